@@ -0,0 +1,230 @@
+#version 440 core
+
+layout(local_size_x = 64) in;
+
+struct GPUObject {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint firstVertex;
+    uint vertexCount;
+    uint flags;
+    uint opaqueVertexCount;
+};
+
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint first;
+    uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer Objects {
+    GPUObject objects[];
+};
+
+// List 0 is the camera's opaque objects, list 1 + i is light i and list
+// 1 + lightCount the camera's transparent objects
+layout(std430, binding = 1) writeonly buffer Commands {
+    DrawCommand commands[];
+};
+
+layout(std430, binding = 2) buffer Counts {
+    uint counts[];
+};
+
+layout(std430, binding = 3) writeonly buffer FaceMasks {
+    uint faceMasks[];
+};
+
+struct Light {
+    vec4 positionRange; // xyz = position, w = shadow far plane
+    uint proxyObject;   // The light's own marker, never a caster
+    uint pad0, pad1, pad2;
+};
+
+layout(std430, binding = 4) readonly buffer Lights {
+    Light lights[];
+};
+
+uniform uint objectCount;
+uniform uint lightCount;
+uniform bool compact;
+uniform vec4 frustumPlanes[6];
+uniform bool shadowFrustumCulling;
+
+uniform bool useOcclusion;
+uniform mat4 prevViewProjection;
+uniform sampler2D hiZ;
+uniform ivec2 hiZSize;
+uniform int hiZLevels;
+
+bool insideFrustum(vec3 center, vec3 extents) {
+    for (int i = 0; i < 6; ++i) {
+        float radius = dot(extents, abs(frustumPlanes[i].xyz));
+        if (dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w < -radius) return false;
+    }
+    return true;
+}
+
+// Test the box against last frame's depth pyramid
+bool occluded(vec3 boxMin, vec3 boxMax) {
+    vec2 ndcMin = vec2( 1.0);
+    vec2 ndcMax = vec2(-1.0);
+    float minDepth = 1.0;
+
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = vec3((i & 1) != 0 ? boxMax.x : boxMin.x,
+                           (i & 2) != 0 ? boxMax.y : boxMin.y,
+                           (i & 4) != 0 ? boxMax.z : boxMin.z);
+        vec4 clip = prevViewProjection * vec4(corner, 1.0);
+        // Box crosses the camera plane, can't be tested
+        if (clip.w <= 0.0) return false;
+
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc.xy);
+        ndcMax = max(ndcMax, ndc.xy);
+        minDepth = min(minDepth, ndc.z * 0.5 + 0.5);
+    }
+
+    // Off last frame's screen, the pyramid has no depth to test it against
+    if (ndcMax.x < -1.0 || ndcMin.x > 1.0 || ndcMax.y < -1.0 || ndcMin.y > 1.0) return false;
+
+    ndcMin = clamp(ndcMin, -1.0, 1.0);
+    ndcMax = clamp(ndcMax, -1.0, 1.0);
+    vec2 pixelMin = (ndcMin * 0.5 + 0.5) * vec2(hiZSize);
+    vec2 pixelMax = (ndcMax * 0.5 + 0.5) * vec2(hiZSize);
+
+    // Pick the level where the rectangle covers at most 2x2 texels
+    float size = max(pixelMax.x - pixelMin.x, pixelMax.y - pixelMin.y);
+    int level = clamp(int(ceil(log2(max(size, 1.0)))), 0, hiZLevels - 1);
+
+    ivec2 levelSize = max(hiZSize >> level, ivec2(1));
+    ivec2 lo = min(ivec2(pixelMin) >> level, levelSize - 1);
+    ivec2 hi = min(ivec2(pixelMax) >> level, levelSize - 1);
+
+    float maxDepth = 0.0;
+    for (int y = lo.y; y <= hi.y; ++y)
+        for (int x = lo.x; x <= hi.x; ++x)
+            maxDepth = max(maxDepth, texelFetch(hiZ, ivec2(x, y), level).r);
+
+    return minDepth > maxDepth;
+}
+
+// Bit per cube face (+X, -X, +Y, -Y, +Z, -Z) the box overlaps, relative to the light
+uint cubeFaceMask(vec3 relMin, vec3 relMax) {
+    uint mask = 0u;
+    for (int face = 0; face < 6; ++face) {
+        int a = face / 2;
+        int b = (a + 1) % 3;
+        int c = (a + 2) % 3;
+        // Furthest the box reaches along the face axis
+        float reach = (face % 2 == 0) ? relMax[a] : -relMin[a];
+
+        if (reach - relMin[b] >= 0.0 && reach + relMax[b] >= 0.0 &&
+            reach - relMin[c] >= 0.0 && reach + relMax[c] >= 0.0)
+            mask |= 1u << uint(face);
+    }
+    return mask;
+}
+
+// Conservative bounds of the region the box can shadow out to the light's
+// range, see shadowVolumeBounds in Bounds.h
+void shadowVolume(vec3 boxMin, vec3 boxMax, vec3 lightPos, float range, out vec3 volumeMin, out vec3 volumeMax) {
+    vec3 lightMin = lightPos - vec3(range);
+    vec3 lightMax = lightPos + vec3(range);
+    volumeMin = lightMin;
+    volumeMax = lightMax;
+
+    vec3 axis = (boxMin + boxMax) * 0.5 - lightPos;
+    if (dot(axis, axis) < 1e-12) return;
+    axis = normalize(axis);
+
+    vec3 directions[8];
+    float minCos = 1.0;
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = vec3((i & 1) != 0 ? boxMax.x : boxMin.x,
+                           (i & 2) != 0 ? boxMax.y : boxMin.y,
+                           (i & 4) != 0 ? boxMax.z : boxMin.z);
+        vec3 d = corner - lightPos;
+        float len = length(d);
+        if (len < 1e-6) return;
+        directions[i] = d / len;
+        minCos = min(minCos, dot(directions[i], axis));
+    }
+    // Light is inside or right next to the box
+    if (minCos < 0.25) return;
+
+    vec3 resultMin = lightPos;
+    vec3 resultMax = lightPos;
+    for (int i = 0; i < 8; ++i) {
+        vec3 p = lightPos + directions[i] * (range / minCos);
+        resultMin = min(resultMin, p);
+        resultMax = max(resultMax, p);
+    }
+    volumeMin = max(resultMin, lightMin);
+    volumeMax = min(resultMax, lightMax);
+}
+
+// Draw vertices [first, first + count) of the object in the list
+void emit(uint list, uint id, uint first, uint count, bool visible) {
+    visible = visible && count > 0u;
+    DrawCommand command = DrawCommand(count, visible ? 1u : 0u, first, id);
+
+    if (compact) {
+        if (!visible) return;
+        uint slot = atomicAdd(counts[list], 1u);
+        commands[list * objectCount + slot] = command;
+    }
+    else {
+        // Keep a fixed slot per object, culled ones draw zero instances
+        if (visible) atomicAdd(counts[list], 1u);
+        commands[list * objectCount + id] = command;
+    }
+}
+
+void main() {
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= objectCount) return;
+
+    GPUObject object = objects[id];
+    mat4 model = object.model;
+
+    // World space AABB
+    vec3 localCenter = (object.boundsMin.xyz + object.boundsMax.xyz) * 0.5;
+    vec3 localExtents = (object.boundsMax.xyz - object.boundsMin.xyz) * 0.5;
+    vec3 center = (model * vec4(localCenter, 1.0)).xyz;
+    vec3 extents = mat3(abs(model[0].xyz), abs(model[1].xyz), abs(model[2].xyz)) * localExtents;
+    vec3 boxMin = center - extents;
+    vec3 boxMax = center + extents;
+
+    // Camera, the opaque faces then the translucent ones for their own pass
+    bool visible = insideFrustum(center, extents);
+    if (visible && useOcclusion)
+        visible = !occluded(boxMin, boxMax);
+    emit(0u, id, object.firstVertex, object.opaqueVertexCount, visible);
+    emit(1u + lightCount, id, object.firstVertex + object.opaqueVertexCount,
+        object.vertexCount - object.opaqueVertexCount, visible);
+
+    // Shadow casters
+    for (uint light = 0u; light < lightCount; ++light) {
+        vec3 lightPos = lights[light].positionRange.xyz;
+        float range = lights[light].positionRange.w;
+        vec3 relMin = boxMin - lightPos;
+        vec3 relMax = boxMax - lightPos;
+
+        uint mask = 0u;
+        if (id != lights[light].proxyObject && length(clamp(vec3(0.0), relMin, relMax)) <= range)
+            mask = cubeFaceMask(relMin, relMax);
+
+        if (mask != 0u && shadowFrustumCulling) {
+            vec3 volumeMin, volumeMax;
+            shadowVolume(boxMin, boxMax, lightPos, range, volumeMin, volumeMax);
+            if (!insideFrustum((volumeMin + volumeMax) * 0.5, (volumeMax - volumeMin) * 0.5))
+                mask = 0u;
+        }
+
+        faceMasks[light * objectCount + id] = mask;
+        emit(1u + light, id, object.firstVertex, object.vertexCount, mask != 0u);
+    }
+}
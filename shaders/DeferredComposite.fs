@@ -0,0 +1,11 @@
+#version 440 core
+
+uniform sampler2D lightAccumulation;
+
+out vec4 FragColor;
+
+// The forward path clamps the sum of the lights, so does this
+void main() {
+    vec4 color = texelFetch(lightAccumulation, ivec2(gl_FragCoord.xy), 0);
+    FragColor = vec4(clamp(color.rgb, 0.0, 1.0), color.a);
+}
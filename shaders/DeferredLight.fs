@@ -0,0 +1,52 @@
+#version 440 core
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+uniform mat4 inverseViewProjection;
+uniform vec2 viewportSize;
+uniform int lightIndex; // -1 for the ambient and fullbright pass
+
+uniform float ambientLight;
+uniform vec3 ambientLightColor;
+
+// Lighting.glsl
+vec3 LightContribution(int index, vec3 fragPos, vec3 norm);
+
+out vec4 FragColor;
+
+vec3 OctahedralDecode(vec2 e) {
+    vec2 f = e * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    // Background
+    if (depth >= 1.0) discard;
+
+    vec4 albedo = texelFetch(gAlbedo, pixel, 0);
+    vec4 normalLit = texelFetch(gNormal, pixel, 0);
+
+    if (lightIndex < 0) {
+        // Ambient under every lit surface, fullbright ones as they are
+        vec3 color = normalLit.a > 0.5 ? albedo.rgb * ambientLightColor * ambientLight : albedo.rgb;
+        FragColor = vec4(color, albedo.a);
+        return;
+    }
+    if (normalLit.a < 0.5) discard;
+
+    // World position back from the depth buffer
+    vec4 clip = vec4(gl_FragCoord.xy / viewportSize * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * clip;
+    vec3 fragPos = world.xyz / world.w;
+
+    // Added over the ambient pass
+    FragColor = vec4(LightContribution(lightIndex, fragPos, OctahedralDecode(normalLit.xy)) * albedo.rgb, 0.0);
+}
@@ -0,0 +1,16 @@
+#version 440 core
+
+layout(location = 0) in vec3 aPos; // Unit light volume, unused for full-screen passes
+
+uniform mat4 viewProjection;
+uniform vec4 volume; // xyz = center, w = radius, 0 for a full-screen triangle
+
+void main() {
+    if (volume.w <= 0.0) {
+        // One triangle over the whole viewport
+        vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+        return;
+    }
+    gl_Position = viewProjection * vec4(volume.xyz + aPos * volume.w, 1.0);
+}
@@ -0,0 +1,5 @@
+#version 440 core
+
+// Light volumes only mark the stencil
+void main() {
+}
@@ -0,0 +1,5 @@
+#version 440 core
+
+// Depth pre-pass, nothing but the rasterized depth
+void main() {
+}
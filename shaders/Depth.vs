@@ -0,0 +1,14 @@
+#version 440 core
+
+layout(location = 0) in vec3 aPos;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// Must match Shader.vs bit for bit, the lit pass tests GL_EQUAL against it
+invariant gl_Position;
+
+void main() {
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
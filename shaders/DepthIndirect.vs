@@ -0,0 +1,29 @@
+#version 440 core
+
+layout(location = 0) in vec3 aPos;
+layout(location = 6) in uint aObjectID; // Per instance, from the draw's baseInstance
+
+struct GPUObject {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint firstVertex;
+    uint vertexCount;
+    uint flags;
+    uint opaqueVertexCount;
+};
+
+layout(std430, binding = 0) readonly buffer Objects {
+    GPUObject objects[];
+};
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// Must match Indirect.vs bit for bit, the lit pass tests GL_EQUAL against it
+invariant gl_Position;
+
+void main() {
+    vec4 worldPos = objects[aObjectID].model * vec4(aPos, 1.0);
+    gl_Position = projection * view * worldPos;
+}
@@ -0,0 +1,45 @@
+#version 440 core
+
+// Depth test before shading, after a pre-pass only the visible fragment runs
+layout(early_fragment_tests) in;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoord;
+flat in int TexID;
+flat in vec3 DiffuseColor;
+flat in float Opacity;
+flat in int UseLighting;
+
+// Texture.glsl
+vec4 SampleTexture(int index, vec2 uv, vec2 dx, vec2 dy);
+
+layout(location = 0) out vec4 AlbedoOpacity;
+layout(location = 1) out vec4 NormalLit; // xy = octahedral normal, a = 1 if lit
+
+// Unit vector to the octahedron folded onto its z >= 0 half, in 0..1
+vec2 OctahedralEncode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 p = n.xy;
+    if (n.z < 0.0) {
+        vec2 signs = vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+        p = (1.0 - abs(p.yx)) * signs;
+    }
+    return p * 0.5 + 0.5;
+}
+
+void main() {
+    vec3 color = DiffuseColor;
+    float alpha = Opacity;
+
+    vec2 texDx = dFdx(TexCoord);
+    vec2 texDy = dFdy(TexCoord);
+    if (TexID >= 0) {
+        vec4 texColor = SampleTexture(TexID, TexCoord, texDx, texDy);
+        color *= texColor.rgb;
+        alpha *= texColor.a;
+    }
+
+    AlbedoOpacity = vec4(color, alpha);
+    NormalLit = vec4(OctahedralEncode(normalize(Normal)), 0.0, UseLighting != 0 ? 1.0 : 0.0);
+}
@@ -0,0 +1,34 @@
+#version 440 core
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+uniform sampler2D depthTexture;
+layout(r32f, binding = 0) uniform readonly image2D srcLevel;
+layout(r32f, binding = 1) uniform writeonly image2D dstLevel;
+
+uniform int level;
+
+void main() {
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 dstSize = imageSize(dstLevel);
+    if (any(greaterThanEqual(p, dstSize))) return;
+
+    if (level == 0) {
+        imageStore(dstLevel, p, vec4(texelFetch(depthTexture, p, 0).r));
+        return;
+    }
+
+    // Farthest depth of the 2x2 footprint. The last texel also takes the odd
+    // row/column of the previous level so the pyramid stays conservative.
+    ivec2 srcSize = imageSize(srcLevel);
+    ivec2 first = p * 2;
+    ivec2 last = first + 1 + ivec2(equal(p, dstSize - 1)) * (srcSize & 1);
+    last = min(last, srcSize - 1);
+
+    float maxDepth = 0.0;
+    for (int y = first.y; y <= last.y; ++y)
+        for (int x = first.x; x <= last.x; ++x)
+            maxDepth = max(maxDepth, imageLoad(srcLevel, ivec2(x, y)).r);
+
+    imageStore(dstLevel, p, vec4(maxDepth));
+}
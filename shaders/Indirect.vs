@@ -0,0 +1,57 @@
+#version 440 core
+
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoord;
+layout(location = 3) in float aTexID;
+layout(location = 4) in vec3 aDiffuseColor;
+layout(location = 5) in float aOpacity;
+layout(location = 6) in uint aObjectID; // Per instance, from the draw's baseInstance
+
+struct GPUObject {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint firstVertex;
+    uint vertexCount;
+    uint flags;
+    uint opaqueVertexCount;
+};
+
+layout(std430, binding = 0) readonly buffer Objects {
+    GPUObject objects[];
+};
+
+#define OBJECT_USE_LIGHTING 1u
+
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoord;
+flat out int TexID;
+flat out vec3 DiffuseColor;
+flat out float Opacity;
+flat out int UseLighting;
+flat out int ObjectIndex;
+
+// Depth.vs and DepthIndirect.vs lay down the same depth for the pre-pass
+invariant gl_Position;
+
+void main() {
+    mat4 model = objects[aObjectID].model;
+
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    gl_Position = projection * view * worldPos;
+
+    FragPos = worldPos.xyz;
+    Normal = mat3(transpose(inverse(model))) * aNormal;
+
+    TexCoord = aTexCoord;
+    TexID = int(aTexID);
+    DiffuseColor = aDiffuseColor;
+    Opacity = aOpacity;
+    UseLighting = (objects[aObjectID].flags & OBJECT_USE_LIGHTING) != 0u ? 1 : 0;
+    ObjectIndex = int(aObjectID);
+}
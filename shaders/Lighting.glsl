@@ -0,0 +1,265 @@
+#version 440 core
+
+// Light and shadow evaluation shared by the forward (Shader.fs) and deferred
+// (DeferredLight.fs) lighting, linked into both as a second fragment shader
+
+#define MAX_SHADOW_TIERS 6
+
+#define SHADOW_FILTER_NEAREST 0
+#define SHADOW_FILTER_PCF 1
+#define SHADOW_FILTER_EVSM 2
+
+// Must match ShadowPrefilter.cs
+#define EVSM_POSITIVE 5.0
+#define EVSM_NEGATIVE 5.0
+
+#define LIGHT_POINT 0
+#define LIGHT_SPOT 1
+#define LIGHT_DIRECTIONAL 2
+
+struct Light {
+    vec4 positionRange;  // xyz = position, w = shadow far plane, 0 without a shadow map
+    vec4 colorIntensity; // rgb = color, a = intensity
+    vec4 direction;      // xyz = direction the light shines, w = cosine of the spot's outer cone
+    int shadowTier;      // Which shadowMaps[] array holds the cubemap
+    int shadowCube;      // Cube index in that array
+    int shadowMode;      // 0 = cube, 1 = dual-paraboloid in the cube's +X and -X faces
+    int type;            // LIGHT_POINT, LIGHT_SPOT or LIGHT_DIRECTIONAL
+    int matrixIndex;     // First of the spot's or cascades' matrices in shadowMatrices[]
+    int cascadeCount;
+    float cosInnerCone;
+    float shadowFade;    // Shadow strength while the light gains or loses its map
+    int shadowMaskChannel; // Channel of shadowMask holding the resolved shadow, -1 for none
+    int pad0;
+    int pad1;
+    int pad2;
+};
+
+layout(std430, binding = 5) readonly buffer Lights {
+    Light lights[];
+};
+
+// View-projections of the spot and directional shadow maps
+layout(std430, binding = 7) readonly buffer ShadowMatrices {
+    mat4 shadowMatrices[];
+};
+
+// One cubemap array per shadow resolution tier, EVSM moments with that filter
+uniform samplerCubeArray shadowMaps[MAX_SHADOW_TIERS];
+// The same depth arrays with linear filtered compares
+uniform samplerCubeArrayShadow shadowCompareMaps[MAX_SHADOW_TIERS];
+uniform int shadowFilter;
+
+// Shadows of the most important lights resolved per pixel by ShadowMask.fs,
+// four lights per layer. Only valid for the opaque draws in the pre-pass's depth.
+layout(rgba8, binding = 2) readonly uniform image2DArray shadowMask;
+uniform bool shadowMaskEnabled;
+
+// Sampler arrays may only be indexed with dynamically uniform expressions and
+// the tier differs between lights and pixels, so these pick the tier's sampler
+// by comparing against each constant index
+int ShadowMapSize(int tier) {
+    int size = 1;
+    for (int t = 0; t < MAX_SHADOW_TIERS; ++t)
+        if (t == tier) size = textureSize(shadowCompareMaps[t], 0).x;
+    return size;
+}
+
+vec4 ShadowMoments(int tier, vec4 coord) {
+    vec4 moments = vec4(0.0);
+    for (int t = 0; t < MAX_SHADOW_TIERS; ++t)
+        if (t == tier) moments = texture(shadowMaps[t], coord);
+    return moments;
+}
+
+float ShadowCompare(int tier, vec4 coord, float depth) {
+    float lit = 0.0;
+    for (int t = 0; t < MAX_SHADOW_TIERS; ++t)
+        if (t == tier) lit = texture(shadowCompareMaps[t], coord, depth);
+    return lit;
+}
+
+// Direction that samples texel uv of a cube face, for the 2D maps kept in
+// the cube array's faces
+vec3 faceTexel(int face, vec2 uv) {
+    vec2 st = uv * 2.0 - 1.0;
+    switch (face) {
+    case 0:  return vec3( 1.0, -st.y, -st.x);
+    case 1:  return vec3(-1.0, -st.y,  st.x);
+    case 2:  return vec3( st.x,  1.0,  st.y);
+    case 3:  return vec3( st.x, -1.0, -st.y);
+    case 4:  return vec3( st.x, -st.y,  1.0);
+    default: return vec3(-st.x, -st.y, -1.0);
+    }
+}
+
+// Upper bound on the lit fraction from one pair of moments
+float Chebyshev(vec2 moments, float depth, float minVariance) {
+    if (depth <= moments.x) return 1.0;
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = depth - moments.x;
+    return variance / (variance + d * d);
+}
+
+// How much of the map's texels around lookup are closer than depth (0..1 of
+// the map's range), filtered with the selected filter
+float SampleShadow(Light light, vec3 lookup, float depth) {
+    vec4 coord = vec4(lookup, float(light.shadowCube));
+
+    if (shadowFilter == SHADOW_FILTER_PCF) {
+        // Four bilinear compares half a texel apart, a tent over 3x3 texels.
+        // The offsets stay on the face, the 2D maps in it don't continue across.
+        vec3 a = abs(lookup);
+        float major = max(a.x, max(a.y, a.z));
+        vec3 axis = vec3(greaterThanEqual(a, vec3(major)));
+        vec3 direction = lookup / major;
+        vec3 tangent = axis.x > 0.0 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+        vec3 bitangent = axis.z > 0.0 ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0);
+        float halfTexel = 1.0 / float(ShadowMapSize(light.shadowTier));
+        float limit = 1.0 - halfTexel;
+
+        float lit = 0.0;
+        for (int i = 0; i < 4; ++i) {
+            vec2 offset = vec2(i & 1, i >> 1) * 2.0 - 1.0;
+            vec3 tap = direction + (tangent * offset.x + bitangent * offset.y) * halfTexel;
+            tap = mix(clamp(tap, -limit, limit), direction, axis);
+            lit += ShadowCompare(light.shadowTier, vec4(tap, coord.w), depth);
+        }
+        return 1.0 - lit * 0.25;
+    }
+
+    if (shadowFilter == SHADOW_FILTER_EVSM) {
+        // Both warps bound the lit fraction, the tighter one wins
+        vec4 moments = ShadowMoments(light.shadowTier, coord);
+        float d = clamp(depth, 0.0, 1.0) * 2.0 - 1.0;
+        float positive = exp(EVSM_POSITIVE * d);
+        float negative = -exp(-EVSM_NEGATIVE * d);
+        float positiveLit = Chebyshev(moments.xy, positive, 1e-4 * positive * positive);
+        float negativeLit = Chebyshev(moments.zw, negative, 1e-4 * negative * negative);
+        // Cut off the low tail to reduce light bleeding
+        float lit = clamp((min(positiveLit, negativeLit) - 0.2) / 0.8, 0.0, 1.0);
+        return 1.0 - lit;
+    }
+
+    float closestDepth = ShadowMoments(light.shadowTier, coord).r;
+    return depth > closestDepth ? 1.0 : 0.0;
+}
+
+float DirectionalShadow(vec3 fragPos, Light light, float cosTheta) {
+    // First cascade that covers the fragment, they're ordered near to far
+    for (int i = 0; i < light.cascadeCount; ++i) {
+        mat4 matrix = shadowMatrices[light.matrixIndex + i];
+        vec3 p = (matrix * vec4(fragPos, 1.0)).xyz;
+        if (any(greaterThan(abs(p), vec3(1.0)))) continue;
+
+        vec2 uv = p.xy * 0.5 + 0.5;
+        float currentDepth = p.z * 0.5 + 0.5;
+
+        // Bias by the texel's world size along the slope, in depth units
+        float scaleXY = length(vec3(matrix[0][0], matrix[1][0], matrix[2][0]));
+        float scaleZ = length(vec3(matrix[0][2], matrix[1][2], matrix[2][2]));
+        float texelWorld = 2.0 / (scaleXY * float(ShadowMapSize(light.shadowTier)));
+        float tanTheta = sqrt(1.0 - cosTheta * cosTheta) / max(cosTheta, 0.25);
+        float footprint = shadowFilter == SHADOW_FILTER_NEAREST ? 1.0 : 2.0;
+        float bias = (0.02 + texelWorld * (1.0 + tanTheta) * footprint) * scaleZ * 0.5;
+
+        return SampleShadow(light, faceTexel(i, uv), currentDepth - bias);
+    }
+    return 0.0;
+}
+
+float ShadowCalculation(vec3 fragPos, vec3 normal, Light light, vec3 lightDir) {
+    // Light without a shadow map
+    float farPlane = light.positionRange.w;
+    if (farPlane <= 0.0) return 0.0;
+
+    float cosTheta = max(dot(normal, lightDir), 0.0);
+    if (light.type == LIGHT_DIRECTIONAL) return DirectionalShadow(fragPos, light, cosTheta);
+
+    vec3 fragToLight = fragPos - light.positionRange.xyz;
+
+    int mapSize = ShadowMapSize(light.shadowTier);
+    vec3 lookup = fragToLight;
+    // Angle a texel spans, the filters reach over more of them. Nearest keeps
+    // the cube's original bias.
+    float texelAngle = shadowFilter == SHADOW_FILTER_NEAREST ? 0.0 : 2.0 / float(mapSize);
+    float footprint = shadowFilter == SHADOW_FILTER_NEAREST ? 1.0 : 2.0;
+    if (light.shadowMode == 1) {
+        // Hemisphere frame with +Z along +Y or -Y, warped like ShadowParaboloid.vs
+        vec3 n = normalize(fragToLight);
+        vec3 p = n.y >= 0.0 ? vec3(n.x, -n.z, n.y) : vec3(n.x, n.z, -n.y);
+        vec2 uv = vec2(-p.x, p.y) / (1.0 + p.z) * 0.5 + 0.5;
+        // The hemispheres live in the +X and -X faces, aim at the texel there
+        lookup = faceTexel(n.y >= 0.0 ? 0 : 1, uv);
+        // Texels cover wider angles than the cube's, bias by their footprint
+        texelAngle = 2.0 * (1.0 + p.z) / float(mapSize);
+    } else if (light.type == LIGHT_SPOT) {
+        // Projected into face 0, nothing outside the cone is lit anyway
+        mat4 matrix = shadowMatrices[light.matrixIndex];
+        vec4 clip = matrix * vec4(fragPos, 1.0);
+        if (clip.w <= 0.0) return 0.0;
+        vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+        if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) return 0.0;
+        lookup = faceTexel(0, uv);
+        texelAngle = 2.0 / (matrix[1][1] * float(mapSize));
+    }
+
+    float currentDepth = length(fragToLight);
+
+    float bias = 0.005 + 0.05 * (1.0 - cosTheta);
+    float tanTheta = sqrt(1.0 - cosTheta * cosTheta) / max(cosTheta, 0.25);
+    bias += currentDepth * texelAngle * tanTheta * footprint;
+
+    // The maps hold distance / far plane
+    return SampleShadow(light, lookup, (currentDepth - bias) / farPlane);
+}
+
+// Shadow on a surface point from one light, faded as the pool picks lights
+float LightShadow(int index, vec3 fragPos, vec3 norm) {
+    Light light = lights[index];
+    vec3 lightDir = light.type == LIGHT_DIRECTIONAL ? -light.direction.xyz
+                                                    : normalize(light.positionRange.xyz - fragPos);
+    return ShadowCalculation(fragPos, norm, light, lightDir) * light.shadowFade;
+}
+
+// Diffuse light reaching a surface point from one light, shadowed
+vec3 LightContribution(int index, vec3 fragPos, vec3 norm) {
+    Light light = lights[index];
+    vec3 lightPos = light.positionRange.xyz;
+    vec3 lightDir = normalize(lightPos - fragPos);
+    float attenuation = 1.0;
+
+    if (light.type == LIGHT_DIRECTIONAL) {
+        // Sunlight, parallel and not attenuated
+        lightDir = -light.direction.xyz;
+    } else {
+        // Distance attenuation, must match Light.h
+        float constant = 1.0;
+        float linear = 0.09;
+        float quadratic = 0.032;
+
+        float distance = length(lightPos - fragPos);
+        if (distance < 1e-6) distance = 1e-6;
+        attenuation = 1.0 / max(
+            constant +
+            linear * distance +
+            quadratic * distance * distance,
+        1e-6);
+
+        // Soft edge between the spot's inner and outer cone
+        if (light.type == LIGHT_SPOT)
+            attenuation *= smoothstep(light.direction.w, light.cosInnerCone, dot(-lightDir, light.direction.xyz));
+    }
+    float ndotl = max(dot(norm, lightDir), 0.0);
+    if (ndotl * attenuation <= 0.0) return vec3(0.0);
+
+    float shadow;
+    if (shadowMaskEnabled && light.shadowMaskChannel >= 0) {
+        // Already resolved for this pixel
+        ivec3 texel = ivec3(gl_FragCoord.xy, light.shadowMaskChannel >> 2);
+        shadow = imageLoad(shadowMask, texel)[light.shadowMaskChannel & 3];
+    } else {
+        shadow = ShadowCalculation(fragPos, norm, light, lightDir) * light.shadowFade;
+    }
+    return light.colorIntensity.rgb * light.colorIntensity.a * ndotl * attenuation * (1.0 - shadow);
+}
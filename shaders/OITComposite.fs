@@ -0,0 +1,21 @@
+#version 440 core
+
+uniform sampler2D accumulation; // rgb = sum of weighted premultiplied color, a = sum of weighted alpha
+uniform sampler2D revealage;    // Product of 1 - alpha, how much of the scene shows through
+
+out vec4 FragColor;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float revealed = texelFetch(revealage, pixel, 0).r;
+    // Nothing transparent covers the pixel
+    if (revealed >= 1.0) discard;
+
+    vec4 sum = texelFetch(accumulation, pixel, 0);
+    // Half floats overflow under many bright layers, clamp each channel to keep the hue
+    sum = min(sum, vec4(65504.0));
+    vec3 average = sum.rgb / max(sum.a, 1e-5);
+
+    // Blended over the scene with GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+    FragColor = vec4(average, 1.0 - revealed);
+}
@@ -0,0 +1,14 @@
+#version 440 core
+
+// One box per instance, drawn for an occlusion query
+layout(location = 0) in vec3 boxCenter;
+layout(location = 1) in vec3 boxExtents;
+
+uniform mat4 viewProjection;
+
+void main() {
+    // 14 vertex triangle strip over the unit cube's faces
+    uint bit = 1u << gl_VertexID;
+    vec3 corner = vec3((0x287Au & bit) != 0u, (0x02AFu & bit) != 0u, (0x31E3u & bit) != 0u);
+    gl_Position = viewProjection * vec4(boxCenter + (corner * 2.0 - 1.0) * boxExtents, 1.0);
+}
@@ -1,7 +1,7 @@
 #version 440 core
 
-#define MAX_TEXTURES 16
-#define MAX_LIGHTS 16
+// Depth test before shading, after a pre-pass only the visible fragment runs
+layout(early_fragment_tests) in;
 
 in vec3 FragPos;
 in vec3 Normal;
@@ -9,39 +9,67 @@ in vec2 TexCoord;
 flat in int TexID;
 flat in vec3 DiffuseColor;
 flat in float Opacity;
+flat in int UseLighting;
+flat in int ObjectIndex;
 
-uniform sampler2D textures[MAX_TEXTURES];
+// Texture.glsl
+vec4 SampleTexture(int index, vec2 uv, vec2 dx, vec2 dy);
+
+// Lighting.glsl
+vec3 LightContribution(int index, vec3 fragPos, vec3 norm);
 
-uniform bool useLighting;
 uniform int numLights;
-uniform vec3 lightPositions[MAX_LIGHTS];
-uniform vec3 lightColors[MAX_LIGHTS];
-uniform float lightIntensities[MAX_LIGHTS];
 
-uniform float lightFarPlanes[MAX_LIGHTS];
-uniform samplerCube depthMaps[MAX_LIGHTS];
+// Must match LightGrid.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+// Offset and count into clusterLights[] per cluster, the last entry lists the
+// lights without a range
+layout(std430, binding = 8) readonly buffer LightGrid {
+    uvec2 clusterRanges[];
+};
+layout(std430, binding = 9) readonly buffer LightIndices {
+    uint clusterLights[];
+};
+uniform vec2 clusterTileSize; // Pixels per cluster tile
+uniform float clusterNear;
+uniform float clusterFar;
+
+// Offset and count into objectLights[] per GPUScene object
+layout(std430, binding = 10) readonly buffer ObjectLightRanges {
+    uvec2 objectLightRanges[];
+};
+layout(std430, binding = 11) readonly buffer ObjectLightIndices {
+    uint objectLights[];
+};
+
+// Must match LightCulling in ObjectLightLists.h
+#define LIGHT_CULLING_NONE 0
+#define LIGHT_CULLING_CLUSTERED 1
+#define LIGHT_CULLING_OBJECT 2
+uniform int lightCulling;
 
 uniform float ambientLight;
 uniform vec3 ambientLightColor;
 
-out vec4 FragColor;
-
-float ShadowCalculation(vec3 fragPos, int lightIndex) {
-    vec3 fragToLight = fragPos - lightPositions[lightIndex];
-
-    float closestDepth = texture(depthMaps[lightIndex], fragToLight).r;
-    closestDepth *= lightFarPlanes[lightIndex];
-
-    float currentDepth = length(fragToLight);
-
-    vec3 normal = normalize(Normal);
-    vec3 lightDir = normalize(lightPositions[lightIndex] - fragPos);
-    float cosTheta = max(dot(normal, lightDir), 0.0);
-    float bias = 0.005 + 0.05 * (1.0 - cosTheta);
-
-    float shadow = currentDepth - bias > closestDepth ? 1.0 : 0.0;
-
-    return shadow;
+// Transparent draws into WeightedBlendedOIT's targets instead of blending in order
+uniform bool weightedBlended;
+
+layout(location = 0) out vec4 FragColor;
+layout(location = 1) out vec4 Revealage;
+
+// Froxel of the fragment, must match LightGrid's slices
+uint ClusterIndex() {
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterTileSize), uvec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    // Back to view depth, then slices grow exponentially from the near plane
+    float ndcZ = gl_FragCoord.z * 2.0 - 1.0;
+    float depth = 2.0 * clusterNear * clusterFar / (clusterFar + clusterNear - ndcZ * (clusterFar - clusterNear));
+    float slice = log(max(depth, clusterNear) / clusterNear) / log(clusterFar / clusterNear) * float(CLUSTER_Z);
+    uint z = min(uint(slice), uint(CLUSTER_Z - 1));
+    return (z * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x;
 }
 
 void main() {
@@ -50,36 +78,35 @@ void main() {
     float alpha = Opacity;
 
     // Apply texture if available
+    vec2 texDx = dFdx(TexCoord);
+    vec2 texDy = dFdy(TexCoord);
     if (TexID >= 0) {
-        vec4 texColor = texture(textures[TexID], TexCoord);
+        vec4 texColor = SampleTexture(TexID, TexCoord, texDx, texDy);
         color *= texColor.rgb;
         alpha *= texColor.a;
     }
 
     vec3 finalColor;
-    if (useLighting) {
+    if (UseLighting != 0) {
         vec3 diffuse = vec3(0.0);
         vec3 norm = normalize(Normal);
 
-        for (int i = 0; i < numLights; ++i) {
-            vec3 lightDir = normalize(lightPositions[i] - FragPos);
-            float ndotl = max(dot(norm, lightDir), 0.0);
-
-            // Distance attenuation
-            float constant = 1.0;
-            float linear = 0.09;
-            float quadratic = 0.032;
-
-            float distance = length(lightPositions[i] - FragPos);
-            if (distance < 1e-6) distance = 1e-6;
-            float attenuation = 1.0 / max(
-                constant +
-                linear * distance +
-                quadratic * distance * distance,
-            1e-6);
-
-            float shadow = ShadowCalculation(FragPos, i);
-            diffuse += lightColors[i] * lightIntensities[i] * ndotl * attenuation * (1.0 - shadow);
+        if (lightCulling == LIGHT_CULLING_CLUSTERED) {
+            // The fragment's cluster, then the lights that reach everywhere
+            uvec2 range = clusterRanges[ClusterIndex()];
+            for (uint i = 0; i < range.y; ++i)
+                diffuse += LightContribution(int(clusterLights[range.x + i]), FragPos, norm);
+            range = clusterRanges[CLUSTER_COUNT];
+            for (uint i = 0; i < range.y; ++i)
+                diffuse += LightContribution(int(clusterLights[range.x + i]), FragPos, norm);
+        } else if (lightCulling == LIGHT_CULLING_OBJECT) {
+            // The strongest lights reaching the object
+            uvec2 range = objectLightRanges[ObjectIndex];
+            for (uint i = 0; i < range.y; ++i)
+                diffuse += LightContribution(int(objectLights[range.x + i]), FragPos, norm);
+        } else {
+            for (int i = 0; i < numLights; ++i)
+                diffuse += LightContribution(i, FragPos, norm);
         }
         diffuse *= color;
 
@@ -91,5 +118,15 @@ void main() {
         finalColor = color;
     }
 
-    FragColor = vec4(clamp(finalColor, 0.0, 1.0), alpha);
+    finalColor = clamp(finalColor, 0.0, 1.0);
+    if (weightedBlended) {
+        // Nearer and more opaque layers weigh more, view depth from the clip w.
+        // Capped so 200 opaque near layers still fit in the half float targets.
+        float depth = 1.0 / gl_FragCoord.w;
+        float weight = alpha * clamp(0.03 / (1e-5 + pow(depth / 200.0, 4.0)), 1e-2, 3e2);
+        FragColor = vec4(finalColor * alpha, alpha) * weight;
+        Revealage = vec4(alpha);
+        return;
+    }
+    FragColor = vec4(finalColor, alpha);
 }
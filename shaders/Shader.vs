@@ -3,13 +3,15 @@
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoord;
-layout(location = 3) in int aTexID;
+layout(location = 3) in float aTexID;
 layout(location = 4) in vec3 aDiffuseColor;
 layout(location = 5) in float aOpacity;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform bool useLighting;
+uniform int objectIndex; // GPUScene index, selects the object's light list
 
 out vec3 FragPos;
 out vec3 Normal;
@@ -17,6 +19,11 @@ out vec2 TexCoord;
 flat out int TexID;
 flat out vec3 DiffuseColor;
 flat out float Opacity;
+flat out int UseLighting;
+flat out int ObjectIndex;
+
+// Depth.vs and DepthIndirect.vs lay down the same depth for the pre-pass
+invariant gl_Position;
 
 void main() {
     // Transform the vertex into clip space
@@ -28,7 +35,9 @@ void main() {
 
     // Passing attributes to the fragment shader
     TexCoord = aTexCoord; // Rasteriser will interpolate the UV
-    TexID = aTexID;
+    TexID = int(aTexID);
     DiffuseColor = aDiffuseColor;
     Opacity = aOpacity;
+    UseLighting = useLighting ? 1 : 0;
+    ObjectIndex = objectIndex;
 }
@@ -4,15 +4,33 @@ layout (triangles) in;
 layout (triangle_strip, max_vertices=18) out;
 
 uniform mat4 shadowMatrices[6];
+uniform int layerBase; // The light's first face in the cubemap array
+
+flat in int FaceMask[];
 
 out vec4 FragPos;
 
+// True if all three vertices are outside the same clip plane
+bool outsideFace(vec4 a, vec4 b, vec4 c) {
+    return (a.x < -a.w && b.x < -b.w && c.x < -c.w) || (a.x > a.w && b.x > b.w && c.x > c.w) ||
+           (a.y < -a.w && b.y < -b.w && c.y < -c.w) || (a.y > a.w && b.y > b.w && c.y > c.w) ||
+           (a.z < -a.w && b.z < -b.w && c.z < -c.w) || (a.z > a.w && b.z > b.w && c.z > c.w);
+}
+
 void main() {
     for(int face = 0; face < 6; ++face) {
-        gl_Layer = face;
+        if ((FaceMask[0] & (1 << face)) == 0) continue;
+
+        // Only emit into the faces the triangle projects into
+        vec4 clip[3];
+        for(int i = 0; i < 3; ++i)
+            clip[i] = shadowMatrices[face] * gl_in[i].gl_Position;
+        if (outsideFace(clip[0], clip[1], clip[2])) continue;
+
+        gl_Layer = layerBase + face;
         for(int i = 0; i < 3; ++i) {
             FragPos = gl_in[i].gl_Position;
-            gl_Position = shadowMatrices[face] * FragPos;
+            gl_Position = clip[i];
             EmitVertex();
         }
         EndPrimitive();
@@ -3,7 +3,11 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 model;
+uniform int faceMask; // Cube faces this object reaches
+
+flat out int FaceMask;
 
 void main() {
     gl_Position = model * vec4(aPos, 1.0);
+    FaceMask = faceMask;
 }
\ No newline at end of file
@@ -0,0 +1,40 @@
+#version 440 core
+
+in vec4 FragPos;
+flat in vec4 LightPositionFar; // Per instance, lights differ within one draw
+flat in int Hemisphere;        // -1 for cube faces, -2 for ortho cascades
+
+uniform float mapSize;
+
+// World direction of a hemisphere frame direction
+vec3 fromHemisphere(vec3 p, int h) {
+    return h == 0 ? vec3(p.x, p.z, -p.y) : vec3(p.x, -p.z, p.y);
+}
+
+void main() {
+    // Orthographic depth is already linear
+    if (Hemisphere == -2) {
+        gl_FragDepth = gl_FragCoord.z;
+        return;
+    }
+
+    vec3 toFragment = FragPos.xyz - LightPositionFar.xyz;
+    vec3 normal = cross(dFdx(FragPos.xyz), dFdy(FragPos.xyz));
+    float lightDistance = length(toFragment);
+
+    if (Hemisphere >= 0) {
+        // Same plane intersection as ShadowParaboloid.fs
+        vec2 q = gl_FragCoord.xy / mapSize * 2.0 - 1.0;
+        float q2 = dot(q, q);
+        float z = (1.0 - q2) / (1.0 + q2);
+        vec3 direction = fromHemisphere(vec3(-q.x * (1.0 + z), q.y * (1.0 + z), z), Hemisphere);
+
+        float facing = dot(direction, normal);
+        if (abs(facing) > 1e-6 * length(normal)) {
+            float planeDistance = dot(toFragment, normal) / facing;
+            if (planeDistance > 0.0) lightDistance = planeDistance;
+        }
+    }
+
+    gl_FragDepth = clamp(lightDistance / LightPositionFar.w, 0.0, 1.0);
+}
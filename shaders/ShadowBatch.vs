@@ -0,0 +1,67 @@
+#version 440 core
+#extension GL_ARB_shader_viewport_layer_array : require
+
+layout (location = 0) in vec3 aPos;
+layout (location = 6) in uvec2 aInstance; // Object, light * 6 + face
+
+struct GPUObject {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint firstVertex;
+    uint vertexCount;
+    uint flags;
+    uint opaqueVertexCount;
+};
+
+struct ShadowLight {
+    mat4 faceMatrices[6];
+    vec4 positionFar; // xyz = position, w = shadow far plane
+    int layer;        // First cube face layer drawn into
+    int mode;         // 0 = perspective, 1 = faces 0 and 1 are dual-paraboloid hemispheres, 2 = ortho
+    int pad0;
+    int pad1;
+};
+
+layout(std430, binding = 0) readonly buffer Objects {
+    GPUObject objects[];
+};
+
+layout(std430, binding = 6) readonly buffer ShadowLights {
+    ShadowLight shadowLights[];
+};
+
+out vec4 FragPos;
+flat out vec4 LightPositionFar;
+flat out int Hemisphere; // -1 for cube faces, -2 for ortho cascades
+out float gl_ClipDistance[1];
+
+// Light-relative direction in the hemisphere's frame, +Z along its axis
+vec3 toHemisphere(vec3 d, int h) {
+    return h == 0 ? vec3(d.x, -d.z, d.y) : vec3(d.x, d.z, -d.y);
+}
+
+void main() {
+    uint light = aInstance.y / 6u;
+    int face = int(aInstance.y % 6u);
+    vec4 positionFar = shadowLights[light].positionFar;
+
+    FragPos = objects[aInstance.x].model * vec4(aPos, 1.0);
+    gl_Layer = shadowLights[light].layer + face;
+    LightPositionFar = positionFar;
+
+    int mode = shadowLights[light].mode;
+    if (mode == 1) {
+        // Same warp as ShadowParaboloid.vs
+        vec3 p = toHemisphere(FragPos.xyz - positionFar.xyz, face);
+        float distance = length(p);
+        vec3 n = p / max(distance, 1e-6);
+        gl_Position = vec4(vec2(-n.x, n.y) / (1.0 + max(n.z, -0.999)), distance / positionFar.w * 2.0 - 1.0, 1.0);
+        gl_ClipDistance[0] = n.z;
+        Hemisphere = face;
+    } else {
+        gl_Position = shadowLights[light].faceMatrices[face] * FragPos;
+        gl_ClipDistance[0] = 1.0;
+        Hemisphere = mode == 2 ? -2 : -1;
+    }
+}
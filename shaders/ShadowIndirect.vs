@@ -0,0 +1,33 @@
+#version 440 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 6) in uint aObjectID; // Per instance, from the draw's baseInstance
+
+struct GPUObject {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint firstVertex;
+    uint vertexCount;
+    uint flags;
+    uint opaqueVertexCount;
+};
+
+layout(std430, binding = 0) readonly buffer Objects {
+    GPUObject objects[];
+};
+
+// Cube faces each caster touches, written by the cull pass
+layout(std430, binding = 3) readonly buffer FaceMasks {
+    uint faceMasks[];
+};
+
+uniform uint lightIndex;
+uniform uint objectCount;
+
+flat out int FaceMask;
+
+void main() {
+    gl_Position = objects[aObjectID].model * vec4(aPos, 1.0);
+    FaceMask = int(faceMasks[lightIndex * objectCount + aObjectID]);
+}
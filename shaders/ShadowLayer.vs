@@ -0,0 +1,24 @@
+#version 440 core
+#extension GL_ARB_shader_viewport_layer_array : require
+
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+uniform mat4 shadowMatrices[6];
+uniform int layerBase; // The light's first face in the cubemap array
+uniform int faceMask;  // Cube faces this object reaches, one instance per face
+
+out vec4 FragPos;
+
+void main() {
+    // The instance picks the n-th face set in the mask
+    int face = 0;
+    for (int remaining = gl_InstanceID; face < 6; ++face) {
+        if ((faceMask & (1 << face)) == 0) continue;
+        if (remaining-- == 0) break;
+    }
+
+    FragPos = model * vec4(aPos, 1.0);
+    gl_Position = shadowMatrices[face] * FragPos;
+    gl_Layer = layerBase + face;
+}
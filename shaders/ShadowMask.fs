@@ -0,0 +1,59 @@
+#version 440 core
+
+// Must match ShadowMask.h
+#define SHADOW_MASK_LAYERS 2
+#define MAX_SHADOW_MASK_LIGHTS (4 * SHADOW_MASK_LAYERS)
+
+uniform sampler2D sceneDepth; // The pre-pass depth
+
+uniform mat4 inverseViewProjection;
+uniform vec2 viewportSize;
+uniform int channelLights[MAX_SHADOW_MASK_LIGHTS]; // Light of each channel, -1 for none
+
+// Lighting.glsl
+float LightShadow(int index, vec3 fragPos, vec3 norm);
+
+layout(location = 0) out vec4 Mask[SHADOW_MASK_LAYERS];
+
+vec3 WorldPosition(ivec2 pixel) {
+    float depth = texelFetch(sceneDepth, pixel, 0).r;
+    vec4 clip = vec4((vec2(pixel) + 0.5) / viewportSize * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * clip;
+    return world.xyz / world.w;
+}
+
+// Of the differences to the two neighbours, the one on the same surface
+vec3 SurfaceDelta(ivec2 pixel, ivec2 step, vec3 center, float depth) {
+    ivec2 maxPixel = ivec2(viewportSize) - 1;
+    ivec2 before = clamp(pixel - step, ivec2(0), maxPixel);
+    ivec2 after = clamp(pixel + step, ivec2(0), maxPixel);
+    float depthBefore = texelFetch(sceneDepth, before, 0).r;
+    float depthAfter = texelFetch(sceneDepth, after, 0).r;
+    bool useAfter = abs(depthAfter - depth) < abs(depthBefore - depth);
+    // At the screen edge only one side exists
+    if (before == pixel) useAfter = true;
+    if (after == pixel) useAfter = false;
+    if (useAfter) return WorldPosition(after) - center;
+    return center - WorldPosition(before);
+}
+
+void main() {
+    for (int layer = 0; layer < SHADOW_MASK_LAYERS; ++layer) Mask[layer] = vec4(0.0);
+
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(sceneDepth, pixel, 0).r;
+    // Background
+    if (depth >= 1.0) return;
+
+    // Geometric normal from the depth, towards the camera
+    vec3 fragPos = WorldPosition(pixel);
+    vec3 dx = SurfaceDelta(pixel, ivec2(1, 0), fragPos, depth);
+    vec3 dy = SurfaceDelta(pixel, ivec2(0, 1), fragPos, depth);
+    vec3 norm = normalize(cross(dx, dy));
+
+    for (int channel = 0; channel < MAX_SHADOW_MASK_LIGHTS; ++channel) {
+        int index = channelLights[channel];
+        if (index < 0) break;
+        Mask[channel >> 2][channel & 3] = LightShadow(index, fragPos, norm);
+    }
+}
@@ -0,0 +1,6 @@
+#version 440 core
+
+// Directional cascades keep the rasterized depth, it's linear in an
+// orthographic projection
+void main() {
+}
@@ -0,0 +1,34 @@
+#version 440 core
+
+in vec4 FragPos;
+
+uniform vec3 lightPos;
+uniform float far_plane;
+uniform int hemisphere;
+uniform float mapSize;
+
+// World direction of a hemisphere frame direction
+vec3 fromHemisphere(vec3 p, int h) {
+    return h == 0 ? vec3(p.x, p.z, -p.y) : vec3(p.x, -p.z, p.y);
+}
+
+void main() {
+    // The warp bends edges, so the interpolated position isn't the point this
+    // texel looks at. Intersect the texel's ray with the triangle's plane.
+    vec2 q = gl_FragCoord.xy / mapSize * 2.0 - 1.0;
+    float q2 = dot(q, q);
+    float z = (1.0 - q2) / (1.0 + q2);
+    vec3 direction = fromHemisphere(vec3(-q.x * (1.0 + z), q.y * (1.0 + z), z), hemisphere);
+
+    vec3 toFragment = FragPos.xyz - lightPos;
+    vec3 normal = cross(dFdx(FragPos.xyz), dFdy(FragPos.xyz));
+    float facing = dot(direction, normal);
+    float lightDistance = length(toFragment);
+    if (abs(facing) > 1e-6 * length(normal)) {
+        float planeDistance = dot(toFragment, normal) / facing;
+        // Grazing or behind the light, keep the interpolated distance
+        if (planeDistance > 0.0) lightDistance = planeDistance;
+    }
+
+    gl_FragDepth = clamp(lightDistance / far_plane, 0.0, 1.0);
+}
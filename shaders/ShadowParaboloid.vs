@@ -0,0 +1,29 @@
+#version 440 core
+
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+uniform vec3 lightPos;
+uniform float far_plane;
+uniform int hemisphere; // 0 = +Y, 1 = -Y
+
+out vec4 FragPos;
+out float gl_ClipDistance[1];
+
+// Light-relative direction in the hemisphere's frame, +Z along its axis
+vec3 toHemisphere(vec3 d, int h) {
+    return h == 0 ? vec3(d.x, -d.z, d.y) : vec3(d.x, d.z, -d.y);
+}
+
+void main() {
+    FragPos = model * vec4(aPos, 1.0);
+
+    // Paraboloid warp, x mirrored to keep the cube faces' winding
+    vec3 p = toHemisphere(FragPos.xyz - lightPos, hemisphere);
+    float distance = length(p);
+    vec3 n = p / max(distance, 1e-6);
+    gl_Position = vec4(vec2(-n.x, n.y) / (1.0 + max(n.z, -0.999)), distance / far_plane * 2.0 - 1.0, 1.0);
+
+    // Drop what's behind the hemisphere
+    gl_ClipDistance[0] = n.z;
+}
@@ -0,0 +1,68 @@
+#version 440 core
+
+#define MAX_RADIUS 8
+
+// Exponents of the warp, the squared positive moment must fit in a half float
+#define EVSM_POSITIVE 5.0
+#define EVSM_NEGATIVE 5.0
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+uniform samplerCubeArray depthMaps;
+layout(rgba32f, binding = 0) uniform image2DArray scratch;
+layout(rgba16f, binding = 1) uniform writeonly imageCubeArray moments;
+
+uniform int mapSize;
+uniform int cube;      // Cube of the light's slot
+uniform int faces[6];  // Face filtered by each dispatch layer
+uniform int radius;
+uniform int pass;      // 0 = depth to moments, horizontal. 1 = vertical into the moments.
+
+// Direction that samples texel uv of a cube face, as in Lighting.glsl
+vec3 faceTexel(int face, vec2 uv) {
+    vec2 st = uv * 2.0 - 1.0;
+    switch (face) {
+    case 0:  return vec3( 1.0, -st.y, -st.x);
+    case 1:  return vec3(-1.0, -st.y,  st.x);
+    case 2:  return vec3( st.x,  1.0,  st.y);
+    case 3:  return vec3( st.x, -1.0, -st.y);
+    case 4:  return vec3( st.x, -st.y,  1.0);
+    default: return vec3(-st.x, -st.y, -1.0);
+    }
+}
+
+vec4 warpedMoments(float depth) {
+    float d = depth * 2.0 - 1.0;
+    float positive = exp(EVSM_POSITIVE * d);
+    float negative = -exp(-EVSM_NEGATIVE * d);
+    return vec4(positive, positive * positive, negative, negative * negative);
+}
+
+void main() {
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(p, ivec2(mapSize)))) return;
+    int layer = int(gl_GlobalInvocationID.z);
+    int face = faces[layer];
+
+    // Gaussian with the radius at two sigma, edges clamped to the face
+    float sigma = max(float(radius) * 0.5, 0.5);
+    vec4 sum = vec4(0.0);
+    float weightSum = 0.0;
+    for (int i = -radius; i <= radius; ++i) {
+        float weight = exp(-float(i * i) / (2.0 * sigma * sigma));
+        if (pass == 0) {
+            int x = clamp(p.x + i, 0, mapSize - 1);
+            vec2 uv = (vec2(x, p.y) + 0.5) / float(mapSize);
+            float depth = textureLod(depthMaps, vec4(faceTexel(face, uv), float(cube)), 0.0).r;
+            sum += warpedMoments(depth) * weight;
+        } else {
+            int y = clamp(p.y + i, 0, mapSize - 1);
+            sum += imageLoad(scratch, ivec3(p.x, y, layer)) * weight;
+        }
+        weightSum += weight;
+    }
+    sum /= weightSum;
+
+    if (pass == 0) imageStore(scratch, ivec3(p, layer), sum);
+    else imageStore(moments, ivec3(p, cube * 6 + face), sum);
+}
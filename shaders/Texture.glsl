@@ -0,0 +1,19 @@
+#version 440 core
+
+// Object texture lookup shared by the forward (Shader.fs) and G-buffer
+// (GBuffer.fs) passes, linked into both as a second fragment shader
+
+#define MAX_TEXTURES 16
+
+uniform sampler2D textures[MAX_TEXTURES];
+
+// The indirect draws batch objects with different textures, and sampler
+// arrays may only be indexed with dynamically uniform expressions, so the
+// unit is picked by comparing against each constant index. The caller takes
+// the derivatives before branching on the index, where they're still defined.
+vec4 SampleTexture(int index, vec2 uv, vec2 dx, vec2 dy) {
+    vec4 color = vec4(1.0);
+    for (int t = 0; t < MAX_TEXTURES; ++t)
+        if (t == index) color = textureGrad(textures[t], uv, dx, dy);
+    return color;
+}
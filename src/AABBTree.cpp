@@ -0,0 +1,434 @@
+#include "AABBTree.h"
+#include <algorithm>
+
+int AABBTree::allocateNode() {
+    if (freeList == -1) {
+        nodes.emplace_back();
+        nodes.back().height = 0;
+        nodes.back().version = version;
+        return nodes.size() - 1;
+    }
+
+    int index = freeList;
+    freeList = nodes[index].parent;
+    nodes[index] = Node();
+    nodes[index].height = 0;
+    nodes[index].version = version;
+    return index;
+}
+
+void AABBTree::freeNode(int index) {
+    nodes[index] = Node();
+    nodes[index].parent = freeList;
+    freeList = index;
+}
+
+int AABBTree::insert(Object *object, const AABB &box) {
+    int leaf = allocateNode();
+    nodes[leaf].box = { box.min - glm::vec3(AABB_TREE_MARGIN), box.max + glm::vec3(AABB_TREE_MARGIN) };
+    nodes[leaf].object = object;
+
+    insertLeaf(leaf);
+    leafCount++;
+    return leaf;
+}
+
+void AABBTree::remove(int proxy) {
+    if (proxy < 0 || proxy >= (int)nodes.size() || !nodes[proxy].isLeaf() || nodes[proxy].height != 0) return;
+
+    removeLeaf(proxy);
+    freeNode(proxy);
+    leafCount--;
+}
+
+bool AABBTree::move(int proxy, const AABB &box) {
+    if (proxy < 0 || proxy >= (int)nodes.size()) return false;
+    if (nodes[proxy].box.contains(box)) return false;
+
+    removeLeaf(proxy);
+    nodes[proxy].box = { box.min - glm::vec3(AABB_TREE_MARGIN), box.max + glm::vec3(AABB_TREE_MARGIN) };
+    insertLeaf(proxy);
+    return true;
+}
+
+void AABBTree::clear() {
+    version++;
+    nodes.clear();
+    root = -1;
+    freeList = -1;
+    leafCount = 0;
+}
+
+void AABBTree::insertLeaf(int leaf) {
+    version++;
+    if (root == -1) {
+        root = leaf;
+        nodes[root].parent = -1;
+        return;
+    }
+
+    // Walk down to the sibling that grows the total surface area the least
+    AABB leafBox = nodes[leaf].box;
+    int index = root;
+    while (!nodes[index].isLeaf()) {
+        int left = nodes[index].left;
+        int right = nodes[index].right;
+
+        float area = nodes[index].box.surfaceArea();
+        float combinedArea = unionAABB(nodes[index].box, leafBox).surfaceArea();
+
+        // Cost of making a new parent for this node and the leaf
+        float cost = 2.0f * combinedArea;
+        // Minimum cost of pushing the leaf further down
+        float inheritanceCost = 2.0f * (combinedArea - area);
+
+        auto descendCost = [&](int child) {
+            float newArea = unionAABB(leafBox, nodes[child].box).surfaceArea();
+            if (nodes[child].isLeaf()) return newArea + inheritanceCost;
+            return newArea - nodes[child].box.surfaceArea() + inheritanceCost;
+        };
+        float costLeft = descendCost(left);
+        float costRight = descendCost(right);
+
+        if (cost < costLeft && cost < costRight) break;
+        index = costLeft < costRight ? left : right;
+    }
+    int sibling = index;
+
+    // New parent for the sibling and the leaf
+    int oldParent = nodes[sibling].parent;
+    int newParent = allocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].box = unionAABB(leafBox, nodes[sibling].box);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    nodes[newParent].left = sibling;
+    nodes[newParent].right = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    if (oldParent != -1) {
+        if (nodes[oldParent].left == sibling) nodes[oldParent].left = newParent;
+        else nodes[oldParent].right = newParent;
+    } else {
+        root = newParent;
+    }
+
+    refit(nodes[leaf].parent);
+}
+
+void AABBTree::removeLeaf(int leaf) {
+    version++;
+    if (leaf == root) {
+        root = -1;
+        return;
+    }
+
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+    if (grandParent != -1) {
+        // Replace the parent with the sibling
+        if (nodes[grandParent].left == parent) nodes[grandParent].left = sibling;
+        else nodes[grandParent].right = sibling;
+        nodes[sibling].parent = grandParent;
+        freeNode(parent);
+
+        refit(grandParent);
+    } else {
+        root = sibling;
+        nodes[sibling].parent = -1;
+        freeNode(parent);
+    }
+    nodes[leaf].parent = -1;
+}
+
+// Rebalance and recompute bounds from index up to the root
+void AABBTree::refit(int index) {
+    while (index != -1) {
+        index = balance(index);
+
+        int left = nodes[index].left;
+        int right = nodes[index].right;
+        nodes[index].height = 1 + std::max(nodes[left].height, nodes[right].height);
+        nodes[index].box = unionAABB(nodes[left].box, nodes[right].box);
+        nodes[index].version = version;
+
+        index = nodes[index].parent;
+    }
+}
+
+// Rotate a child up if the subtree heights differ by more than one.
+// Returns the index of the node now at this position.
+int AABBTree::balance(int iA) {
+    if (nodes[iA].isLeaf() || nodes[iA].height < 2) return iA;
+
+    int iB = nodes[iA].left;
+    int iC = nodes[iA].right;
+    int heightDiff = nodes[iC].height - nodes[iB].height;
+
+    auto replaceInParent = [&](int oldChild, int newChild) {
+        int parent = nodes[newChild].parent;
+        if (parent == -1) root = newChild;
+        else if (nodes[parent].left == oldChild) nodes[parent].left = newChild;
+        else nodes[parent].right = newChild;
+    };
+
+    // Rotate C up
+    if (heightDiff > 1) {
+        int iF = nodes[iC].left;
+        int iG = nodes[iC].right;
+
+        nodes[iC].left = iA;
+        nodes[iC].parent = nodes[iA].parent;
+        nodes[iA].parent = iC;
+        replaceInParent(iA, iC);
+
+        // Keep the taller grandchild under C
+        if (nodes[iF].height > nodes[iG].height) {
+            nodes[iC].right = iF;
+            nodes[iA].right = iG;
+            nodes[iG].parent = iA;
+        } else {
+            nodes[iC].right = iG;
+            nodes[iA].right = iF;
+            nodes[iF].parent = iA;
+        }
+        int iMoved = nodes[iA].right;
+        int iKept = nodes[iC].right;
+        nodes[iA].box = unionAABB(nodes[iB].box, nodes[iMoved].box);
+        nodes[iA].height = 1 + std::max(nodes[iB].height, nodes[iMoved].height);
+        nodes[iC].box = unionAABB(nodes[iA].box, nodes[iKept].box);
+        nodes[iC].height = 1 + std::max(nodes[iA].height, nodes[iKept].height);
+        nodes[iA].version = nodes[iC].version = version;
+        return iC;
+    }
+
+    // Rotate B up
+    if (heightDiff < -1) {
+        int iD = nodes[iB].left;
+        int iE = nodes[iB].right;
+
+        nodes[iB].left = iA;
+        nodes[iB].parent = nodes[iA].parent;
+        nodes[iA].parent = iB;
+        replaceInParent(iA, iB);
+
+        if (nodes[iD].height > nodes[iE].height) {
+            nodes[iB].right = iD;
+            nodes[iA].left = iE;
+            nodes[iE].parent = iA;
+        } else {
+            nodes[iB].right = iE;
+            nodes[iA].left = iD;
+            nodes[iD].parent = iA;
+        }
+        int iMoved = nodes[iA].left;
+        int iKept = nodes[iB].right;
+        nodes[iA].box = unionAABB(nodes[iC].box, nodes[iMoved].box);
+        nodes[iA].height = 1 + std::max(nodes[iC].height, nodes[iMoved].height);
+        nodes[iB].box = unionAABB(nodes[iA].box, nodes[iKept].box);
+        nodes[iB].height = 1 + std::max(nodes[iA].height, nodes[iKept].height);
+        nodes[iA].version = nodes[iB].version = version;
+        return iB;
+    }
+
+    return iA;
+}
+
+void AABBTree::rebuild() {
+    if (root == -1) return;
+    version++;
+
+    // Keep the leaves (their ids are the proxies), drop every internal node
+    std::vector<int> leaves;
+    leaves.reserve(leafCount);
+    for (int i = 0; i < (int)nodes.size(); ++i) {
+        if (nodes[i].height < 0) continue;
+        if (nodes[i].isLeaf()) leaves.push_back(i);
+        else freeNode(i);
+    }
+
+    root = build(leaves, 0, leaves.size());
+    nodes[root].parent = -1;
+}
+
+// Top-down build with binned SAH over the leaf centroids
+int AABBTree::build(std::vector<int> &leaves, size_t begin, size_t end) {
+    if (end - begin == 1) return leaves[begin];
+
+    AABB bounds, centroidBounds;
+    for (size_t i = begin; i < end; ++i) {
+        bounds.expand(nodes[leaves[i]].box);
+        centroidBounds.expand(nodes[leaves[i]].box.center());
+    }
+
+    glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+    int axis = 0;
+    if (extent.y > extent[axis]) axis = 1;
+    if (extent.z > extent[axis]) axis = 2;
+
+    size_t mid = begin + (end - begin) / 2;
+    if (extent[axis] > 1e-6f) {
+        auto binOf = [&](int leaf) {
+            float t = (nodes[leaf].box.center()[axis] - centroidBounds.min[axis]) / extent[axis];
+            return std::min(AABB_TREE_SAH_BINS - 1, (int)(t * AABB_TREE_SAH_BINS));
+        };
+
+        AABB binBoxes[AABB_TREE_SAH_BINS];
+        int binCounts[AABB_TREE_SAH_BINS] = {};
+        for (size_t i = begin; i < end; ++i) {
+            int bin = binOf(leaves[i]);
+            binBoxes[bin].expand(nodes[leaves[i]].box);
+            binCounts[bin]++;
+        }
+
+        // Sweep from the right to get the cost of every right side
+        float rightCost[AABB_TREE_SAH_BINS] = {};
+        AABB rightBox;
+        int rightCount = 0;
+        for (int i = AABB_TREE_SAH_BINS - 1; i > 0; --i) {
+            rightBox.expand(binBoxes[i]);
+            rightCount += binCounts[i];
+            rightCost[i] = rightCount ? rightBox.surfaceArea() * rightCount : 0.0f;
+        }
+
+        // Then from the left, splitting after bin i
+        float bestCost = std::numeric_limits<float>::max();
+        int bestSplit = -1;
+        AABB leftBox;
+        int leftCount = 0;
+        for (int i = 0; i < AABB_TREE_SAH_BINS - 1; ++i) {
+            leftBox.expand(binBoxes[i]);
+            leftCount += binCounts[i];
+            if (leftCount == 0 || leftCount == (int)(end - begin)) continue;
+
+            float cost = leftBox.surfaceArea() * leftCount + rightCost[i + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestSplit = i;
+            }
+        }
+
+        if (bestSplit != -1) {
+            auto it = std::partition(leaves.begin() + begin, leaves.begin() + end,
+                [&](int leaf) { return binOf(leaf) <= bestSplit; });
+            mid = it - leaves.begin();
+        }
+    }
+
+    // Degenerate centroids, split at the median
+    if (mid == begin || mid == end) {
+        mid = begin + (end - begin) / 2;
+        std::nth_element(leaves.begin() + begin, leaves.begin() + mid, leaves.begin() + end,
+            [&](int a, int b) { return nodes[a].box.center()[axis] < nodes[b].box.center()[axis]; });
+    }
+
+    int left = build(leaves, begin, mid);
+    int right = build(leaves, mid, end);
+
+    int node = allocateNode();
+    nodes[node].box = bounds;
+    nodes[node].left = left;
+    nodes[node].right = right;
+    nodes[node].height = 1 + std::max(nodes[left].height, nodes[right].height);
+    nodes[left].parent = node;
+    nodes[right].parent = node;
+    return node;
+}
+
+void AABBTree::collectLeaves(int index, std::vector<Object*> &result) const {
+    std::vector<int> stack{ index };
+    while (!stack.empty()) {
+        int i = stack.back();
+        stack.pop_back();
+
+        if (nodes[i].isLeaf()) {
+            result.push_back(nodes[i].object);
+        } else {
+            stack.push_back(nodes[i].left);
+            stack.push_back(nodes[i].right);
+        }
+    }
+}
+
+void AABBTree::queryFrustum(const Frustum &frustum, std::vector<Object*> &result) const {
+    if (root == -1) return;
+
+    std::vector<int> stack{ root };
+    while (!stack.empty()) {
+        int i = stack.back();
+        stack.pop_back();
+
+        Containment containment = frustum.classify(nodes[i].box);
+        if (containment == Containment::Outside) continue;
+
+        // Whole subtree is visible, skip the remaining plane tests
+        if (containment == Containment::Inside || nodes[i].isLeaf()) {
+            collectLeaves(i, result);
+        } else {
+            stack.push_back(nodes[i].left);
+            stack.push_back(nodes[i].right);
+        }
+    }
+}
+
+void AABBTree::querySphere(const Sphere &sphere, std::vector<Object*> &result) const {
+    if (root == -1) return;
+
+    std::vector<int> stack{ root };
+    while (!stack.empty()) {
+        int i = stack.back();
+        stack.pop_back();
+
+        if (!sphere.intersects(nodes[i].box)) continue;
+
+        if (nodes[i].isLeaf()) {
+            result.push_back(nodes[i].object);
+        } else {
+            stack.push_back(nodes[i].left);
+            stack.push_back(nodes[i].right);
+        }
+    }
+}
+
+void AABBTree::queryAABB(const AABB &box, std::vector<Object*> &result) const {
+    if (root == -1) return;
+
+    std::vector<int> stack{ root };
+    while (!stack.empty()) {
+        int i = stack.back();
+        stack.pop_back();
+
+        if (!box.intersects(nodes[i].box)) continue;
+
+        if (nodes[i].isLeaf()) {
+            result.push_back(nodes[i].object);
+        } else {
+            stack.push_back(nodes[i].left);
+            stack.push_back(nodes[i].right);
+        }
+    }
+}
+
+void AABBTree::queryRay(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+    std::vector<Object*> &result) const {
+    if (root == -1) return;
+
+    glm::vec3 invDirection = 1.0f / direction;
+
+    std::vector<int> stack{ root };
+    while (!stack.empty()) {
+        int i = stack.back();
+        stack.pop_back();
+
+        if (!rayIntersectsAABB(origin, invDirection, maxDistance, nodes[i].box)) continue;
+
+        if (nodes[i].isLeaf()) {
+            result.push_back(nodes[i].object);
+        } else {
+            stack.push_back(nodes[i].left);
+            stack.push_back(nodes[i].right);
+        }
+    }
+}
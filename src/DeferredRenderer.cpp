@@ -0,0 +1,273 @@
+#include "DeferredRenderer.h"
+#include "RenderTarget.h"
+#include <glad/gl.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+
+DeferredRenderer::DeferredRenderer(const DeferredShaders &shaders)
+: shaders(shaders) {
+    createSphere();
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+DeferredRenderer::~DeferredRenderer() {
+    destroyTargets();
+    if (sphereVBO != 0) glDeleteBuffers(1, &sphereVBO);
+    if (sphereVAO != 0) glDeleteVertexArrays(1, &sphereVAO);
+    if (emptyVAO != 0) glDeleteVertexArrays(1, &emptyVAO);
+}
+
+// Twice subdivided icosahedron, pushed out so its faces enclose the unit sphere
+void DeferredRenderer::createSphere() {
+    const float t = (1.0f + std::sqrt(5.0f)) * 0.5f;
+    std::vector<glm::vec3> corners = {
+        {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+        {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+        {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}
+    };
+    std::vector<std::array<glm::vec3, 3>> triangles;
+    const int faces[20][3] = {
+        {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+        {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+        {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+        {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}
+    };
+    for (const auto &face : faces) {
+        triangles.push_back({ glm::normalize(corners[face[0]]), glm::normalize(corners[face[1]]),
+            glm::normalize(corners[face[2]]) });
+    }
+
+    for (int level = 0; level < 2; ++level) {
+        std::vector<std::array<glm::vec3, 3>> split;
+        for (const auto &tri : triangles) {
+            glm::vec3 a = glm::normalize(tri[0] + tri[1]);
+            glm::vec3 b = glm::normalize(tri[1] + tri[2]);
+            glm::vec3 c = glm::normalize(tri[2] + tri[0]);
+            split.push_back({ tri[0], a, c });
+            split.push_back({ tri[1], b, a });
+            split.push_back({ tri[2], c, b });
+            split.push_back({ a, b, c });
+        }
+        triangles.swap(split);
+    }
+
+    // The faces cut inside the sphere, scale by their closest approach
+    float minDistance = 1.0f;
+    for (const auto &tri : triangles) {
+        glm::vec3 normal = glm::normalize(glm::cross(tri[1] - tri[0], tri[2] - tri[0]));
+        minDistance = std::min(minDistance, std::abs(glm::dot(normal, tri[0])));
+    }
+
+    std::vector<glm::vec3> vertices;
+    for (const auto &tri : triangles) {
+        for (const glm::vec3 &v : tri) vertices.push_back(v / minDistance);
+    }
+    sphereVertexCount = (int)vertices.size();
+
+    glGenVertexArrays(1, &sphereVAO);
+    glGenBuffers(1, &sphereVBO);
+    glBindVertexArray(sphereVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DeferredRenderer::createTargets() {
+    albedoTexture = createRenderTarget(GL_RGBA8, width, height);
+    normalTexture = createRenderTarget(GL_RGB10_A2, width, height);
+    depthTexture = createRenderTarget(GL_DEPTH24_STENCIL8, width, height);
+    accumulationTexture = createRenderTarget(GL_RGBA16F, width, height);
+    sceneTexture = createRenderTarget(GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &depthStencil);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthStencil);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+
+    glGenFramebuffers(1, &gbufferFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, gbufferFBO);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, albedoTexture, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, normalTexture, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, depthTexture, 0);
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "ERROR::DEFERRED: G-buffer framebuffer is not complete" << std::endl;
+
+    glGenFramebuffers(1, &lightFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, lightFBO);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, accumulationTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencil);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "ERROR::DEFERRED: Light framebuffer is not complete" << std::endl;
+
+    glGenFramebuffers(1, &sceneFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sceneTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencil);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "ERROR::DEFERRED: Scene framebuffer is not complete" << std::endl;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DeferredRenderer::destroyTargets() {
+    unsigned int fbos[3] = { gbufferFBO, lightFBO, sceneFBO };
+    unsigned int textures[5] = { albedoTexture, normalTexture, depthTexture, accumulationTexture, sceneTexture };
+    if (gbufferFBO != 0) glDeleteFramebuffers(3, fbos);
+    if (albedoTexture != 0) glDeleteTextures(5, textures);
+    if (depthStencil != 0) glDeleteRenderbuffers(1, &depthStencil);
+    gbufferFBO = lightFBO = sceneFBO = 0;
+    albedoTexture = normalTexture = depthTexture = accumulationTexture = sceneTexture = 0;
+    depthStencil = 0;
+}
+
+void DeferredRenderer::beginGeometry(int viewportWidth, int viewportHeight) {
+    if (viewportWidth != width || viewportHeight != height || gbufferFBO == 0) {
+        destroyTargets();
+        width = viewportWidth;
+        height = viewportHeight;
+        createTargets();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, gbufferFBO);
+    glViewport(0, 0, width, height);
+    // Opaque black where nothing is drawn, like the forward path's clear
+    const float albedoClear[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const float normalClear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, albedoClear);
+    glClearBufferfv(GL_COLOR, 1, normalClear);
+    glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+}
+
+void DeferredRenderer::shade(const std::vector<Light*> &lights, const glm::mat4 &view, const glm::mat4 &projection) {
+    volumeLights = fullscreenLights = 0;
+
+    // Depth and a clear stencil for the light volumes
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, gbufferFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, lightFBO);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+        GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, lightFBO);
+    const float accumulationClear[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    glClearBufferfv(GL_COLOR, 0, accumulationClear);
+
+    glm::mat4 viewProjection = projection * view;
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, albedoTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, normalTexture);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+
+    const Shader &lightShader = *shaders.light;
+    lightShader.use();
+    lightShader.setInt("gAlbedo", 0);
+    lightShader.setInt("gNormal", 1);
+    lightShader.setInt("gDepth", 2);
+    lightShader.setMat4("viewProjection", viewProjection);
+    lightShader.setMat4("inverseViewProjection", glm::inverse(viewProjection));
+    lightShader.setVec2("viewportSize", (float)width, (float)height);
+    shaders.stencil->use();
+    shaders.stencil->setMat4("viewProjection", viewProjection);
+
+    // Ambient and fullbright surfaces fill every covered pixel
+    glDisable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    lightShader.use();
+    lightShader.setInt("lightIndex", -1);
+    lightShader.setVec4("volume", glm::vec4(0.0f));
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glEnable(GL_STENCIL_TEST);
+    // Volumes crossing the near or far plane keep their caps
+    glEnable(GL_DEPTH_CLAMP);
+
+    for (size_t i = 0; i < lights.size(); ++i) {
+        float range = lights[i]->lightRange();
+        if (range == 0.0f) continue;
+
+        if (range < 0.0f) {
+            // Directional light, the whole screen
+            glDisable(GL_STENCIL_TEST);
+            lightShader.use();
+            lightShader.setInt("lightIndex", (int)i);
+            lightShader.setVec4("volume", glm::vec4(0.0f));
+            glBindVertexArray(emptyVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glEnable(GL_STENCIL_TEST);
+            fullscreenLights++;
+            continue;
+        }
+
+        glm::vec4 volume(lights[i]->position, range);
+        glBindVertexArray(sphereVAO);
+
+        // Mark pixels whose surface is inside the sphere: the back faces are
+        // behind it and the front faces aren't
+        shaders.stencil->use();
+        shaders.stencil->setVec4("volume", volume);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glStencilFunc(GL_ALWAYS, 0, 0);
+        glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+        glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+        glDrawArrays(GL_TRIANGLES, 0, sphereVertexCount);
+
+        // Shade the marked pixels through the back faces, clearing the marks
+        lightShader.use();
+        lightShader.setInt("lightIndex", (int)i);
+        lightShader.setVec4("volume", volume);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+        glDrawArrays(GL_TRIANGLES, 0, sphereVertexCount);
+        glCullFace(GL_BACK);
+        volumeLights++;
+    }
+
+    glDisable(GL_DEPTH_CLAMP);
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_BLEND);
+
+    // Clamp the sum into the scene target, it shares the depth for the forward draws
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, accumulationTexture);
+    shaders.composite->use();
+    shaders.composite->setInt("lightAccumulation", 0);
+    shaders.composite->setVec4("volume", glm::vec4(0.0f));
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    for (int unit = 0; unit < 3; ++unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+}
+
+void DeferredRenderer::present() const {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
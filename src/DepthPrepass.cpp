@@ -0,0 +1,83 @@
+#include "DepthPrepass.h"
+#include <glad/gl.h>
+
+DepthPrepass::DepthPrepass(const DepthPrepassSettings &settings)
+: settings(settings) {
+    glGenQueries(QUERY_COUNT, prepassQueries);
+    glGenQueries(QUERY_COUNT, shadingQueries);
+}
+
+DepthPrepass::~DepthPrepass() {
+    glDeleteQueries(QUERY_COUNT, prepassQueries);
+    glDeleteQueries(QUERY_COUNT, shadingQueries);
+}
+
+bool DepthPrepass::collect(int query, bool wait) {
+    if (!pending[query]) return true;
+    if (!wait) {
+        GLuint prepassAvailable = 0, shadedAvailable = 0;
+        glGetQueryObjectuiv(prepassQueries[query], GL_QUERY_RESULT_AVAILABLE, &prepassAvailable);
+        glGetQueryObjectuiv(shadingQueries[query], GL_QUERY_RESULT_AVAILABLE, &shadedAvailable);
+        if (!prepassAvailable || !shadedAvailable) return false;
+    }
+
+    GLuint64 prepassSamples = 0, shadedSamples = 0;
+    glGetQueryObjectui64v(prepassQueries[query], GL_QUERY_RESULT, &prepassSamples);
+    glGetQueryObjectui64v(shadingQueries[query], GL_QUERY_RESULT, &shadedSamples);
+    pending[query] = false;
+    // Nothing visible, nothing to learn
+    if (shadedSamples > 0) measuredOverdraw = (float)prepassSamples / (float)shadedSamples;
+    return true;
+}
+
+bool DepthPrepass::beginPrepass() {
+    // Read every finished measurement, the newest one decides below
+    while (pending[oldest] && collect(oldest, false)) oldest = (oldest + 1) % QUERY_COUNT;
+    // All queries in flight, the oldest has to finish before it's reused
+    if (pending[current]) {
+        collect(current, true);
+        oldest = (oldest + 1) % QUERY_COUNT;
+    }
+
+    switch (mode) {
+    case PrepassMode::Off: running = false; break;
+    case PrepassMode::On:  running = true;  break;
+    case PrepassMode::Auto:
+        // Stay on while it pays, otherwise probe now and then in case the view got denser
+        running = measuredOverdraw == 0.0f || measuredOverdraw >= settings.overdrawThreshold ||
+            framesSinceProbe >= settings.probeInterval;
+        break;
+    }
+    framesSinceProbe = running ? 0 : framesSinceProbe + 1;
+    if (!running) return false;
+
+    measuring = measureOverdraw;
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    if (measuring) glBeginQuery(GL_SAMPLES_PASSED, prepassQueries[current]);
+    return true;
+}
+
+void DepthPrepass::endPrepass() {
+    if (!running) return;
+    if (measuring) glEndQuery(GL_SAMPLES_PASSED);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void DepthPrepass::beginShading() {
+    if (!running) return;
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+    if (measuring) glBeginQuery(GL_SAMPLES_PASSED, shadingQueries[current]);
+}
+
+void DepthPrepass::end() {
+    if (!running) return;
+    if (measuring) {
+        glEndQuery(GL_SAMPLES_PASSED);
+        pending[current] = true;
+        current = (current + 1) % QUERY_COUNT;
+    }
+
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+}
@@ -0,0 +1,131 @@
+#include "FrustumCuller.h"
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#define FRUSTUM_CULLER_X86
+#endif
+
+#if defined(FRUSTUM_CULLER_X86) && defined(__GNUC__)
+#define FRUSTUM_CULLER_AVX
+#endif
+
+namespace {
+
+struct Batch {
+    const float *cx, *cy, *cz, *ex, *ey, *ez;
+};
+
+#ifndef FRUSTUM_CULLER_X86
+void testScalar(const Frustum &frustum, const Batch &b, size_t count, unsigned char *inside) {
+    for (size_t i = 0; i < count; ++i) {
+        bool visible = true;
+        for (const glm::vec4 &p : frustum.planes) {
+            float d = p.x * b.cx[i] + p.y * b.cy[i] + p.z * b.cz[i] + p.w;
+            float r = std::fabs(p.x) * b.ex[i] + std::fabs(p.y) * b.ey[i] + std::fabs(p.z) * b.ez[i];
+            if (d < -r) { visible = false; break; }
+        }
+        inside[i] = visible;
+    }
+}
+#endif
+
+#ifdef FRUSTUM_CULLER_X86
+// Two 4-wide halves per batch
+void testSSE(const Frustum &frustum, const Batch &b, size_t count, unsigned char *inside) {
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    for (size_t i = 0; i < count; i += 4) {
+        __m128 cx = _mm_loadu_ps(b.cx + i), cy = _mm_loadu_ps(b.cy + i), cz = _mm_loadu_ps(b.cz + i);
+        __m128 ex = _mm_loadu_ps(b.ex + i), ey = _mm_loadu_ps(b.ey + i), ez = _mm_loadu_ps(b.ez + i);
+        __m128 outside = _mm_setzero_ps();
+
+        for (const glm::vec4 &p : frustum.planes) {
+            __m128 nx = _mm_set1_ps(p.x), ny = _mm_set1_ps(p.y), nz = _mm_set1_ps(p.z);
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                  _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(p.w)));
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex),
+                                             _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)),
+                                  _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+            // d + r < 0 means fully behind the plane
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+
+        int mask = _mm_movemask_ps(outside);
+        for (int j = 0; j < 4; ++j)
+            inside[i + j] = !(mask & (1 << j));
+    }
+}
+#endif
+
+#ifdef FRUSTUM_CULLER_AVX
+__attribute__((target("avx")))
+void testAVX(const Frustum &frustum, const Batch &b, size_t count, unsigned char *inside) {
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+    for (size_t i = 0; i < count; i += CULL_BATCH_SIZE) {
+        __m256 cx = _mm256_loadu_ps(b.cx + i), cy = _mm256_loadu_ps(b.cy + i), cz = _mm256_loadu_ps(b.cz + i);
+        __m256 ex = _mm256_loadu_ps(b.ex + i), ey = _mm256_loadu_ps(b.ey + i), ez = _mm256_loadu_ps(b.ez + i);
+        __m256 outside = _mm256_setzero_ps();
+
+        for (const glm::vec4 &p : frustum.planes) {
+            __m256 nx = _mm256_set1_ps(p.x), ny = _mm256_set1_ps(p.y), nz = _mm256_set1_ps(p.z);
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)),
+                                     _mm256_add_ps(_mm256_mul_ps(nz, cz), _mm256_set1_ps(p.w)));
+            __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMask, nx), ex),
+                                                   _mm256_mul_ps(_mm256_andnot_ps(signMask, ny), ey)),
+                                     _mm256_mul_ps(_mm256_andnot_ps(signMask, nz), ez));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(outside);
+        for (size_t j = 0; j < CULL_BATCH_SIZE; ++j)
+            inside[i + j] = !(mask & (1 << j));
+    }
+}
+
+bool hasAVX() {
+    static const bool supported = __builtin_cpu_supports("avx");
+    return supported;
+}
+#endif
+
+} // namespace
+
+void FrustumCuller::cull(const Frustum &frustum, const std::vector<Object*> &objects, std::vector<Object*> &visible) {
+    size_t count = objects.size();
+    size_t padded = (count + CULL_BATCH_SIZE - 1) / CULL_BATCH_SIZE * CULL_BATCH_SIZE;
+
+    // Gather into SoA, the results of the padding lanes are ignored
+    centerX.assign(padded, 0.0f); centerY.assign(padded, 0.0f); centerZ.assign(padded, 0.0f);
+    extentX.assign(padded, 0.0f); extentY.assign(padded, 0.0f); extentZ.assign(padded, 0.0f);
+    inside.assign(padded, 0);
+
+    for (size_t i = 0; i < count; ++i) {
+        const AABB &box = objects[i]->worldBounds;
+        glm::vec3 c = box.center();
+        glm::vec3 e = box.extents();
+        centerX[i] = c.x; centerY[i] = c.y; centerZ[i] = c.z;
+        extentX[i] = e.x; extentY[i] = e.y; extentZ[i] = e.z;
+    }
+
+    Batch batch{ centerX.data(), centerY.data(), centerZ.data(), extentX.data(), extentY.data(), extentZ.data() };
+
+#if defined(FRUSTUM_CULLER_AVX)
+    if (hasAVX()) testAVX(frustum, batch, padded, inside.data());
+    else testSSE(frustum, batch, padded, inside.data());
+#elif defined(FRUSTUM_CULLER_X86)
+    testSSE(frustum, batch, padded, inside.data());
+#else
+    testScalar(frustum, batch, padded, inside.data());
+#endif
+
+    for (size_t i = 0; i < count; ++i) {
+        if (inside[i]) {
+            visible.push_back(objects[i]);
+            stats.visible++;
+        } else {
+            stats.culled++;
+        }
+    }
+}
@@ -0,0 +1,203 @@
+#include "GPUCuller.h"
+#include "Bounds.h"
+#include <glad/gl.h>
+#include <algorithm>
+#include <cmath>
+
+GPUCuller::GPUCuller(GPUScene &scene, const Shader *cullShader, const Shader *hiZShader)
+: scene(scene), cullShader(cullShader), hiZShader(hiZShader) {
+    compact = GLAD_GL_VERSION_4_6 != 0;
+
+    glGenBuffers(1, &commandBuffer);
+    glGenBuffers(1, &countBuffer);
+    glGenBuffers(1, &faceMaskBuffer);
+    glGenBuffers(1, &lightBuffer);
+    allocateLists(0);
+}
+
+GPUCuller::~GPUCuller() {
+    if (commandBuffer != 0) glDeleteBuffers(1, &commandBuffer);
+    if (countBuffer != 0) glDeleteBuffers(1, &countBuffer);
+    if (faceMaskBuffer != 0) glDeleteBuffers(1, &faceMaskBuffer);
+    if (lightBuffer != 0) glDeleteBuffers(1, &lightBuffer);
+    if (depthTexture != 0) glDeleteTextures(1, &depthTexture);
+    if (hiZTexture != 0) glDeleteTextures(1, &hiZTexture);
+}
+
+void GPUCuller::allocateLists(size_t lightCount) {
+    // The camera's opaque list, one per light, then the camera's transparent list
+    size_t lists = 2 + lightCount;
+    size_t objectCount = std::max<size_t>(scene.size(), 1);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, lists * objectCount * sizeof(DrawCommand), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, lists * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, faceMaskBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(lightCount, 1) * objectCount * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(lightCount, 1) * sizeof(GPULight), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    lightCapacity = lightCount;
+}
+
+void GPUCuller::cull(const glm::mat4 &view, const glm::mat4 &projection, const std::vector<Light*> &lights) {
+    if (lights.size() != lightCapacity) allocateLists(lights.size());
+
+    std::vector<GPULight> lightData;
+    lightData.reserve(lights.size());
+    for (Light *light : lights) {
+        GPULight gpuLight{};
+        gpuLight.positionRange = glm::vec4(light->position, light->shadowFarPlane);
+        gpuLight.proxyObject = scene.indexOf(light->proxy);
+        lightData.push_back(gpuLight);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, lightData.size() * sizeof(GPULight), lightData.data());
+
+    unsigned int zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+
+    cullShader->use();
+    cullShader->setUInt("objectCount", scene.size());
+    cullShader->setUInt("lightCount", lights.size());
+    cullShader->setBool("compact", compact);
+    cullShader->setBool("shadowFrustumCulling", shadowFrustumCulling);
+    for (int i = 0; i < 6; ++i)
+        cullShader->setVec4("frustumPlanes[" + std::to_string(i) + "]", frustum.planes[i]);
+
+    bool useOcclusion = occlusionCulling && hiZValid;
+    cullShader->setBool("useOcclusion", useOcclusion);
+    if (useOcclusion) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, hiZTexture);
+        cullShader->setInt("hiZ", 0);
+        cullShader->setMat4("prevViewProjection", hiZViewProjection);
+        glUniform2i(glGetUniformLocation(cullShader->ID, "hiZSize"), hiZWidth, hiZHeight);
+        cullShader->setInt("hiZLevels", hiZLevels);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, scene.objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, countBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, faceMaskBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, lightBuffer);
+
+    glDispatchCompute((scene.size() + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    hiZViewProjection = projection * view;
+}
+
+void GPUCuller::drawList(size_t list) const {
+    const void *offset = (const void*)(list * scene.size() * sizeof(DrawCommand));
+
+    glBindVertexArray(scene.VAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    if (compact) {
+        glBindBuffer(GL_PARAMETER_BUFFER, countBuffer);
+        glMultiDrawArraysIndirectCount(GL_TRIANGLES, offset, list * sizeof(unsigned int), scene.size(), 0);
+        glBindBuffer(GL_PARAMETER_BUFFER, 0);
+    } else {
+        glMultiDrawArraysIndirect(GL_TRIANGLES, offset, scene.size(), 0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void GPUCuller::drawCameraList(const Shader &shader, const glm::mat4 &view, const glm::mat4 &projection,
+    size_t list) const {
+    shader.use();
+    shader.setMat4("projection", projection);
+    shader.setMat4("view", view);
+
+    scene.bindTextures(shader);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, scene.objectBuffer);
+    drawList(list);
+}
+
+void GPUCuller::drawOpaque(const Shader &shader, const glm::mat4 &view, const glm::mat4 &projection) const {
+    drawCameraList(shader, view, projection, 0);
+}
+
+void GPUCuller::drawTransparent(const Shader &shader, const glm::mat4 &view, const glm::mat4 &projection) const {
+    drawCameraList(shader, view, projection, 1 + lightCapacity);
+}
+
+void GPUCuller::renderShadowMaps(const Shader &shadowShader, const std::vector<Light*> &lights) const {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, scene.objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, faceMaskBuffer);
+
+    for (size_t i = 0; i < lights.size(); ++i) {
+        // Spot and directional maps are drawn by the CPU path
+        if (lights[i]->shadowMapSize == 0 || lights[i]->type != LightType::Point) continue;
+
+        // Drawn over the CPU path's cached map
+        lights[i]->invalidateShadowMap();
+        lights[i]->beginShadowPass(shadowShader);
+        shadowShader.setUInt("lightIndex", i);
+        shadowShader.setUInt("objectCount", scene.size());
+        drawList(1 + i);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void GPUCuller::buildDepthPyramid(int width, int height) {
+    if (width <= 0 || height <= 0) return;
+
+    if (width != hiZWidth || height != hiZHeight) {
+        if (depthTexture != 0) glDeleteTextures(1, &depthTexture);
+        if (hiZTexture != 0) glDeleteTextures(1, &hiZTexture);
+
+        hiZWidth = width;
+        hiZHeight = height;
+        hiZLevels = (int)std::floor(std::log2((float)std::max(width, height))) + 1;
+
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenTextures(1, &hiZTexture);
+        glBindTexture(GL_TEXTURE_2D, hiZTexture);
+        glTexStorage2D(GL_TEXTURE_2D, hiZLevels, GL_R32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Copy the depth of the bound framebuffer
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+
+    hiZShader->use();
+    hiZShader->setInt("depthTexture", 0);
+
+    int levelWidth = width, levelHeight = height;
+    for (int level = 0; level < hiZLevels; ++level) {
+        hiZShader->setInt("level", level);
+        glBindImageTexture(0, hiZTexture, std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, hiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+        glDispatchCompute((levelWidth + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+            (levelHeight + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        levelWidth = std::max(levelWidth / 2, 1);
+        levelHeight = std::max(levelHeight / 2, 1);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    hiZValid = true;
+}
@@ -0,0 +1,138 @@
+#include "GPUScene.h"
+#include <glad/gl.h>
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+GPUScene::GPUScene(const std::vector<Object*> &sceneObjects)
+: objects(sceneObjects) {
+    std::vector<float> vertices;
+    gpuObjects.reserve(objects.size());
+
+    for (Object *object : objects) {
+        objectIndices[object] = gpuObjects.size();
+        object->sceneIndex = gpuObjects.size();
+
+        GPUObject gpuObject{};
+        gpuObject.boundsMin = glm::vec4(object->localBounds.min, 1.0f);
+        gpuObject.boundsMax = glm::vec4(object->localBounds.max, 1.0f);
+        gpuObject.firstVertex = vertices.size() / OBJECT_STRIDE;
+        gpuObject.vertexCount = object->vertexCount();
+        gpuObject.opaqueVertexCount = object->opaqueVertexCount;
+        gpuObject.flags = (object->useLighting ? OBJECT_USE_LIGHTING : 0u) |
+                          (object->hasTransparency ? OBJECT_TRANSPARENT : 0u);
+        gpuObjects.push_back(gpuObject);
+
+        // Remap the object's texture indices into the shared texture table
+        std::vector<float> remap(object->textures.size(), -1.0f);
+        for (size_t i = 0; i < object->textures.size(); ++i) {
+            auto it = std::find(textures.begin(), textures.end(), object->textures[i]);
+            if (it != textures.end()) {
+                remap[i] = it - textures.begin();
+            } else if (textures.size() < MAX_TEXTURES) {
+                textures.push_back(object->textures[i]);
+                remap[i] = textures.size() - 1;
+            } else {
+                std::cerr << "GPUScene: texture limit reached, dropping texture " << object->textures[i] << "\n";
+            }
+        }
+
+        size_t first = vertices.size();
+        vertices.insert(vertices.end(), object->vertices.begin(), object->vertices.end());
+        for (size_t i = first; i < vertices.size(); i += OBJECT_STRIDE) {
+            int texIndex = (int)vertices[i + 8];
+            if (texIndex >= 0) vertices[i + 8] = remap[texIndex];
+        }
+    }
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &objectIDBuffer);
+    glGenBuffers(1, &objectBuffer);
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+    // Same layout as Object
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, OBJECT_STRIDE*sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, OBJECT_STRIDE*sizeof(float), (void*)(3*sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, OBJECT_STRIDE*sizeof(float), (void*)(6*sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, OBJECT_STRIDE*sizeof(float), (void*)(8*sizeof(float)));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, OBJECT_STRIDE*sizeof(float), (void*)(9*sizeof(float)));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, OBJECT_STRIDE*sizeof(float), (void*)(12*sizeof(float)));
+    glEnableVertexAttribArray(5);
+
+    // Object ID, one per instance. Instanced attributes start at baseInstance,
+    // so each indirect command picks its object without gl_BaseInstance.
+    std::vector<unsigned int> ids(objects.size());
+    std::iota(ids.begin(), ids.end(), 0u);
+    glBindBuffer(GL_ARRAY_BUFFER, objectIDBuffer);
+    glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(unsigned int), ids.data(), GL_STATIC_DRAW);
+    glVertexAttribIPointer(6, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)0);
+    glVertexAttribDivisor(6, 1);
+    glEnableVertexAttribArray(6);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, gpuObjects.size() * sizeof(GPUObject), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Every model matrix once, later only the ones that move
+    uploadedVersions.resize(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i) {
+        objects[i]->updateTransform();
+        gpuObjects[i].model = objects[i]->GetModelMatrix();
+        uploadedVersions[i] = objects[i]->transformVersion;
+    }
+    if (!objects.empty()) upload(0, objects.size() - 1);
+}
+
+GPUScene::~GPUScene() {
+    if (VAO != 0) glDeleteVertexArrays(1, &VAO);
+    if (VBO != 0) glDeleteBuffers(1, &VBO);
+    if (objectIDBuffer != 0) glDeleteBuffers(1, &objectIDBuffer);
+    if (objectBuffer != 0) glDeleteBuffers(1, &objectBuffer);
+}
+
+void GPUScene::update(const std::vector<Object*> &moved) {
+    // Upload the range spanning every object whose transform changed
+    size_t first = objects.size(), last = 0;
+    for (const Object *object : moved) {
+        unsigned int i = indexOf(object);
+        if (i == NO_OBJECT || object->transformVersion == uploadedVersions[i]) continue;
+
+        gpuObjects[i].model = object->GetModelMatrix();
+        uploadedVersions[i] = object->transformVersion;
+        first = std::min(first, (size_t)i);
+        last = std::max(last, (size_t)i);
+    }
+    if (first > last) return;
+    upload(first, last);
+}
+
+void GPUScene::upload(size_t first, size_t last) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(GPUObject),
+        (last - first + 1) * sizeof(GPUObject), gpuObjects.data() + first);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GPUScene::bindTextures(const Shader &shader) const {
+    for (int i = 0; i < (int)textures.size(); ++i) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+    }
+
+    std::vector<int> texUnits(textures.size());
+    for (int i = 0; i < (int)textures.size(); ++i)
+        texUnits[i] = i;
+    if (!texUnits.empty()) shader.setIntArray("textures", texUnits);
+}
@@ -1,111 +1,512 @@
 #include "Light.h"
 #include "Object.h"
+#include "AABBTree.h"
+#include "ShadowPool.h"
+#include "StorageBuffer.h"
 #include <glad/gl.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <bit>
 
-Light::Light(glm::vec3 position, glm::vec3 color, float intensity, const Shader *shader)
-: position(position), color(color), intensity(intensity), shader(shader) {
-    glGenTextures(1, &depthCubemap);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
+Light::Light(glm::vec3 position, glm::vec3 color, float intensity, const ShadowShaders *shadowShaders)
+: position(position), color(color), intensity(intensity), shadowShaders(shadowShaders) {
+    shadowFarPlane = calculateFarPlane();
+}
 
-    for (unsigned int i = 0; i < 6; ++i) {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT,
-            SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+float Light::calculateFarPlane() const {
+    if (intensity < 1e-6f) {
+        return MIN_FAR_PLANE;
     }
 
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    const float minIntensity = 1.0f / 256.0f;
+    float maxDistance = std::sqrt(intensity / minIntensity);
 
-    // Attach depth texture as FBO's depth buffer
-    glGenFramebuffers(1, &depthMapFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthCubemap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return glm::clamp(maxDistance, MIN_FAR_PLANE, MAX_FAR_PLANE);
+}
 
-    shadowFarPlane = calculateFarPlane();
+float Light::lightRange() const noexcept {
+    if (type == LightType::Directional) return -1.0f;
+
+    // Solve intensity * color / attenuation = 1/512 for the distance
+    float peak = intensity * glm::max(color.r, glm::max(color.g, color.b)) * 512.0f;
+    if (peak <= 1.0f) return 0.0f;
+    float b = ATTENUATION_LINEAR, a = ATTENUATION_QUADRATIC;
+    return (-b + std::sqrt(b * b + 4.0f * a * (peak - 1.0f))) / (2.0f * a);
 }
 
-Light::~Light() {
-    if (depthMapFBO != 0) {
-        glDeleteFramebuffers(1, &depthMapFBO);
-    }
-    if (depthCubemap != 0) {
-        glDeleteTextures(1, &depthCubemap);
+void Light::setDualParaboloid(bool enabled) noexcept {
+    if (enabled == dualParaboloid) return;
+    dualParaboloid = enabled;
+    invalidateShadowMap();
+}
+
+unsigned int Light::shadowFaceCount() const noexcept {
+    switch (type) {
+    case LightType::Spot:        return 1;
+    case LightType::Directional: return glm::clamp(cascadeCount, 1u, MAX_CASCADES);
+    default:                     return dualParaboloid ? 2 : 6;
     }
 }
 
-Light::Light(Light&& other) noexcept
-    : position(other.position), color(other.color), intensity(other.intensity),
-        shader(other.shader), depthMapFBO(other.depthMapFBO),
-        depthCubemap(other.depthCubemap) {
-    other.depthMapFBO = 0;
-    other.depthCubemap = 0;
+// Light space of a spot or directional light, any up vector not along it
+static glm::mat4 lightView(const glm::vec3 &position, const glm::vec3 &direction) {
+    glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    return glm::lookAt(position, position + direction, up);
 }
 
-Light& Light::operator=(Light&& other) noexcept {
-    if (this != &other) {
-        if (depthMapFBO != 0) glDeleteFramebuffers(1, &depthMapFBO);
-        if (depthCubemap != 0) glDeleteTextures(1, &depthCubemap);
+void Light::fitCascades(const Camera &camera) {
+    if (type != LightType::Directional || shadowMapSize == 0) return;
+
+    unsigned int count = shadowFaceCount();
+    float nearPlane = camera.nearPlane;
+    float farPlane = glm::min(shadowDistance, camera.farPlane);
+    // Frustum slope, from the projection so it matches the aspect ratio
+    float tanY = 1.0f / camera.projectionMatrix[1][1];
+    float tanX = 1.0f / camera.projectionMatrix[0][0];
+
+    glm::vec3 forward = camera.Forward();
+    glm::mat4 view = lightView(glm::vec3(0.0f), direction);
+
+    float splitNear = nearPlane;
+    for (unsigned int i = 0; i < count; ++i) {
+        // Blend of logarithmic and uniform splits
+        float t = float(i + 1) / count;
+        float logSplit = nearPlane * std::pow(farPlane / nearPlane, t);
+        float uniformSplit = nearPlane + (farPlane - nearPlane) * t;
+        float splitFar = glm::mix(uniformSplit, logSplit, 0.75f);
 
-        position = other.position;
-        color = other.color;
-        intensity = other.intensity;
-        shader = other.shader;
-        depthMapFBO = other.depthMapFBO;
-        depthCubemap = other.depthCubemap;
+        // Bounding sphere of the slice. It only depends on the slice's
+        // shape, so the map's extent stays the same as the camera turns.
+        float k = tanX * tanX + tanY * tanY;
+        float centerDistance = glm::min(0.5f * (splitNear + splitFar) * (1.0f + k), splitFar);
+        float farRadius = glm::length(glm::vec3(tanX * splitFar, tanY * splitFar, splitFar - centerDistance));
+        float nearRadius = glm::length(glm::vec3(tanX * splitNear, tanY * splitNear, splitNear - centerDistance));
+        float radius = std::ceil(glm::max(farRadius, nearRadius) * 16.0f) / 16.0f;
 
-        other.depthMapFBO = 0;
-        other.depthCubemap = 0;
+        // Move the center in whole texels, the rasterized depth then stays put
+        glm::vec3 center = glm::vec3(view * glm::vec4(camera.position + forward * centerDistance, 1.0f));
+        float texel = 2.0f * radius / shadowMapSize;
+        center = glm::floor(center / texel) * texel;
+
+        // Reach back towards the light for casters outside the slice
+        glm::mat4 projection = glm::ortho(center.x - radius, center.x + radius, center.y - radius, center.y + radius,
+            -center.z - radius - shadowDistance, -center.z + radius);
+        cascadeMatrices[i] = projection * view;
+        splitNear = splitFar;
     }
-    return *this;
 }
 
-float Light::calculateFarPlane() const {
-    if (intensity < 1e-6f) {
-        return MIN_FAR_PLANE;
+void Light::beginShadowPass(const Shader &passShader) const {
+    clearShadowFaces(shadowLayer, 0x3F);
+    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+    glViewport(0, 0, shadowMapSize, shadowMapSize);
+    setShadowUniforms(passShader, shadowLayer);
+}
+
+void Light::clearShadowFaces(int layer, unsigned int faceMask) const {
+    // The FBO covers the whole pool, clear only this light's faces
+    float farDepth = 1.0f;
+    if (faceMask == 0x3F) {
+        glClearTexSubImage(shadowTexture, 0, 0, 0, layer, shadowMapSize, shadowMapSize, 6,
+            GL_DEPTH_COMPONENT, GL_FLOAT, &farDepth);
+        return;
     }
+    for (int face = 0; face < 6; ++face) {
+        if (faceMask & (1u << face))
+            glClearTexSubImage(shadowTexture, 0, 0, 0, layer + face, shadowMapSize, shadowMapSize, 1,
+                GL_DEPTH_COMPONENT, GL_FLOAT, &farDepth);
+    }
+}
 
-    const float minIntensity = 1.0f / 256.0f;
-    float maxDistance = std::sqrt(intensity / minIntensity);
+void Light::invalidateShadowMap() noexcept {
+    for (FaceCache &face : faceCache) {
+        face.valid = false;
+        face.staticValid = false;
+    }
+}
 
-    return glm::clamp(maxDistance, MIN_FAR_PLANE, MAX_FAR_PLANE);
+unsigned int Light::unrenderedFaceMask() const noexcept {
+    unsigned int mask = 0;
+    for (unsigned int face = 0; face < shadowFaceCount(); ++face) {
+        if (!faceCache[face].valid) mask |= 1u << face;
+    }
+    return mask;
 }
 
-void Light::renderShadowMap(const std::vector<Object*> &objects) {
+std::array<glm::mat4, 6> Light::shadowMatrices() const {
+    if (type == LightType::Spot) {
+        glm::mat4 projection = glm::perspective(glm::radians(2.0f * outerCone), 1.0f, shadowNearPlane, shadowFarPlane);
+        std::array<glm::mat4, 6> matrices;
+        matrices.fill(glm::mat4(1.0f));
+        matrices[0] = projection * lightView(position, direction);
+        return matrices;
+    }
+    if (type == LightType::Directional) {
+        std::array<glm::mat4, 6> matrices;
+        matrices.fill(glm::mat4(1.0f));
+        for (unsigned int i = 0; i < shadowFaceCount(); ++i) matrices[i] = cascadeMatrices[i];
+        return matrices;
+    }
+
     // Create depth cubemap transformation matrices
-    glm::mat4 shadowProjection = glm::perspective(glm::radians(90.0f),
-        (float)SHADOW_MAP_SIZE / (float)SHADOW_MAP_SIZE, shadowNearPlane, shadowFarPlane);
+    glm::mat4 shadowProjection = glm::perspective(glm::radians(90.0f), 1.0f, shadowNearPlane, shadowFarPlane);
 
-    std::vector<glm::mat4> shadowTransforms;
-    shadowTransforms.push_back(shadowProjection * glm::lookAt(position, position + glm::vec3( 1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)));
-    shadowTransforms.push_back(shadowProjection * glm::lookAt(position, position + glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)));
-    shadowTransforms.push_back(shadowProjection * glm::lookAt(position, position + glm::vec3( 0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)));
-    shadowTransforms.push_back(shadowProjection * glm::lookAt(position, position + glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)));
-    shadowTransforms.push_back(shadowProjection * glm::lookAt(position, position + glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)));
-    shadowTransforms.push_back(shadowProjection * glm::lookAt(position, position + glm::vec3( 0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f)));
+    return {
+        shadowProjection * glm::lookAt(position, position + glm::vec3( 1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+        shadowProjection * glm::lookAt(position, position + glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+        shadowProjection * glm::lookAt(position, position + glm::vec3( 0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
+        shadowProjection * glm::lookAt(position, position + glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
+        shadowProjection * glm::lookAt(position, position + glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+        shadowProjection * glm::lookAt(position, position + glm::vec3( 0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
+    };
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
-    glClear(GL_DEPTH_BUFFER_BIT);
+void Light::setShadowUniforms(const Shader &passShader, int layer) const {
+    std::array<glm::mat4, 6> shadowTransforms = shadowMatrices();
 
-    shader->use();
+    passShader.use();
     for (unsigned int i = 0; i < 6; ++i)
-        shader->setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
-    shader->setFloat("far_plane", shadowFarPlane);
-    shader->setVec3("lightPos", position);
+        passShader.setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
+    passShader.setFloat("far_plane", shadowFarPlane);
+    passShader.setVec3("lightPos", position);
+    passShader.setInt("layerBase", layer);
+}
 
-    // Render scene to depth cubemap
-    for (Object *object : objects) {
-        shader->setMat4("model", object->GetModelMatrix());
+// In object order, so the caster lists compare equal whatever order the tree returned them in
+static void sortCasters(std::vector<ShadowCaster>::iterator first, std::vector<ShadowCaster>::iterator last) {
+    std::sort(first, last, [](const ShadowCaster &a, const ShadowCaster &b) {
+        return std::less<const Object*>()(a.object, b.object);
+    });
+}
 
-        glBindVertexArray(object->VAO);
-        glDrawArrays(GL_TRIANGLES, 0, object->vertices.size() / OBJECT_STRIDE);
-        glBindVertexArray(0);
+void Light::selectCasters(const AABBTree &tree, const Frustum *cameraFrustum,
+    std::vector<ShadowCaster> &casters) const {
+    size_t first = casters.size();
+    if (type != LightType::Point) {
+        // Each map's own frustum, the casters in several cascades reach several faces
+        std::array<glm::mat4, 6> matrices = shadowMatrices();
+        std::vector<Object*> candidates;
+        for (unsigned int face = 0; face < shadowFaceCount(); ++face) {
+            Frustum frustum = Frustum::fromMatrix(matrices[face]);
+            candidates.clear();
+            tree.queryFrustum(frustum, candidates);
+
+            for (Object *object : candidates) {
+                if (object == proxy || !frustum.intersects(object->worldBounds)) continue;
+                auto it = std::find_if(casters.begin() + first, casters.end(),
+                    [object](const ShadowCaster &caster) { return caster.object == object; });
+                if (it != casters.end()) it->faceMask |= 1u << face;
+                else casters.push_back({ object, 1u << face, object->transformVersion });
+            }
+        }
+        sortCasters(casters.begin() + first, casters.end());
+        return;
+    }
+
+    Sphere range{ position, shadowFarPlane };
+
+    std::vector<Object*> candidates;
+    tree.querySphere(range, candidates);
+
+    for (Object *object : candidates) {
+        if (object == proxy) continue;
+
+        // Tree leaves are padded, test the exact bounds
+        const AABB &box = object->worldBounds;
+        if (!range.intersects(box)) continue;
+
+        unsigned int faceMask = dualParaboloid ? paraboloidMask(box, position) : cubeFaceMask(box, position);
+        if (faceMask == 0) continue;
+
+        if (cameraFrustum && !cameraFrustum->intersects(shadowVolumeBounds(box, position, shadowFarPlane)))
+            continue;
+
+        casters.push_back({ object, faceMask, object->transformVersion });
     }
+    sortCasters(casters.begin() + first, casters.end());
+}
+
+void Light::beginShadowDraw(const ShadowDraw &draw) const {
+    if (draw.clearMask != 0) clearShadowFaces(draw.layer, draw.clearMask);
+
+    for (int face = 0; face < 6; ++face) {
+        if (draw.copyMask & (1u << face))
+            glCopyImageSubData(shadowTexture, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, staticLayer + face,
+                shadowTexture, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, draw.layer + face,
+                shadowMapSize, shadowMapSize, 1);
+    }
+}
 
+unsigned int Light::drawShadow(const ShadowDraw &draw) const {
+    beginShadowDraw(draw);
+    unsigned int drawCalls = drawCasters(draw.casters, draw.layer);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
\ No newline at end of file
+    return drawCalls;
+}
+
+unsigned int Light::drawCasters(const std::vector<ShadowCaster> &casters, int layer) const {
+    glViewport(0, 0, shadowMapSize, shadowMapSize);
+    ShadowPipeline pipeline = shadowShaders->resolved();
+    unsigned int drawCalls = 0;
+
+    if (dualParaboloid) {
+        // One pass per hemisphere, the vertex shader warps and clips behind it
+        const Shader &pass = *shadowShaders->paraboloid;
+        pass.use();
+        pass.setVec3("lightPos", position);
+        pass.setFloat("far_plane", shadowFarPlane);
+        pass.setFloat("mapSize", (float)shadowMapSize);
+
+        glEnable(GL_CLIP_DISTANCE0);
+        glBindFramebuffer(GL_FRAMEBUFFER, faceFBO);
+        for (int hemisphere = 0; hemisphere < 2; ++hemisphere) {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowTexture, 0, layer + hemisphere);
+            pass.setInt("hemisphere", hemisphere);
+
+            for (const ShadowCaster &caster : casters) {
+                if ((caster.faceMask & (1u << hemisphere)) == 0) continue;
+                Object *object = caster.object;
+                pass.setMat4("model", object->GetModelMatrix());
+
+                glBindVertexArray(object->VAO);
+                glDrawArrays(GL_TRIANGLES, 0, object->vertices.size() / OBJECT_STRIDE);
+                drawCalls++;
+            }
+        }
+        glDisable(GL_CLIP_DISTANCE0);
+        glBindVertexArray(0);
+        return drawCalls;
+    }
+
+    if (pipeline == ShadowPipeline::FacePasses || type != LightType::Point) {
+        // One face at a time, each only gets the casters that reach it. Spot
+        // and directional maps are never layered, they're one face per map.
+        const Shader &pass = type == LightType::Directional ? *shadowShaders->ortho : *shadowShaders->face;
+        setShadowUniforms(pass, layer);
+        std::array<glm::mat4, 6> shadowTransforms = shadowMatrices();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, faceFBO);
+        for (unsigned int face = 0; face < shadowFaceCount(); ++face) {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowTexture, 0, layer + face);
+            pass.setMat4("shadowMatrix", shadowTransforms[face]);
+
+            for (const ShadowCaster &caster : casters) {
+                if ((caster.faceMask & (1u << face)) == 0) continue;
+                Object *object = caster.object;
+                pass.setMat4("model", object->GetModelMatrix());
+
+                glBindVertexArray(object->VAO);
+                glDrawArrays(GL_TRIANGLES, 0, object->vertices.size() / OBJECT_STRIDE);
+                drawCalls++;
+            }
+        }
+        glBindVertexArray(0);
+        return drawCalls;
+    }
+
+    // Layered, the shader picks each triangle's faces
+    bool instanced = pipeline == ShadowPipeline::VertexLayer;
+    const Shader &pass = instanced ? *shadowShaders->vertexLayer : *shadowShaders->geometry;
+    setShadowUniforms(pass, layer);
+    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+
+    // Render casters to depth cubemap, only on the faces they reach
+    for (const ShadowCaster &caster : casters) {
+        Object *object = caster.object;
+        pass.setMat4("model", object->GetModelMatrix());
+        pass.setInt("faceMask", caster.faceMask);
+
+        glBindVertexArray(object->VAO);
+        if (instanced)
+            glDrawArraysInstanced(GL_TRIANGLES, 0, object->vertices.size() / OBJECT_STRIDE, std::popcount(caster.faceMask));
+        else
+            glDrawArrays(GL_TRIANGLES, 0, object->vertices.size() / OBJECT_STRIDE);
+        drawCalls++;
+    }
+    glBindVertexArray(0);
+    return drawCalls;
+}
+
+static unsigned int faceCount(const std::vector<ShadowCaster> &casters) {
+    unsigned int faces = 0;
+    for (const ShadowCaster &caster : casters)
+        faces += std::popcount(caster.faceMask);
+    return faces;
+}
+
+// The casters reaching any of the faces, with their masks limited to them
+static std::vector<ShadowCaster> maskCasters(const std::vector<ShadowCaster> &casters, unsigned int faceMask) {
+    std::vector<ShadowCaster> result;
+    for (const ShadowCaster &caster : casters) {
+        unsigned int mask = caster.faceMask & faceMask;
+        if (mask != 0) result.push_back({ caster.object, mask, caster.transformVersion });
+    }
+    return result;
+}
+
+unsigned int Light::prepareShadowUpdate(const AABBTree &tree, const Frustum *cameraFrustum) {
+    selectedStatic.clear();
+    selectedDynamic.clear();
+    dirtyFaces = staticDirtyFaces = 0;
+    if (shadowMapSize == 0) return 0;
+
+    // The static layer doesn't depend on the camera, select it over the full range
+    std::vector<ShadowCaster> candidates;
+    selectCasters(tree, nullptr, candidates);
+
+    for (const ShadowCaster &caster : candidates) {
+        if (caster.object->isStatic) {
+            selectedStatic.push_back(caster);
+        } else if (!cameraFrustum || type != LightType::Point || cameraFrustum->intersects(
+            shadowVolumeBounds(caster.object->worldBounds, position, shadowFarPlane))) {
+            selectedDynamic.push_back(caster);
+        }
+    }
+
+    // A face is out of date when the light moved or its own casters changed
+    std::array<glm::mat4, 6> matrices = shadowMatrices();
+    for (unsigned int face = 0; face < shadowFaceCount(); ++face) {
+        FaceCache &cache = faceCache[face];
+        unsigned int bit = 1u << face;
+        bool lightChanged = !cache.valid || matrices[face] != cache.matrix || position != cache.position ||
+            intensity != cache.intensity || shadowNearPlane != cache.nearPlane ||
+            shadowFarPlane != cache.farPlane;
+
+        if (lightChanged || maskCasters(selectedStatic, bit) != cache.staticCasters)
+            staticDirtyFaces |= bit;
+        if ((staticDirtyFaces & bit) || maskCasters(selectedDynamic, bit) != cache.dynamicCasters)
+            dirtyFaces |= bit;
+
+        if (dirtyFaces & bit) cache.staleFrames++;
+    }
+    return dirtyFaces;
+}
+
+unsigned int Light::updateShadowMap(unsigned int faceMask, std::vector<ShadowDraw> &draws) {
+    if (shadowMapSize == 0) return 0;
+
+    unsigned int faces = dirtyFaces & faceMask;
+    // Faces left for later that were never drawn would show someone else's depth
+    unsigned int clearMask = unrenderedFaceMask() & ~faces;
+    if (faces == 0) {
+        if (clearMask != 0) draws.push_back({ this, shadowLayer, 0, clearMask, 0, {} });
+        return 0;
+    }
+
+    bool hasDynamic = !selectedDynamic.empty();
+    for (const FaceCache &cache : faceCache) hasDynamic |= !cache.dynamicCasters.empty();
+
+    unsigned int casterFaces = 0;
+    if (!hasDynamic) {
+        // Only static casters, the shadow map itself is the cache
+        std::vector<ShadowCaster> casters = maskCasters(selectedStatic, faces);
+        casterFaces = faceCount(casters);
+        draws.push_back({ this, shadowLayer, 0, clearMask | faces, 0, std::move(casters) });
+        for (int face = 0; face < 6; ++face) {
+            if (faces & (1u << face)) faceCache[face].staticValid = false;
+        }
+    } else if (staticLayer < 0 && !(shadowPool && shadowPool->allocateStaticLayer(*this))) {
+        // No room for a static layer, redraw everything on the faces
+        std::vector<ShadowCaster> casters = maskCasters(selectedStatic, faces);
+        std::vector<ShadowCaster> dynamicCasters = maskCasters(selectedDynamic, faces);
+        casters.insert(casters.end(), dynamicCasters.begin(), dynamicCasters.end());
+        casterFaces = faceCount(casters);
+        draws.push_back({ this, shadowLayer, 0, clearMask | faces, 0, std::move(casters) });
+        for (int face = 0; face < 6; ++face) {
+            if (faces & (1u << face)) faceCache[face].staticValid = false;
+        }
+    } else {
+        unsigned int staticFaces = 0;
+        for (int face = 0; face < 6; ++face) {
+            unsigned int bit = 1u << face;
+            if ((faces & bit) && ((staticDirtyFaces & bit) || !faceCache[face].staticValid))
+                staticFaces |= bit;
+        }
+        if (staticFaces != 0) {
+            std::vector<ShadowCaster> casters = maskCasters(selectedStatic, staticFaces);
+            casterFaces += faceCount(casters);
+            draws.push_back({ this, staticLayer, 0, staticFaces, 0, std::move(casters) });
+            for (int face = 0; face < 6; ++face) {
+                if (staticFaces & (1u << face)) faceCache[face].staticValid = true;
+            }
+        }
+
+        // Restore the static depth on the faces, then draw the dynamic casters over it
+        std::vector<ShadowCaster> casters = maskCasters(selectedDynamic, faces);
+        casterFaces += faceCount(casters);
+        draws.push_back({ this, shadowLayer, 1, clearMask, faces, std::move(casters) });
+    }
+
+    std::array<glm::mat4, 6> matrices = shadowMatrices();
+    for (int face = 0; face < 6; ++face) {
+        unsigned int bit = 1u << face;
+        if ((faces & bit) == 0) continue;
+
+        FaceCache &cache = faceCache[face];
+        cache.valid = true;
+        cache.matrix = matrices[face];
+        cache.position = position;
+        cache.intensity = intensity;
+        cache.nearPlane = shadowNearPlane;
+        cache.farPlane = shadowFarPlane;
+        cache.staticCasters = maskCasters(selectedStatic, bit);
+        cache.dynamicCasters = maskCasters(selectedDynamic, bit);
+        cache.staleFrames = 0;
+    }
+    dirtyFaces &= ~faces;
+    return casterFaces;
+}
+
+LightBuffer::LightBuffer() {
+    glGenBuffers(1, &buffer);
+    glGenBuffers(1, &matrixBuffer);
+}
+
+LightBuffer::~LightBuffer() {
+    if (buffer != 0) glDeleteBuffers(1, &buffer);
+    if (matrixBuffer != 0) glDeleteBuffers(1, &matrixBuffer);
+}
+
+void LightBuffer::upload(const std::vector<Light*> &lights) {
+    std::vector<LightData> data;
+    std::vector<glm::mat4> matrices;
+    data.reserve(lights.size());
+    for (Light *light : lights) {
+        LightData entry{};
+        // Directional lights have no range, w only says whether there's a shadow map
+        float farPlane = light->type == LightType::Directional ? 1.0f : light->shadowFarPlane;
+        entry.positionRange = glm::vec4(light->position, light->shadowTier >= 0 ? farPlane : 0.0f);
+        entry.colorIntensity = glm::vec4(light->color, light->intensity);
+        entry.direction = glm::vec4(glm::normalize(light->direction), std::cos(glm::radians(light->outerCone)));
+        entry.shadowTier = std::max(light->shadowTier, 0);
+        entry.shadowCube = light->shadowLayer / 6;
+        entry.shadowMode = light->dualParaboloid ? 1 : 0;
+        entry.type = (int)light->type;
+        entry.matrixIndex = matrices.size();
+        entry.cascadeCount = light->type == LightType::Directional ? light->shadowFaceCount() : 0;
+        entry.cosInnerCone = std::cos(glm::radians(light->innerCone));
+        entry.shadowFade = light->shadowFade;
+        entry.shadowMaskChannel = light->shadowMaskChannel;
+        data.push_back(entry);
+
+        if (light->type != LightType::Point) {
+            std::array<glm::mat4, 6> lightMatrices = light->shadowMatrices();
+            matrices.insert(matrices.end(), lightMatrices.begin(), lightMatrices.begin() + light->shadowFaceCount());
+        }
+    }
+
+    uploadStorageBuffer(buffer, capacity, data);
+    uploadStorageBuffer(matrixBuffer, matrixCapacity, matrices);
+    count = data.size();
+}
+
+void LightBuffer::bind(const Shader &shader, const ShadowPool &pool, int textureUnit) const {
+    shader.use();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BUFFER_BINDING, buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SHADOW_MATRIX_BINDING, matrixBuffer);
+    shader.setInt("numLights", count);
+    pool.bindTextures(shader, textureUnit);
+    shader.setVec3("ambientLightColor", glm::vec3(1.0f));
+    shader.setFloat("ambientLight", 0.1f);
+}
@@ -0,0 +1,140 @@
+#include "LightGrid.h"
+#include "Bounds.h"
+#include "StorageBuffer.h"
+#include <glad/gl.h>
+#include <algorithm>
+#include <cmath>
+#include <bit>
+
+constexpr unsigned int SLICE_SIZE = CLUSTER_X * CLUSTER_Y; // Clusters per depth slice, a multiple of 4
+
+LightGrid::LightGrid() {
+    glGenBuffers(1, &gridBuffer);
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gridBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (CLUSTER_COUNT + 1) * sizeof(glm::uvec2), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+LightGrid::~LightGrid() {
+    if (gridBuffer != 0) glDeleteBuffers(1, &gridBuffer);
+    if (indexBuffer != 0) glDeleteBuffers(1, &indexBuffer);
+}
+
+// Depth of the near side of a slice, slices grow exponentially
+static float sliceDepth(unsigned int slice, float nearPlane, float farPlane) {
+    return nearPlane * std::pow(farPlane / nearPlane, (float)slice / CLUSTER_Z);
+}
+
+void LightGrid::buildClusters(const glm::mat4 &projection, float nearPlane, float farPlane) {
+    clusterProjection = projection;
+    clusterNear = nearPlane;
+    clusterFar = farPlane;
+
+    minX.resize(CLUSTER_COUNT); minY.resize(CLUSTER_COUNT); minZ.resize(CLUSTER_COUNT);
+    maxX.resize(CLUSTER_COUNT); maxY.resize(CLUSTER_COUNT); maxZ.resize(CLUSTER_COUNT);
+
+    // Symmetric perspective, view-space x = ndc x * depth * tanX
+    float tanX = 1.0f / projection[0][0];
+    float tanY = 1.0f / projection[1][1];
+
+    for (unsigned int z = 0; z < CLUSTER_Z; ++z) {
+        float nearDepth = sliceDepth(z, nearPlane, farPlane);
+        float farDepth = sliceDepth(z + 1, nearPlane, farPlane);
+        for (unsigned int y = 0; y < CLUSTER_Y; ++y) {
+            float y0 = (-1.0f + 2.0f * y / CLUSTER_Y) * tanY;
+            float y1 = (-1.0f + 2.0f * (y + 1) / CLUSTER_Y) * tanY;
+            for (unsigned int x = 0; x < CLUSTER_X; ++x) {
+                float x0 = (-1.0f + 2.0f * x / CLUSTER_X) * tanX;
+                float x1 = (-1.0f + 2.0f * (x + 1) / CLUSTER_X) * tanX;
+
+                // The tile's edges fan out with depth, bound both ends
+                unsigned int i = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+                minX[i] = std::min(x0 * nearDepth, x0 * farDepth);
+                maxX[i] = std::max(x1 * nearDepth, x1 * farDepth);
+                minY[i] = std::min(y0 * nearDepth, y0 * farDepth);
+                maxY[i] = std::max(y1 * nearDepth, y1 * farDepth);
+                minZ[i] = -farDepth;
+                maxZ[i] = -nearDepth;
+            }
+        }
+    }
+}
+
+void LightGrid::build(const std::vector<Light*> &lights, const glm::mat4 &view, const glm::mat4 &projection,
+    float nearPlane, float farPlane) {
+    if (projection != clusterProjection || nearPlane != clusterNear || farPlane != clusterFar)
+        buildClusters(projection, nearPlane, farPlane);
+
+    BoxLanes bounds{ minX.data(), minY.data(), minZ.data(), maxX.data(), maxY.data(), maxZ.data() };
+    float logRatio = std::log(farPlane / nearPlane);
+
+    hits.clear();
+    std::vector<unsigned int> unbounded;
+    std::vector<unsigned int> counts(CLUSTER_COUNT, 0);
+
+    for (unsigned int light = 0; light < lights.size(); ++light) {
+        float range = lights[light]->lightRange();
+        if (range < 0.0f) {
+            unbounded.push_back(light);
+            continue;
+        }
+        if (range == 0.0f) continue;
+
+        glm::vec3 center = glm::vec3(view * glm::vec4(lights[light]->position, 1.0f));
+        float nearDepth = -center.z - range;
+        float farDepth = -center.z + range;
+        if (farDepth < nearPlane || nearDepth > farPlane) continue;
+
+        // Only the slices the sphere's depth range covers
+        unsigned int firstSlice = 0, lastSlice = CLUSTER_Z - 1;
+        if (nearDepth > nearPlane)
+            firstSlice = std::min<unsigned int>(std::log(nearDepth / nearPlane) / logRatio * CLUSTER_Z, CLUSTER_Z - 1);
+        if (farDepth < farPlane)
+            lastSlice = std::min<unsigned int>(std::log(farDepth / nearPlane) / logRatio * CLUSTER_Z, CLUSTER_Z - 1);
+
+        SphereSplat sphere(center, range);
+        for (size_t first = firstSlice * SLICE_SIZE; first < (lastSlice + 1) * SLICE_SIZE; first += 4) {
+            unsigned int mask = spheresReachBoxes(sphere.lanes(), 0, bounds, first);
+            while (mask != 0) {
+                unsigned int cluster = first + std::countr_zero(mask);
+                mask &= mask - 1;
+                hits.push_back(cluster);
+                hits.push_back(light);
+                counts[cluster]++;
+            }
+        }
+    }
+
+    // Compact the lists, each cluster's lights end up in light order
+    ranges.resize(CLUSTER_COUNT + 1);
+    unsigned int offset = 0;
+    occupied = 0;
+    for (unsigned int cluster = 0; cluster < CLUSTER_COUNT; ++cluster) {
+        ranges[cluster] = glm::uvec2(offset, 0);
+        offset += counts[cluster];
+        occupied += counts[cluster] != 0;
+    }
+    ranges[CLUSTER_COUNT] = glm::uvec2(offset, unbounded.size());
+
+    indices.resize(offset + unbounded.size());
+    for (size_t i = 0; i < hits.size(); i += 2) {
+        glm::uvec2 &range = ranges[hits[i]];
+        indices[range.x + range.y++] = hits[i + 1];
+    }
+    std::copy(unbounded.begin(), unbounded.end(), indices.begin() + offset);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gridBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, ranges.size() * sizeof(glm::uvec2), ranges.data());
+
+    uploadStorageBuffer(indexBuffer, indexCapacity, indices);
+}
+
+void LightGrid::bind(const Shader &shader, int width, int height) const {
+    shader.use();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_GRID_BINDING, gridBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_INDEX_BINDING, indexBuffer);
+    shader.setVec2("clusterTileSize", (float)width / CLUSTER_X, (float)height / CLUSTER_Y);
+    shader.setFloat("clusterNear", clusterNear);
+    shader.setFloat("clusterFar", clusterFar);
+}
@@ -10,23 +10,121 @@
 #include "Camera.h"
 #include "Light.h"
 #include "MapLoader.h"
+#include "GPUScene.h"
+#include "GPUCuller.h"
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
+#include "OcclusionQueries.h"
+#include "PotentiallyVisibleSet.h"
+#include "ShadowPool.h"
+#include "ShadowBatch.h"
+#include "ShadowScheduler.h"
+#include "ShadowPrefilter.h"
+#include "LightGrid.h"
+#include "ObjectLightLists.h"
+#include "DeferredRenderer.h"
+#include "DepthPrepass.h"
+#include "ShadowMask.h"
+#include "WeightedBlendedOIT.h"
+#include "TriangleSorter.h"
+#include "WorkerPool.h"
+#include "GPUTimer.h"
 
 #include <iostream>
 #include <algorithm>
+#include <cstring>
+#include <memory>
+#include <functional>
+#include <bit>
+
+struct RenderSettings {
+    bool gpuCulling = false;
+    bool pvs = true; // CPU path, when the map has a bake
+    OcclusionCulling occlusionCulling = OcclusionCulling::Software; // CPU path, the GPU one has its Hi-Z test
+    bool shadowFrustumCulling = true;
+    bool shadowCache = true;
+    bool shadowBatching = true;
+    bool shadowAmortize = true;
+    ShadowPipeline shadowPipeline = ShadowPipeline::GeometryShader;
+    ShadowFilter shadowFilter = ShadowFilter::PCF;
+    LightCulling lightCulling = LightCulling::Clustered;
+    RenderPath renderPath = RenderPath::Forward; // Chosen at startup, --deferred
+    PrepassMode depthPrepass = PrepassMode::Auto;
+    bool shadowMask = false; // Forward only, resolves the top lights' shadows after a pre-pass
+    TransparencyMode transparency = TransparencyMode::WeightedBlended;
+};
+
+const char *shadowPipelineName(ShadowPipeline pipeline) {
+    switch (pipeline) {
+    case ShadowPipeline::VertexLayer: return "vs layer";
+    case ShadowPipeline::FacePasses:  return "face passes";
+    default:                          return "gs";
+    }
+}
+
+const char *lightCullingName(LightCulling culling) {
+    switch (culling) {
+    case LightCulling::Clustered: return "clustered";
+    case LightCulling::PerObject: return "per object";
+    default:                      return "none";
+    }
+}
+
+const char *prepassModeName(PrepassMode mode) {
+    switch (mode) {
+    case PrepassMode::Off: return "off";
+    case PrepassMode::On:  return "on";
+    default:               return "auto";
+    }
+}
+
+const char *transparencyName(TransparencyMode mode) {
+    switch (mode) {
+    case TransparencyMode::WeightedBlended: return "weighted blended";
+    case TransparencyMode::SortedTriangles: return "sorted triangles";
+    default:                                return "sorted";
+    }
+}
+
+const char *occlusionCullingName(OcclusionCulling culling) {
+    switch (culling) {
+    case OcclusionCulling::Software: return "software";
+    case OcclusionCulling::Queries:  return "queries";
+    default:                         return "off";
+    }
+}
+
+const char *shadowFilterName(ShadowFilter filter) {
+    switch (filter) {
+    case ShadowFilter::PCF:  return "pcf";
+    case ShadowFilter::EVSM: return "evsm";
+    default:                 return "nearest";
+    }
+}
 
 struct CallbackData {
     Camera *camera;
+    RenderSettings *settings;
 };
 
+bool hasExtension(const char *name);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 //void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 
 #define WINDOW_TITLE "Title"
 int window_width = 1920;
 int window_height = 1080;
 
-int main() {
+int main(int argc, char **argv) {
+    RenderSettings settings;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--deferred") == 0) settings.renderPath = RenderPath::Deferred;
+        else if (std::strcmp(argv[i], "--forward") == 0) settings.renderPath = RenderPath::Forward;
+        else std::cout << "Unknown option: " << argv[i] << std::endl;
+    }
+
     // Initialize and configure (glfw)
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -45,6 +143,7 @@ int main() {
 
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetKeyCallback(window, key_callback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     //glfwSetScrollCallback(window, scroll_callback);
 
@@ -55,6 +154,17 @@ int main() {
         return -1;
     }
 
+    // The lit fragment shaders sample the object textures and every shadow tier.
+    // GL 4.4 only promises 16 units, more than that is common but not certain.
+    GLint textureUnits = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &textureUnits);
+    if (textureUnits < (GLint)(MAX_TEXTURES + SHADOW_TEXTURE_UNITS)) {
+        std::cout << "The lit shaders need " << MAX_TEXTURES + SHADOW_TEXTURE_UNITS <<
+            " fragment texture units, this GPU has " << textureUnits << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+
     GLFWmonitor* primary = glfwGetPrimaryMonitor();
     const GLFWvidmode* mode = glfwGetVideoMode(primary);
 
@@ -75,20 +185,119 @@ int main() {
             glm::radians(45.0f), (float)window_width / (float)window_height,
             camera.nearPlane, camera.farPlane);
 
-    Shader shader("shaders/Shader.vs", "shaders/Shader.fs");
+    Shader shader("shaders/Shader.vs", "shaders/Shader.fs", nullptr,
+        { "shaders/Texture.glsl", "shaders/Lighting.glsl" });
     Shader shadowShader("shaders/Shadow.vs", "shaders/Shadow.fs", "shaders/Shadow.gs");
+    Shader shadowFaceShader("shaders/ShadowFace.vs", "shaders/Shadow.fs");
+    Shader shadowParaboloidShader("shaders/ShadowParaboloid.vs", "shaders/ShadowParaboloid.fs");
+    Shader shadowOrthoShader("shaders/ShadowFace.vs", "shaders/ShadowOrtho.fs");
+    std::unique_ptr<Shader> shadowLayerShader;
+    std::unique_ptr<Shader> shadowBatchShader;
+    if (hasExtension("GL_ARB_shader_viewport_layer_array")) {
+        shadowLayerShader = std::make_unique<Shader>("shaders/ShadowLayer.vs", "shaders/Shadow.fs");
+        shadowBatchShader = std::make_unique<Shader>("shaders/ShadowBatch.vs", "shaders/ShadowBatch.fs");
+    }
+    Shader indirectShader("shaders/Indirect.vs", "shaders/Shader.fs", nullptr,
+        { "shaders/Texture.glsl", "shaders/Lighting.glsl" });
+    Shader shadowIndirectShader("shaders/ShadowIndirect.vs", "shaders/Shadow.fs", "shaders/Shadow.gs");
+    Shader cullShader("shaders/Cull.cs");
+    Shader hiZShader("shaders/HiZ.cs");
+    Shader shadowPrefilterShader("shaders/ShadowPrefilter.cs");
+    Shader depthShader("shaders/Depth.vs", "shaders/Depth.fs");
+    Shader depthIndirectShader("shaders/DepthIndirect.vs", "shaders/Depth.fs");
+    Shader shadowMaskShader("shaders/DeferredLight.vs", "shaders/ShadowMask.fs", nullptr, { "shaders/Lighting.glsl" });
+    Shader oitCompositeShader("shaders/DeferredLight.vs", "shaders/OITComposite.fs");
+    Shader occlusionBoxShader("shaders/OcclusionBox.vs", "shaders/Depth.fs");
+
+    // Deferred path programs, only built when it's selected
+    std::unique_ptr<Shader> gbufferShader, gbufferIndirectShader;
+    std::unique_ptr<Shader> deferredLightShader, deferredStencilShader, deferredCompositeShader;
+    std::unique_ptr<DeferredRenderer> deferredRenderer;
+    if (settings.renderPath == RenderPath::Deferred) {
+        gbufferShader = std::make_unique<Shader>("shaders/Shader.vs", "shaders/GBuffer.fs", nullptr,
+            std::vector<const char*>{ "shaders/Texture.glsl" });
+        gbufferIndirectShader = std::make_unique<Shader>("shaders/Indirect.vs", "shaders/GBuffer.fs", nullptr,
+            std::vector<const char*>{ "shaders/Texture.glsl" });
+        deferredLightShader = std::make_unique<Shader>("shaders/DeferredLight.vs", "shaders/DeferredLight.fs",
+            nullptr, std::vector<const char*>{ "shaders/Lighting.glsl" });
+        deferredStencilShader = std::make_unique<Shader>("shaders/DeferredLight.vs", "shaders/DeferredStencil.fs");
+        deferredCompositeShader = std::make_unique<Shader>("shaders/DeferredLight.vs", "shaders/DeferredComposite.fs");
+
+        DeferredShaders deferredShaders;
+        deferredShaders.light = deferredLightShader.get();
+        deferredShaders.stencil = deferredStencilShader.get();
+        deferredShaders.composite = deferredCompositeShader.get();
+        deferredRenderer = std::make_unique<DeferredRenderer>(deferredShaders);
+    }
 
-    Scene map = MAPLoader::loadMAP("maps/map.map", shader, shadowShader);
-
-    std::vector<Object*> &sceneObjects       = map.sceneObjects;
-    std::vector<Light*>  &sceneLights        = map.sceneLights;
-    std::vector<Object*> &opaqueObjects      = map.opaqueObjects;
-    std::vector<Object*> &transparentObjects = map.transparentObjects;
+    ShadowShaders shadowShaders;
+    shadowShaders.geometry = &shadowShader;
+    shadowShaders.vertexLayer = shadowLayerShader.get();
+    shadowShaders.face = &shadowFaceShader;
+    shadowShaders.paraboloid = &shadowParaboloidShader;
+    shadowShaders.ortho = &shadowOrthoShader;
+
+    const std::string mapPath = "maps/map.map";
+    Scene map = MAPLoader::loadMAP(mapPath, shader, shadowShaders);
+
+    std::vector<Object*> &sceneObjects = map.sceneObjects;
+    std::vector<Light*>  &sceneLights  = map.sceneLights;
+
+    // Shadow maps from a pooled allocator, sized by each light's screen coverage.
+    // Filtered maps look as smooth at 2048 as nearest ones at 8192.
+    ShadowPoolSettings shadowSettings;
+    shadowSettings.minSize = 256;
+    shadowSettings.maxSize = 2048;
+    shadowSettings.depthFormat = ShadowDepthFormat::Depth24;
+    shadowSettings.memoryBudget = size_t(512) << 20;
+    shadowSettings.paraboloidDistance = 20.0f;
+    // Lights past the most important 16 are unshadowed, their shadows fade out
+    shadowSettings.maxShadowedLights = 16;
+    ShadowPool shadowPool(shadowSettings);
+    ShadowPrefilter shadowPrefilter(shadowPool, &shadowPrefilterShader);
+    LightBuffer lightBuffer;
+    LightGrid lightGrid;
+    DepthPrepass depthPrepass;
+    ShadowMask shadowMask(&shadowMaskShader);
+    WeightedBlendedOIT weightedBlendedOIT(&oitCompositeShader);
+    WorkerPool workerPool;
+    TriangleSorter triangleSorter(workerPool);
+    // Visibility of the static objects from each view cell, baked once per map
+    PotentiallyVisibleSet pvs;
+    pvs.loadOrBake(mapPath, map, workerPool);
+
+    GPUScene gpuScene(sceneObjects);
+    ObjectLightLists objectLightLists(gpuScene);
+    GPUCuller gpuCuller(gpuScene, &cullShader, &hiZShader);
+    ShadowBatch shadowBatch(gpuScene, shadowBatchShader.get());
+
+    // Dirty shadow faces beyond the budget wait for later frames
+    ShadowSchedulerSettings schedulerSettings;
+    schedulerSettings.faceBudget = 24;
+    schedulerSettings.millisecondBudget = 0.0;
+    ShadowScheduler shadowScheduler(schedulerSettings);
+
+    FrustumCuller frustumCuller;
+    OcclusionCuller occlusionCuller(workerPool);
+    OcclusionQueries occlusionQueries(&occlusionBoxShader);
+    std::vector<Object*> cullCandidates;
+    std::vector<Object*> frustumVisible;
+    std::vector<Object*> visibleObjects;
+    std::vector<Object*> visibleOpaque;
+    std::vector<Object*> visibleTransparent;
+    std::vector<ShadowDraw> shadowDraws;
+    std::vector<Light*> cpuShadowLights;
+    std::vector<unsigned int> shadowFaceMasks;
+    size_t shadowFaces = 0, shadowFacesTotal = 0, shadowDrawCalls = 0;
+    size_t shadowUpdates = 0, shadowDirty = 0;
+    GPUTimer shadowTimer;
+    double lastReportTime = glfwGetTime();
+    int reportFrames = 0;
 
     double lastTime = glfwGetTime();
     double DeltaTime = 0.0;
 
-    CallbackData callbackData{ &camera };
+    CallbackData callbackData{ &camera, &settings };
     glfwSetWindowUserPointer(window, &callbackData);
 
     while (!glfwWindowShouldClose(window)) {
@@ -155,48 +364,345 @@ int main() {
         camera.clampRotation();
 
         // Logic
+        map.updateSpatialIndex();
+        // Model matrices for the GPU-driven draws and the batched shadows
+        gpuScene.update(map.movedObjects);
 
         // Draw
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // Shadow map
-        for (Light *light : sceneLights) {
-            light->renderShadowMap(sceneObjects);
+        glm::mat4 view = camera.GetViewMatrix();
+        glm::mat4 projection = camera.projectionMatrix;
+
+        // Frustum culling. The tree finds candidates whose fattened leaf
+        // boxes intersect, the SIMD culler then tests their exact bounds.
+        Frustum frustum = Frustum::fromMatrix(projection * view);
+        bool softwareOcclusion = settings.occlusionCulling == OcclusionCulling::Software && !settings.gpuCulling;
+        bool occlusionQuerying = settings.occlusionCulling == OcclusionCulling::Queries && !settings.gpuCulling;
+        // The camera's view cell lists what can be seen from anywhere in it
+        bool usePvs = settings.pvs && !settings.gpuCulling && pvs.update(camera.position);
+        visibleObjects.clear();
+        if (settings.gpuCulling) {
+            // The GPU culls everything it draws. Only sorted translucent objects are drawn from here.
+            if (settings.transparency != TransparencyMode::WeightedBlended)
+                frustumCuller.cull(frustum, map.transparentObjects, visibleObjects);
+        } else if (occlusionQuerying) {
+            // The query walk does its own frustum tests and stops at hidden subtrees,
+            // leaves outside the view cell's set are skipped before they're queried
+            std::function<bool(const Object&)> potentiallyVisible;
+            if (usePvs) potentiallyVisible = [&](const Object &object) { return pvs.isVisible(object); };
+            size_t reached = occlusionQueries.cull(map.objectTree, frustum, camera.position, camera.nearPlane,
+                visibleObjects, potentiallyVisible);
+            frustumCuller.stats.visible += reached;
+            frustumCuller.stats.culled += sceneObjects.size() - reached;
+        } else {
+            // The PVS replaces the tree's coarse frustum query, the culler tests what it lists
+            const std::vector<Object*> *candidates = &cullCandidates;
+            if (usePvs) {
+                candidates = &pvs.visibleObjects();
+            } else {
+                cullCandidates.clear();
+                map.objectTree.queryFrustum(frustum, cullCandidates);
+            }
+            frustumCuller.stats.culled += sceneObjects.size() - candidates->size();
+
+            if (softwareOcclusion) {
+                // Then against the largest occluders in view, drawn into a small CPU depth buffer
+                frustumVisible.clear();
+                frustumCuller.cull(frustum, *candidates, frustumVisible);
+                occlusionCuller.cull(projection * view, camera.position, frustumVisible, visibleObjects);
+            } else {
+                frustumCuller.cull(frustum, *candidates, visibleObjects);
+            }
         }
 
-        glViewport(0, 0, window_width, window_height);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        visibleOpaque.clear();
+        visibleTransparent.clear();
+        for (Object *object : visibleObjects) {
+            // Objects with both kinds of faces draw each in its pass
+            if (object->hasOpaque()) visibleOpaque.push_back(object);
+            if (object->hasTransparency) visibleTransparent.push_back(object);
+        }
 
-        glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 projection = camera.projectionMatrix;
+        shadowPool.settings.paraboloidShadows = !settings.gpuCulling;
+        shadowPool.settings.filter = settings.shadowFilter;
+        shadowPool.update(sceneLights, camera.position, projection, window_height, (float)DeltaTime);
+        for (Light *light : sceneLights) light->fitCascades(camera);
+
+        // GPU visibility for the camera and every light
+        if (settings.gpuCulling) {
+            gpuCuller.shadowFrustumCulling = settings.shadowFrustumCulling;
+            gpuCuller.cull(view, projection, sceneLights);
+        } else {
+            // The pyramid stops following the camera, don't cull against it when switched back on
+            gpuCuller.invalidateDepthPyramid();
+        }
 
-        // Draw opaque objects
-        for (Object *object : opaqueObjects) {
-            object->draw(view, projection, sceneLights);
+        // Shadow map
+        shadowShaders.pipeline = settings.shadowPipeline;
+        if (!settings.shadowCache) {
+            for (Light *light : sceneLights) light->invalidateShadowMap();
         }
 
-        // Sort translucent objects back to front
-        glm::vec3 camPos = camera.position;
-        std::sort(transparentObjects.begin(), transparentObjects.end(),
-            [camPos](Object *a, Object *b) {
-                float distA = glm::length(camPos - a->position);
-                float distB = glm::length(camPos - b->position);
-                return distA > distB; // Farthest first
-            });
+        shadowTimer.begin();
+        // The GPU-driven pass only draws point light cubes, the rest go through the CPU path
+        cpuShadowLights.clear();
+        shadowDraws.clear();
+        if (settings.gpuCulling) {
+            gpuCuller.renderShadowMaps(shadowIndirectShader, sceneLights);
+            for (Light *light : sceneLights) {
+                if (light->type != LightType::Point) cpuShadowLights.push_back(light);
+            }
+        } else {
+            cpuShadowLights = sceneLights;
+        }
+        if (!cpuShadowLights.empty()) {
+            const Frustum *shadowFrustum = settings.shadowFrustumCulling ? &frustum : nullptr;
+            // Cached, only faces whose light or casters changed are dirty
+            for (Light *light : cpuShadowLights)
+                shadowDirty += std::popcount(light->prepareShadowUpdate(map.objectTree, shadowFrustum));
+
+            if (settings.shadowAmortize) {
+                shadowUpdates += shadowScheduler.schedule(cpuShadowLights, camera.position, shadowFaceMasks);
+            } else {
+                shadowFaceMasks.assign(cpuShadowLights.size(), 0x3F);
+                for (Light *light : cpuShadowLights) shadowUpdates += std::popcount(light->dirtyFaceMask());
+            }
+
+            for (size_t i = 0; i < cpuShadowLights.size(); ++i) {
+                shadowFaces += cpuShadowLights[i]->updateShadowMap(shadowFaceMasks[i], shadowDraws);
+                shadowFacesTotal += 6 * sceneObjects.size();
+            }
+
+            // Every dirty light in one multi-draw per tier, or light by light
+            if (settings.shadowBatching && shadowBatch.supported()) {
+                shadowDrawCalls += shadowBatch.render(shadowDraws);
+            } else {
+                for (const ShadowDraw &draw : shadowDraws)
+                    shadowDrawCalls += draw.light->drawShadow(draw);
+            }
+        }
 
+        // Blur what changed into the EVSM moments
+        if (settings.shadowFilter == ShadowFilter::EVSM) {
+            if (settings.gpuCulling) {
+                for (Light *light : sceneLights) {
+                    if (light->type == LightType::Point) shadowPrefilter.filter(*light, light->allFacesMask());
+                }
+            }
+            shadowPrefilter.filter(shadowDraws);
+        }
+        shadowTimer.end();
 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glDepthMask(GL_FALSE);
+        glViewport(0, 0, window_width, window_height);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // Draw translucent objects
-        for (Object *object : transparentObjects) {
-            object->draw(view, projection, sceneLights);
+        // The mask reads the pre-pass depth, which the deferred path keeps in its G-buffer instead
+        bool useShadowMask = settings.shadowMask && !deferredRenderer;
+        if (useShadowMask) shadowMask.selectLights(sceneLights, shadowPool, camera.position, projection);
+
+        // Lights and shadow maps, bound once for every lit draw this frame.
+        // After the shadow pass, which may have grown the pool's arrays.
+        lightBuffer.upload(sceneLights);
+        lightBuffer.bind(shader, shadowPool, MAX_TEXTURES);
+        if (settings.gpuCulling)
+            lightBuffer.bind(indirectShader, shadowPool, MAX_TEXTURES);
+        if (deferredRenderer)
+            lightBuffer.bind(*deferredLightShader, shadowPool, MAX_TEXTURES);
+        if (useShadowMask)
+            lightBuffer.bind(shadowMaskShader, shadowPool, MAX_TEXTURES);
+
+        // Each fragment only shades the lights assigned to its cluster or its object.
+        // The GPU-culled draws aren't known here, so every object gets a list.
+        if (settings.lightCulling == LightCulling::Clustered) {
+            lightGrid.build(sceneLights, view, projection, camera.nearPlane, camera.farPlane);
+            lightGrid.bind(shader, window_width, window_height);
+            if (settings.gpuCulling)
+                lightGrid.bind(indirectShader, window_width, window_height);
+        } else if (settings.lightCulling == LightCulling::PerObject) {
+            objectLightLists.build(settings.gpuCulling ? sceneObjects : visibleObjects, sceneLights);
+            objectLightLists.bind();
+        }
+        shader.use();
+        shader.setInt("lightCulling", (int)settings.lightCulling);
+        indirectShader.use();
+        indirectShader.setInt("lightCulling", (int)settings.lightCulling);
+
+        // Draw opaque objects, lit directly or into the G-buffer
+        if (deferredRenderer) deferredRenderer->beginGeometry(window_width, window_height);
+        // Depth first from the same draw list when overdraw makes it worth it,
+        // then only the visible fragment of each pixel is shaded. The shadow
+        // mask and the occlusion queries need the depth every frame.
+        depthPrepass.mode = useShadowMask || occlusionQuerying ? PrepassMode::On : settings.depthPrepass;
+        depthPrepass.measureOverdraw = !occlusionQuerying;
+        if (depthPrepass.beginPrepass()) {
+            if (settings.gpuCulling) {
+                gpuCuller.drawOpaque(depthIndirectShader, view, projection);
+            } else if (occlusionQuerying) {
+                occlusionQueries.drawDepth(view, projection, depthShader);
+            } else {
+                for (Object *object : visibleOpaque)
+                    object->draw(view, projection, depthShader, ObjectPart::Opaque);
+            }
+            depthPrepass.endPrepass();
+            // Hidden nodes are tested against the finished depth, their objects drawn if they pass
+            if (occlusionQuerying) occlusionQueries.queryHidden(view, projection, depthShader);
+            if (useShadowMask) shadowMask.resolve(window_width, window_height, view, projection);
+        }
+        shadowMask.bind(shader, useShadowMask);
+        shadowMask.bind(indirectShader, useShadowMask);
+        depthPrepass.beginShading();
+        if (settings.gpuCulling) {
+            gpuCuller.drawOpaque(deferredRenderer ? *gbufferIndirectShader : indirectShader, view, projection);
+            // Occluders for next frame's cull
+            gpuCuller.buildDepthPyramid(window_width, window_height);
+        } else {
+            for (Object *object : visibleOpaque) {
+                bool conditional = occlusionQuerying && occlusionQueries.beginConditional(*object);
+                if (deferredRenderer) object->draw(view, projection, *gbufferShader, ObjectPart::Opaque);
+                else object->draw(view, projection, ObjectPart::Opaque);
+                if (conditional) occlusionQueries.endConditional();
+            }
+        }
+        depthPrepass.end();
+        // Light the G-buffer, transparents are drawn forward over the result
+        if (deferredRenderer) deferredRenderer->shade(sceneLights, view, projection);
+
+        // Draw translucent objects, behind them the mask holds the surface they cover
+        if (useShadowMask) {
+            shadowMask.bind(shader, false);
+            shadowMask.bind(indirectShader, false);
+        }
+        if (settings.transparency == TransparencyMode::WeightedBlended) {
+            // Any order, the GPU-culled ones in one multi-draw
+            weightedBlendedOIT.begin(window_width, window_height);
+            const Shader &transparentShader = settings.gpuCulling ? indirectShader : shader;
+            transparentShader.use();
+            transparentShader.setBool("weightedBlended", true);
+            if (settings.gpuCulling) {
+                gpuCuller.drawTransparent(indirectShader, view, projection);
+            } else {
+                for (Object *object : visibleTransparent) {
+                    bool conditional = occlusionQuerying && occlusionQueries.beginConditional(*object);
+                    object->draw(view, projection, ObjectPart::Transparent);
+                    if (conditional) occlusionQueries.endConditional();
+                }
+            }
+            transparentShader.use();
+            transparentShader.setBool("weightedBlended", false);
+            weightedBlendedOIT.composite();
+        } else {
+            // Sort translucent objects back to front, by squared distance
+            glm::vec3 camPos = camera.position;
+            std::sort(visibleTransparent.begin(), visibleTransparent.end(),
+                [camPos](Object *a, Object *b) {
+                    glm::vec3 toA = camPos - a->position;
+                    glm::vec3 toB = camPos - b->position;
+                    return glm::dot(toA, toA) > glm::dot(toB, toB); // Farthest first
+                });
+
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glDepthMask(GL_FALSE);
+
+            // And within each object when sorting triangles
+            bool sortTriangles = settings.transparency == TransparencyMode::SortedTriangles;
+            if (sortTriangles) triangleSorter.sort(visibleTransparent, camera.position);
+            for (Object *object : visibleTransparent) {
+                bool conditional = occlusionQuerying && occlusionQueries.beginConditional(*object);
+                if (sortTriangles) triangleSorter.draw(*object, view, projection);
+                else object->draw(view, projection, ObjectPart::Transparent);
+                if (conditional) occlusionQueries.endConditional();
+            }
+
+            glDepthMask(GL_TRUE);
+            glDisable(GL_BLEND);
         }
 
-        glDepthMask(GL_TRUE);
-        glDisable(GL_BLEND);
+        if (deferredRenderer) deferredRenderer->present();
+
+        // Report frame rate and culling results in the title
+        reportFrames++;
+        if (currentTime - lastReportTime >= 0.5) {
+            const FrustumCuller::Stats &stats = frustumCuller.stats;
+            std::string title = std::string(WINDOW_TITLE) +
+                " | " + std::to_string((int)(reportFrames / (currentTime - lastReportTime))) + " fps" +
+                " | visible " + std::to_string(stats.visible / reportFrames) +
+                " culled " + std::to_string(stats.culled / reportFrames);
+            if (usePvs)
+                title += " pvs cell " + std::to_string(pvs.currentCell()) + " sees " +
+                    std::to_string(pvs.visibleObjects().size()) + "/" + std::to_string(sceneObjects.size());
+            if (softwareOcclusion) {
+                const OcclusionCuller::Stats &occlusion = occlusionCuller.stats;
+                char occlusionInfo[128];
+                snprintf(occlusionInfo, sizeof(occlusionInfo), " occluded %zu (%zu occluders, %zu tris, %.2f ms)",
+                    occlusion.occluded / reportFrames, occlusion.occluders / reportFrames,
+                    occlusion.triangles / reportFrames, occlusion.milliseconds / reportFrames);
+                title += occlusionInfo;
+            } else if (occlusionQuerying) {
+                const OcclusionQueries::Stats &queries = occlusionQueries.stats;
+                char queryInfo[160];
+                snprintf(queryInfo, sizeof(queryInfo), " hidden %zu (%zu nodes, %zu box + %zu draw queries, %zu pending)",
+                    queries.hidden / reportFrames, queries.visited / reportFrames, queries.boxQueries / reportFrames,
+                    queries.geometryQueries / reportFrames, queries.pending / reportFrames);
+                title += queryInfo;
+            }
+            if (shadowFacesTotal > 0)
+                title += " | shadow faces " + std::to_string(shadowFaces / reportFrames) +
+                    "/" + std::to_string(shadowFacesTotal / reportFrames);
+            if (!settings.gpuCulling) {
+                title += " | shadow updates " + std::to_string(shadowUpdates / reportFrames) +
+                    "/" + std::to_string(shadowDirty / reportFrames);
+                title += " | shadow draws " + std::to_string(shadowDrawCalls / reportFrames);
+                shadowScheduler.measure(shadowTimer.averageMilliseconds(), (double)shadowUpdates / reportFrames);
+            }
+            title += " | shadow maps " + std::to_string(shadowPool.allocatedBytes() >> 20) + " MB for " +
+                std::to_string(shadowPool.shadowedLights()) + "/" + std::to_string(sceneLights.size()) + " lights";
+            if (deferredRenderer)
+                title += " | deferred " + std::to_string(deferredRenderer->volumeLights) + " volumes " +
+                    std::to_string(deferredRenderer->fullscreenLights) + " full-screen";
+            char prepass[64];
+            snprintf(prepass, sizeof(prepass), " | prepass %s%s overdraw %.2f", prepassModeName(settings.depthPrepass),
+                depthPrepass.active() ? " (on)" : "", depthPrepass.overdraw());
+            title += prepass;
+            title += std::string(" | transparency ") + transparencyName(settings.transparency);
+            if (settings.transparency == TransparencyMode::SortedTriangles) {
+                const TriangleSorter::Stats &sortStats = triangleSorter.stats;
+                char sortInfo[128];
+                snprintf(sortInfo, sizeof(sortInfo), " %.2f ms, %zu tris: %zu radix %zu patched %zu kept",
+                    sortStats.milliseconds / reportFrames, sortStats.triangles / reportFrames,
+                    sortStats.radixSorted / reportFrames, sortStats.insertionSorted / reportFrames,
+                    sortStats.kept / reportFrames);
+                title += sortInfo;
+            }
+            if (useShadowMask)
+                title += " | shadow mask " + std::to_string(shadowMask.maskedLights()) + " lights";
+            if (settings.lightCulling == LightCulling::Clustered)
+                title += " | clusters " + std::to_string(lightGrid.occupiedClusters()) +
+                    " lit, " + std::to_string(lightGrid.lightReferences()) + " light refs";
+            else if (settings.lightCulling == LightCulling::PerObject)
+                title += " | object lights " + std::to_string(objectLightLists.lightReferences()) +
+                    " refs, " + std::to_string(objectLightLists.droppedLights()) + " over the cap";
+
+            bool batched = !settings.gpuCulling && settings.shadowBatching && shadowBatch.supported();
+            char shadowTime[64];
+            snprintf(shadowTime, sizeof(shadowTime), " | shadow %s %s %.2f ms",
+                batched ? "batched" : shadowPipelineName(shadowShaders.resolved()),
+                shadowFilterName(settings.shadowFilter), shadowTimer.averageMilliseconds());
+            title += shadowTime;
+            shadowTimer.reset();
+            glfwSetWindowTitle(window, title.c_str());
+
+            frustumCuller.resetStats();
+            occlusionCuller.resetStats();
+            occlusionQueries.resetStats();
+            triangleSorter.resetStats();
+            shadowFaces = shadowFacesTotal = shadowDrawCalls = 0;
+            shadowUpdates = shadowDirty = 0;
+            reportFrames = 0;
+            lastReportTime = currentTime;
+        }
 
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -205,6 +711,17 @@ int main() {
     return 0;
 }
 
+// True if the context supports the named GL extension
+bool hasExtension(const char *name) {
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i = 0; i < count; ++i) {
+        const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && std::strcmp(extension, name) == 0) return true;
+    }
+    return false;
+}
+
 // Callback for whenever the window size changed (by OS or user resize)
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     auto* data = static_cast<CallbackData*>(glfwGetWindowUserPointer(window));
@@ -221,6 +738,79 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     window_height = height;
 }
 
+// Callback for key presses, used for render toggles
+void key_callback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/) {
+    if (action != GLFW_PRESS) return;
+
+    auto* data = static_cast<CallbackData*>(glfwGetWindowUserPointer(window));
+    RenderSettings* settings = data->settings;
+
+    switch (key) {
+    case GLFW_KEY_G:
+        settings->gpuCulling = !settings->gpuCulling;
+        std::cout << "GPU culling: " << (settings->gpuCulling ? "on" : "off") << std::endl;
+        break;
+    case GLFW_KEY_V:
+        // Start from the camera's view cell set, or the whole tree
+        settings->pvs = !settings->pvs;
+        std::cout << "PVS: " << (settings->pvs ? "on" : "off") << std::endl;
+        break;
+    case GLFW_KEY_O:
+        // Cycle the occlusion culling: off, CPU depth buffer, GPU queries
+        settings->occlusionCulling = (OcclusionCulling)(((int)settings->occlusionCulling + 1) % 3);
+        std::cout << "Occlusion culling: " << occlusionCullingName(settings->occlusionCulling) << std::endl;
+        break;
+    case GLFW_KEY_P:
+        // Cycle the shadow pipeline, to compare them in the title's timing
+        settings->shadowPipeline = (ShadowPipeline)(((int)settings->shadowPipeline + 1) % 3);
+        std::cout << "Shadow pipeline: " << shadowPipelineName(settings->shadowPipeline) << std::endl;
+        break;
+    case GLFW_KEY_B:
+        // Batch all lights' shadow draws, or draw them light by light with the pipeline
+        settings->shadowBatching = !settings->shadowBatching;
+        std::cout << "Shadow batching: " << (settings->shadowBatching ? "on" : "off") << std::endl;
+        break;
+    case GLFW_KEY_U:
+        // Spread dirty shadow faces over frames within the scheduler's budget
+        settings->shadowAmortize = !settings->shadowAmortize;
+        std::cout << "Shadow update budget: " << (settings->shadowAmortize ? "on" : "off") << std::endl;
+        break;
+    case GLFW_KEY_K:
+        settings->shadowCache = !settings->shadowCache;
+        std::cout << "Shadow cache: " << (settings->shadowCache ? "on" : "off") << std::endl;
+        break;
+    case GLFW_KEY_F:
+        // Cycle the shadow filter
+        settings->shadowFilter = (ShadowFilter)(((int)settings->shadowFilter + 1) % 3);
+        std::cout << "Shadow filter: " << shadowFilterName(settings->shadowFilter) << std::endl;
+        break;
+    case GLFW_KEY_L:
+        // Cycle the forward light culling: every light, clusters, per object lists
+        settings->lightCulling = (LightCulling)(((int)settings->lightCulling + 1) % 3);
+        std::cout << "Light culling: " << lightCullingName(settings->lightCulling) << std::endl;
+        break;
+    case GLFW_KEY_Z:
+        // Cycle the depth pre-pass: off, on, on while overdraw pays for it
+        settings->depthPrepass = (PrepassMode)(((int)settings->depthPrepass + 1) % 3);
+        std::cout << "Depth pre-pass: " << prepassModeName(settings->depthPrepass) << std::endl;
+        break;
+    case GLFW_KEY_M:
+        // Resolve the top lights' shadows once per pixel after a forced pre-pass
+        settings->shadowMask = !settings->shadowMask;
+        std::cout << "Shadow mask: " << (settings->shadowMask ? "on" : "off") << std::endl;
+        break;
+    case GLFW_KEY_T:
+        // Cycle the transparency: sorted objects, sorted triangles, order-independent
+        settings->transparency = (TransparencyMode)(((int)settings->transparency + 1) % 3);
+        std::cout << "Transparency: " << transparencyName(settings->transparency) << std::endl;
+        break;
+    case GLFW_KEY_C:
+        settings->shadowFrustumCulling = !settings->shadowFrustumCulling;
+        std::cout << "Shadow caster frustum culling: " << (settings->shadowFrustumCulling ? "on" : "off") << std::endl;
+        break;
+    }
+}
+
 // Callback for whenever the mouse is moved
 bool firstMouse = true;
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
@@ -3,7 +3,42 @@
 #include <sstream>
 #include <filesystem>
 
-Scene MAPLoader::loadMAP(const std::string& path, const Shader &shader, const Shader &shadowShader) {
+void Scene::updateSpatialIndex() {
+    movedObjects.clear();
+    for (Object *object : sceneObjects) {
+        if (!object->updateTransform()) continue;
+        objectTree.move(object->spatialProxy, object->worldBounds);
+        movedObjects.push_back(object);
+    }
+}
+
+// Small unlit sphere in the light's color, marks it in the scene
+static void addLightProxy(Scene &scene, Light &light, const Shader &shader) {
+    auto lightObj = std::make_unique<Object>("assets/LightSphere.obj", &shader);
+    lightObj->position = light.position;
+    lightObj->scale = glm::vec3(0.05f);
+    lightObj->useLighting = false;
+
+    // Change the color of the light object
+    size_t diffuseOffset = 9;
+    auto& verts = lightObj->vertices;
+    for (size_t i = 0; i < verts.size(); i += OBJECT_STRIDE) {
+        verts[i + diffuseOffset + 0] = light.color.r;
+        verts[i + diffuseOffset + 1] = light.color.g;
+        verts[i + diffuseOffset + 2] = light.color.b;
+    }
+    // Re-upload the vertex data
+    glBindBuffer(GL_ARRAY_BUFFER, lightObj->VBO);
+    glBufferSubData(GL_ARRAY_BUFFER, 0,
+        lightObj->vertices.size() * sizeof(float),
+        lightObj->vertices.data());
+
+    light.proxy = lightObj.get();
+    scene.sceneObjects.push_back(lightObj.get());
+    scene.objectOwnership.push_back(std::move(lightObj));
+}
+
+Scene MAPLoader::loadMAP(const std::string& path, const Shader &shader, const ShadowShaders &shadowShaders) {
     std::ifstream in(path);
     if (!in.is_open()) {
         std::cerr << "Failed to open MAP file: " << path << "\n";
@@ -34,11 +69,26 @@ Scene MAPLoader::loadMAP(const std::string& path, const Shader &shader, const Sh
             char comma;
             ss >> px >> py >> pz >> comma >> rx >> ry >> rz >> comma >> sx >> sy >> sz >> comma >> useLighting;
 
+            // Optional STATIC column, objects are static unless it's 0
+            int isStatic = 1;
+            if (!(ss >> comma >> isStatic)) isStatic = 1;
+            // Optional OCCLUDER column after it: AUTO, ON or OFF
+            OccluderMode occluder = OccluderMode::Auto;
+            std::string occluderMode;
+            if (ss >> comma >> occluderMode) {
+                if (occluderMode == "ON") occluder = OccluderMode::On;
+                else if (occluderMode == "OFF") occluder = OccluderMode::Off;
+                else if (occluderMode != "AUTO")
+                    std::cerr << "Unknown occluder mode " << occluderMode << " in " << path << ", using AUTO\n";
+            }
+
             auto obj = std::make_unique<Object>(objPath, &shader);
             obj->position = glm::vec3(px, py, pz);
             obj->rotation = glm::vec3(rx, ry, rz);
             obj->scale = glm::vec3(sx, sy, sz);
             obj->useLighting = useLighting != 0;
+            obj->isStatic = isStatic != 0;
+            obj->occluder = occluder;
 
             Object* objPtr = obj.get();
             scene.sceneObjects.push_back(objPtr);
@@ -50,35 +100,52 @@ Scene MAPLoader::loadMAP(const std::string& path, const Shader &shader, const Sh
             ss >> px >> py >> pz >> comma >> r >> g >> b >> comma >> intensity;
 
             auto light = std::make_unique<Light>(
-                glm::vec3(px, py, pz), glm::vec3(r, g, b), intensity, &shadowShader);
+                glm::vec3(px, py, pz), glm::vec3(r, g, b), intensity, &shadowShaders);
+
+            // Optional SHADOW column: AUTO, CUBE or PARABOLOID
+            std::string shadowMode;
+            if (ss >> comma >> shadowMode) {
+                if (shadowMode == "CUBE") light->shadowMode = ShadowMode::Cube;
+                else if (shadowMode == "PARABOLOID") light->shadowMode = ShadowMode::DualParaboloid;
+                else if (shadowMode != "AUTO")
+                    std::cerr << "Unknown shadow mode " << shadowMode << " in " << path << ", using AUTO\n";
+            }
 
-            Light* lightPtr = light.get();
+            addLightProxy(scene, *light, shader);
+            scene.sceneLights.push_back(light.get());
+            scene.lightOwnership.push_back(std::move(light));
+        }
+        else if (type == "LIGHT_SPOT") {
+            float px, py, pz, dx, dy, dz, r, g, b, intensity, innerCone, outerCone;
+            char comma;
+            ss >> px >> py >> pz >> comma >> dx >> dy >> dz >> comma >> r >> g >> b >> comma >> intensity
+               >> comma >> innerCone >> outerCone;
+
+            auto light = std::make_unique<Light>(
+                glm::vec3(px, py, pz), glm::vec3(r, g, b), intensity, &shadowShaders);
+            light->type = LightType::Spot;
+            light->direction = glm::normalize(glm::vec3(dx, dy, dz));
+            // The shadow map's field of view is twice the outer cone, keep it under 180
+            light->outerCone = glm::clamp(outerCone, 1.0f, 89.0f);
+            light->innerCone = glm::clamp(innerCone, 0.0f, light->outerCone);
+
+            addLightProxy(scene, *light, shader);
+            scene.sceneLights.push_back(light.get());
+            scene.lightOwnership.push_back(std::move(light));
+        }
+        else if (type == "LIGHT_DIRECTIONAL") {
+            float dx, dy, dz, r, g, b, intensity;
+            char comma;
+            ss >> dx >> dy >> dz >> comma >> r >> g >> b >> comma >> intensity;
+
+            // No position and no marker, the light is infinitely far away
+            auto light = std::make_unique<Light>(
+                glm::vec3(0.0f), glm::vec3(r, g, b), intensity, &shadowShaders);
+            light->type = LightType::Directional;
+            light->direction = glm::normalize(glm::vec3(dx, dy, dz));
+
+            scene.sceneLights.push_back(light.get());
             scene.lightOwnership.push_back(std::move(light));
-            scene.sceneLights.push_back(lightPtr);
-
-            // Light Object
-            auto lightObj = std::make_unique<Object>("assets/LightSphere.obj", &shader);
-            lightObj->position = glm::vec3(px, py, pz);
-            lightObj->scale = glm::vec3(0.05f);
-            lightObj->useLighting = false;
-
-            // Change the color of the light object
-            size_t diffuseOffset = 9;
-            auto& verts = lightObj->vertices;
-            for (size_t i = 0; i < verts.size(); i += OBJECT_STRIDE) {
-                verts[i + diffuseOffset + 0] = r;
-                verts[i + diffuseOffset + 1] = g;
-                verts[i + diffuseOffset + 2] = b;
-            }
-            // Re-upload the vertex data
-            glBindBuffer(GL_ARRAY_BUFFER, lightObj->VBO);
-            glBufferSubData(GL_ARRAY_BUFFER, 0,
-                lightObj->vertices.size() * sizeof(float),
-                lightObj->vertices.data());
-
-            Object* lightObjPtr = lightObj.get();
-            scene.sceneObjects.push_back(lightObjPtr);
-            scene.objectOwnership.push_back(std::move(lightObj));
         }
         else {
             std::cerr << "Unknown type in MAP file: " << type << "\n";
@@ -86,12 +153,19 @@ Scene MAPLoader::loadMAP(const std::string& path, const Shader &shader, const Sh
         }
     }
 
-    // Separate opaque and transparent objects
+    // Separate opaque and transparent objects, one with both kinds of faces is in both
     for (auto& obj : scene.sceneObjects) {
+        if (obj->hasOpaque()) scene.opaqueObjects.push_back(obj);
         if (obj->hasTransparency) scene.transparentObjects.push_back(obj);
-        else scene.opaqueObjects.push_back(obj);
     }
 
+    // Build the spatial index. The map is static, so do a full SAH build.
+    for (auto& obj : scene.sceneObjects) {
+        obj->updateTransform();
+        obj->spatialProxy = scene.objectTree.insert(obj, obj->worldBounds);
+    }
+    scene.objectTree.rebuild();
+
     std::cout << "Loaded map: " << path << std::endl;
     return scene;
 }
\ No newline at end of file
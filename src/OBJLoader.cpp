@@ -6,6 +6,7 @@
 #include <iostream>
 #include <filesystem>
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 struct FaceVertex {
@@ -220,3 +221,26 @@ std::vector<Face> OBJLoader::loadOBJ(const std::string& path) {
 
     return faces;
 }
+
+void OBJLoader::computeBounds(const std::vector<Face> &faces, AABB &box, Sphere &sphere) {
+    box = AABB();
+    for (const auto &face : faces)
+        for (const auto &v : face.vertices)
+            box.expand(v.point);
+
+    if (!box.valid()) {
+        sphere = Sphere();
+        return;
+    }
+
+    // Centered on the box, but only as large as the furthest vertex
+    float radiusSq = 0.0f;
+    for (const auto &face : faces)
+        for (const auto &v : face.vertices) {
+            glm::vec3 d = v.point - box.center();
+            radiusSq = std::max(radiusSq, glm::dot(d, d));
+        }
+
+    sphere.center = box.center();
+    sphere.radius = std::sqrt(radiusSq);
+}
@@ -6,6 +6,15 @@ Object::Object(const std::string &path, const Shader *shader)
 : shader(shader) {
     textures.reserve(MAX_TEXTURES);
     std::vector<Face> faces = OBJLoader::loadOBJ(path);
+    OBJLoader::computeBounds(faces, localBounds, localSphere);
+
+    // Opaque faces first, so they draw in the opaque pass as one range and
+    // only the translucent ones pay for blending
+    auto translucent = std::stable_partition(faces.begin(), faces.end(),
+        [](const Face &face) { return face.material.opacity >= 1.0f; });
+    hasTransparency = translucent != faces.end();
+    for (auto it = faces.begin(); it != translucent; ++it)
+        opaqueVertexCount += it->vertices.size();
 
     // Combine faces
     for (auto& face : faces) {
@@ -20,10 +29,6 @@ Object::Object(const std::string &path, const Shader *shader)
             }
         }
 
-        if (face.material.opacity < 1.0f) {
-            hasTransparency = true;
-        }
-
         for (auto& v : face.vertices) {
             vertices.push_back(v.point.x);
             vertices.push_back(v.point.y);
@@ -88,11 +93,15 @@ Object::~Object() {
 
 Object::Object(Object&& other) noexcept
     : shader(other.shader), VAO(other.VAO), VBO(other.VBO),
-      hasTransparency(other.hasTransparency),
+      hasTransparency(other.hasTransparency), opaqueVertexCount(other.opaqueVertexCount),
       vertices(std::move(other.vertices)),
       textures(std::move(other.textures)),
+      localBounds(other.localBounds), localSphere(other.localSphere),
+      worldBounds(other.worldBounds), worldSphere(other.worldSphere),
+      transformVersion(other.transformVersion), spatialProxy(other.spatialProxy),
       position(other.position), rotation(other.rotation),
-      scale(other.scale), useLighting(other.useLighting) {
+      scale(other.scale), useLighting(other.useLighting), isStatic(other.isStatic),
+      occluder(other.occluder), sceneIndex(other.sceneIndex) {
     other.VAO = 0;
     other.VBO = 0;
 }
@@ -109,12 +118,23 @@ Object& Object::operator=(Object&& other) noexcept {
         VAO = other.VAO;
         VBO = other.VBO;
         hasTransparency = other.hasTransparency;
+        opaqueVertexCount = other.opaqueVertexCount;
         vertices = std::move(other.vertices);
         textures = std::move(other.textures);
+        localBounds = other.localBounds;
+        localSphere = other.localSphere;
+        worldBounds = other.worldBounds;
+        worldSphere = other.worldSphere;
+        transformVersion = other.transformVersion;
+        spatialProxy = other.spatialProxy;
+        transformValid = false;
         position = other.position;
         rotation = other.rotation;
         scale = other.scale;
         useLighting = other.useLighting;
+        isStatic = other.isStatic;
+        occluder = other.occluder;
+        sceneIndex = other.sceneIndex;
 
         other.VAO = 0;
         other.VBO = 0;
@@ -135,55 +155,76 @@ glm::mat4 Object::GetModelMatrix() const noexcept {
     return model;
 }
 
-void Object::draw(const glm::mat4 view, const glm::mat4 projection, std::vector<Light*> &lights) const {
+bool Object::updateTransform() noexcept {
+    if (transformValid && position == boundsPosition && rotation == boundsRotation && scale == boundsScale)
+        return false;
+
+    glm::mat4 model = GetModelMatrix();
+    worldBounds = transformAABB(localBounds, model);
+    worldSphere = transformSphere(localSphere, model);
+
+    boundsPosition = position;
+    boundsRotation = rotation;
+    boundsScale = scale;
+    transformValid = true;
+    transformVersion++;
+    return true;
+}
+
+void Object::draw(const glm::mat4 view, const glm::mat4 projection, ObjectPart part) const {
     if (!shader) return;
+    draw(view, projection, *shader, part);
+}
+
+void Object::draw(const glm::mat4 view, const glm::mat4 projection, const Shader &passShader,
+    ObjectPart part) const {
+    size_t first = part == ObjectPart::Transparent ? opaqueVertexCount : 0;
+    size_t count = part == ObjectPart::Opaque ? opaqueVertexCount : vertexCount() - first;
+    if (count == 0) return;
+
+    beginDraw(view, projection, passShader);
+    glDrawArrays(GL_TRIANGLES, first, count);
+    endDraw();
+}
 
+void Object::drawIndexed(const glm::mat4 view, const glm::mat4 projection, unsigned int indexBuffer,
+    size_t indexCount) const {
+    if (!shader || indexCount == 0) return;
+
+    beginDraw(view, projection, *shader);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)0);
+    endDraw();
+}
+
+void Object::beginDraw(const glm::mat4 &view, const glm::mat4 &projection, const Shader &passShader) const {
     glm::mat4 model = GetModelMatrix();
 
-    shader->use();
-    shader->setMat4("projection", projection);
-    shader->setMat4("view", view);
-    shader->setMat4("model", model);
+    passShader.use();
+    passShader.setMat4("projection", projection);
+    passShader.setMat4("view", view);
+    passShader.setMat4("model", model);
 
     // Bind all textures
-    int textureUnit = 0;
-    for (; textureUnit < (int)textures.size(); ++textureUnit) {
+    for (int textureUnit = 0; textureUnit < (int)textures.size(); ++textureUnit) {
         glActiveTexture(GL_TEXTURE0 + textureUnit);
         glBindTexture(GL_TEXTURE_2D, textures[textureUnit]);
     }
-    textureUnit++;
 
     // Map each texture to their corresponding unit
     std::vector<int> texUnits(textures.size());
     for (int i = 0; i < (int)textures.size(); ++i)
         texUnits[i] = i;
-    shader->setIntArray("textures", texUnits);
-
-    // Bind shadow cubemaps
-    for (int i = 0; i < (int)lights.size(); ++i) {
-        glActiveTexture(GL_TEXTURE0 + textureUnit);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, lights[i]->depthCubemap);
-        shader->setInt("depthMaps[" + std::to_string(i) + "]", textureUnit);
-        textureUnit++;
-    }
+    passShader.setIntArray("textures", texUnits);
 
-    // Lighting
-    shader->setBool("useLighting", useLighting);
-    if (useLighting) {
-        shader->setInt("numLights", lights.size());
-        for (int i = 0; i < (int)lights.size(); ++i) {
-            shader->setVec3("lightPositions[" + std::to_string(i) + "]", lights[i]->position);
-            shader->setVec3("lightColors[" + std::to_string(i) + "]", lights[i]->color);
-            shader->setFloat("lightIntensities[" + std::to_string(i) + "]", lights[i]->intensity);
-            shader->setFloat("lightFarPlanes[" + std::to_string(i) + "]", lights[i]->shadowFarPlane);
-        }
-    }
-    shader->setVec3("ambientLightColor", glm::vec3(1.0f));
-    shader->setFloat("ambientLight", 0.1f);
+    // Lighting, the lights themselves are bound once per pass by LightBuffer
+    passShader.setBool("useLighting", useLighting);
+    passShader.setInt("objectIndex", sceneIndex);
 
-    // Bind VAO, draw call, unbind VAB
     glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, vertices.size() / OBJECT_STRIDE);
+}
+
+void Object::endDraw() const {
     glBindVertexArray(0);
 
     // Unbind textures
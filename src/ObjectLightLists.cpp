@@ -0,0 +1,102 @@
+#include "ObjectLightLists.h"
+#include "StorageBuffer.h"
+#include <glad/gl.h>
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+// Brightest the light gets over the box, before the surface's angle and shadows
+float contribution(const Light &light, const AABB &box) {
+    float peak = light.intensity * glm::max(light.color.r, glm::max(light.color.g, light.color.b));
+    if (light.type == LightType::Directional) return peak;
+    float distance = glm::length(glm::clamp(light.position, box.min, box.max) - light.position);
+    return peak / (1.0f + ATTENUATION_LINEAR * distance + ATTENUATION_QUADRATIC * distance * distance);
+}
+
+} // namespace
+
+ObjectLightLists::ObjectLightLists(const GPUScene &scene)
+: scene(scene) {
+    glGenBuffers(1, &rangeBuffer);
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, rangeBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(scene.size(), 1) * sizeof(glm::uvec2),
+        nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+ObjectLightLists::~ObjectLightLists() {
+    if (rangeBuffer != 0) glDeleteBuffers(1, &rangeBuffer);
+    if (indexBuffer != 0) glDeleteBuffers(1, &indexBuffer);
+}
+
+void ObjectLightLists::build(const std::vector<Object*> &objects, const std::vector<Light*> &lights) {
+    // Point and spot ranges in SoA, directional lights apart
+    size_t padded = (lights.size() + 3) & ~size_t(3);
+    lightX.assign(padded, 0.0f);
+    lightY.assign(padded, 0.0f);
+    lightZ.assign(padded, 0.0f);
+    lightRange2.assign(padded, -1.0f);
+    unbounded.clear();
+    for (size_t i = 0; i < lights.size(); ++i) {
+        float range = lights[i]->lightRange();
+        if (range < 0.0f) {
+            unbounded.push_back(i);
+        } else if (range > 0.0f) {
+            lightX[i] = lights[i]->position.x;
+            lightY[i] = lights[i]->position.y;
+            lightZ[i] = lights[i]->position.z;
+            lightRange2[i] = range * range;
+        }
+    }
+    SphereLanes spheres{ lightX.data(), lightY.data(), lightZ.data(), lightRange2.data() };
+
+    ranges.assign(scene.size(), glm::uvec2(0));
+    indices.clear();
+    dropped = 0;
+
+    std::vector<std::pair<float, unsigned int>> candidates;
+    for (const Object *object : objects) {
+        unsigned int index = scene.indexOf(object);
+        if (index == NO_OBJECT || !object->useLighting) continue;
+        const AABB &box = object->worldBounds;
+        BoxSplat boxes(box);
+
+        candidates.clear();
+        for (size_t first = 0; first < padded; first += 4) {
+            unsigned int mask = spheresReachBoxes(spheres, first, boxes.lanes(), 0);
+            while (mask != 0) {
+                unsigned int light = first + std::countr_zero(mask);
+                mask &= mask - 1;
+                candidates.push_back({ contribution(*lights[light], box), light });
+            }
+        }
+        for (unsigned int light : unbounded)
+            candidates.push_back({ contribution(*lights[light], box), light });
+
+        // Strongest K, then back in light order so the shading sums in the usual order
+        if (candidates.size() > maxLightsPerObject) {
+            std::nth_element(candidates.begin(), candidates.begin() + maxLightsPerObject, candidates.end(),
+                [](const auto &a, const auto &b) { return a.first > b.first; });
+            dropped += candidates.size() - maxLightsPerObject;
+            candidates.resize(maxLightsPerObject);
+        }
+        std::sort(candidates.begin(), candidates.end(),
+            [](const auto &a, const auto &b) { return a.second < b.second; });
+
+        ranges[index] = glm::uvec2(indices.size(), candidates.size());
+        for (const auto &candidate : candidates) indices.push_back(candidate.second);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, rangeBuffer);
+    if (!ranges.empty())
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, ranges.size() * sizeof(glm::uvec2), ranges.data());
+
+    uploadStorageBuffer(indexBuffer, indexCapacity, indices);
+}
+
+void ObjectLightLists::bind() const {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_LIGHT_RANGE_BINDING, rangeBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_LIGHT_INDEX_BINDING, indexBuffer);
+}
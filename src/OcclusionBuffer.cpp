@@ -0,0 +1,236 @@
+#include "OcclusionBuffer.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#define OCCLUSION_BUFFER_SSE
+#endif
+
+OcclusionBuffer::OcclusionBuffer(WorkerPool &workers, int width, int height)
+: workers(workers) {
+    // Whole tiles, which also keeps rows a multiple of 4 pixels for SSE
+    tilesX = std::max((width + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE, 1);
+    tilesY = std::max((height + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE, 1);
+    bufferWidth = tilesX * OCCLUSION_TILE_SIZE;
+    bufferHeight = tilesY * OCCLUSION_TILE_SIZE;
+    pixels.assign((size_t)bufferWidth * bufferHeight, 0.0f);
+    tiles.assign((size_t)tilesX * tilesY, 0.0f);
+    workerTriangles.resize(workers.workerCount());
+}
+
+void OcclusionBuffer::begin(const glm::mat4 &viewProjection) {
+    this->viewProjection = viewProjection;
+    occluders.clear();
+    occluderFirst.assign(1, 0);
+}
+
+void OcclusionBuffer::addOccluder(const std::vector<glm::vec3> &triangles, const glm::mat4 &model) {
+    if (triangles.size() < 3) return;
+    occluders.push_back({ &triangles, viewProjection * model });
+    occluderFirst.push_back(occluderFirst.back() + triangles.size() / 3);
+}
+
+void OcclusionBuffer::addScreenTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c,
+    std::vector<Triangle> &out) const {
+    // Pixel coordinates from the bottom left, pixel centers at + 0.5
+    glm::vec3 p[3];
+    const glm::vec4 *clip[3] = { &a, &b, &c };
+    for (int i = 0; i < 3; ++i) {
+        float invW = 1.0f / clip[i]->w;
+        p[i] = glm::vec3((clip[i]->x * invW * 0.5f + 0.5f) * bufferWidth,
+                         (clip[i]->y * invW * 0.5f + 0.5f) * bufferHeight, invW);
+    }
+
+    // Counter-clockwise is front facing, as in GL
+    float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+    if (!(area > 0.0f)) return;
+
+    float minX = std::min({ p[0].x, p[1].x, p[2].x }), maxX = std::max({ p[0].x, p[1].x, p[2].x });
+    float minY = std::min({ p[0].y, p[1].y, p[2].y }), maxY = std::max({ p[0].y, p[1].y, p[2].y });
+    // Pixels whose centers the bounds reach, clamped before the int conversion
+    Triangle t;
+    t.minX = (int)std::ceil(std::clamp(minX - 0.5f, -1.0f, (float)bufferWidth));
+    t.maxX = (int)std::floor(std::clamp(maxX - 0.5f, -1.0f, (float)bufferWidth));
+    t.minY = (int)std::ceil(std::clamp(minY - 0.5f, -1.0f, (float)bufferHeight));
+    t.maxY = (int)std::floor(std::clamp(maxY - 0.5f, -1.0f, (float)bufferHeight));
+    t.minX = std::max(t.minX, 0); t.maxX = std::min(t.maxX, bufferWidth - 1);
+    t.minY = std::max(t.minY, 0); t.maxY = std::min(t.maxY, bufferHeight - 1);
+    if (t.minX > t.maxX || t.minY > t.maxY) return;
+
+    // Edge i runs from vertex i to the next, the inside is on its left
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec3 &from = p[i], &to = p[(i + 1) % 3];
+        t.edgeA[i] = from.y - to.y;
+        t.edgeB[i] = to.x - from.x;
+        t.edgeC[i] = -(t.edgeA[i] * from.x + t.edgeB[i] * from.y);
+    }
+    // Each vertex's barycentric is the opposite edge's function over the area
+    float invArea = 1.0f / area;
+    float w0 = p[0].z * invArea, w1 = p[1].z * invArea, w2 = p[2].z * invArea;
+    t.depthA = t.edgeA[1] * w0 + t.edgeA[2] * w1 + t.edgeA[0] * w2;
+    t.depthB = t.edgeB[1] * w0 + t.edgeB[2] * w1 + t.edgeB[0] * w2;
+    t.depthC = t.edgeC[1] * w0 + t.edgeC[2] * w1 + t.edgeC[0] * w2;
+    out.push_back(t);
+}
+
+void OcclusionBuffer::setupTriangle(const glm::vec4 clip[3], std::vector<Triangle> &out) const {
+    // Near plane z = -w, the rest is clamped to the buffer while rasterizing
+    float distance[3];
+    int inside = 0;
+    for (int i = 0; i < 3; ++i) {
+        distance[i] = clip[i].z + clip[i].w;
+        inside += distance[i] >= 0.0f;
+    }
+    if (inside == 0) return;
+    if (inside == 3) {
+        addScreenTriangle(clip[0], clip[1], clip[2], out);
+        return;
+    }
+
+    glm::vec4 polygon[4];
+    int count = 0;
+    for (int i = 0; i < 3; ++i) {
+        int j = (i + 1) % 3;
+        if (distance[i] >= 0.0f) polygon[count++] = clip[i];
+        if ((distance[i] >= 0.0f) != (distance[j] >= 0.0f)) {
+            float t = distance[i] / (distance[i] - distance[j]);
+            polygon[count++] = clip[i] + (clip[j] - clip[i]) * t;
+        }
+    }
+    for (int i = 2; i < count; ++i)
+        addScreenTriangle(polygon[0], polygon[i - 1], polygon[i], out);
+}
+
+void OcclusionBuffer::rasterizeRows(int beginRow, int endRow) {
+    for (int y = beginRow; y < endRow; ++y)
+        std::fill(pixels.begin() + (size_t)y * bufferWidth, pixels.begin() + (size_t)(y + 1) * bufferWidth, 0.0f);
+
+    for (const Triangle &t : triangles) {
+        int firstRow = std::max(t.minY, beginRow), lastRow = std::min(t.maxY, endRow - 1);
+        int firstColumn = t.minX & ~3;
+
+        for (int y = firstRow; y <= lastRow; ++y) {
+            float py = (float)y + 0.5f;
+            float row0 = t.edgeB[0] * py + t.edgeC[0];
+            float row1 = t.edgeB[1] * py + t.edgeC[1];
+            float row2 = t.edgeB[2] * py + t.edgeC[2];
+            float rowDepth = t.depthB * py + t.depthC;
+            float *line = pixels.data() + (size_t)y * bufferWidth;
+
+#ifdef OCCLUSION_BUFFER_SSE
+            const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            const __m128 zero = _mm_setzero_ps();
+            __m128 a0 = _mm_set1_ps(t.edgeA[0]), a1 = _mm_set1_ps(t.edgeA[1]), a2 = _mm_set1_ps(t.edgeA[2]);
+            __m128 r0 = _mm_set1_ps(row0), r1 = _mm_set1_ps(row1), r2 = _mm_set1_ps(row2);
+            __m128 depthA = _mm_set1_ps(t.depthA), depthRow = _mm_set1_ps(rowDepth);
+
+            for (int x = firstColumn; x <= t.maxX; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                __m128 inside = _mm_and_ps(
+                    _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0), zero),
+                               _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), r1), zero)),
+                    _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), r2), zero));
+                if (_mm_movemask_ps(inside) == 0) continue;
+
+                __m128 depth = _mm_add_ps(_mm_mul_ps(depthA, px), depthRow);
+                __m128 old = _mm_loadu_ps(line + x);
+                __m128 nearest = _mm_max_ps(old, depth);
+                _mm_storeu_ps(line + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+            }
+#else
+            for (int x = firstColumn; x <= t.maxX; ++x) {
+                float px = (float)x + 0.5f;
+                if (t.edgeA[0] * px + row0 < 0.0f || t.edgeA[1] * px + row1 < 0.0f ||
+                    t.edgeA[2] * px + row2 < 0.0f) continue;
+                line[x] = std::max(line[x], t.depthA * px + rowDepth);
+            }
+#endif
+        }
+    }
+
+    // Farthest of each tile's pixels
+    for (int ty = beginRow / OCCLUSION_TILE_SIZE; ty < endRow / OCCLUSION_TILE_SIZE; ++ty) {
+        for (int tx = 0; tx < tilesX; ++tx) {
+            float farthest = pixels[(size_t)ty * OCCLUSION_TILE_SIZE * bufferWidth + tx * OCCLUSION_TILE_SIZE];
+            for (int y = 0; y < OCCLUSION_TILE_SIZE; ++y) {
+                const float *line = pixels.data() + (size_t)(ty * OCCLUSION_TILE_SIZE + y) * bufferWidth +
+                    tx * OCCLUSION_TILE_SIZE;
+                for (int x = 0; x < OCCLUSION_TILE_SIZE; ++x) farthest = std::min(farthest, line[x]);
+            }
+            tiles[(size_t)ty * tilesX + tx] = farthest;
+        }
+    }
+}
+
+void OcclusionBuffer::rasterize() {
+    // Transform and set up every occluder triangle, each worker a contiguous range
+    size_t total = occluderFirst.back();
+    for (std::vector<Triangle> &list : workerTriangles) list.clear();
+    workers.parallelFor(total, OCCLUSION_TRIANGLES_PER_WORKER, [&](size_t begin, size_t end, unsigned int worker) {
+        std::vector<Triangle> &out = workerTriangles[worker];
+        size_t occluder = std::upper_bound(occluderFirst.begin(), occluderFirst.end(), begin) - occluderFirst.begin() - 1;
+        for (size_t i = begin; i < end; ++i) {
+            while (i >= occluderFirst[occluder + 1]) ++occluder;
+            const Occluder &o = occluders[occluder];
+            const glm::vec3 *points = o.triangles->data() + (i - occluderFirst[occluder]) * 3;
+            glm::vec4 clip[3];
+            for (int v = 0; v < 3; ++v) clip[v] = o.modelViewProjection * glm::vec4(points[v], 1.0f);
+            setupTriangle(clip, out);
+        }
+    });
+    // Concatenated in worker order, the same list for any number of workers
+    triangles.clear();
+    for (const std::vector<Triangle> &list : workerTriangles)
+        triangles.insert(triangles.end(), list.begin(), list.end());
+
+    // Bands of tile rows, no two workers write the same pixel
+    workers.parallelFor(tilesY, OCCLUSION_TILE_ROWS_PER_WORKER, [&](size_t begin, size_t end, unsigned int) {
+        rasterizeRows((int)begin * OCCLUSION_TILE_SIZE, (int)end * OCCLUSION_TILE_SIZE);
+    });
+}
+
+bool OcclusionBuffer::isVisible(const AABB &box) const noexcept {
+    if (!box.valid()) return true;
+
+    float minX = bufferWidth, maxX = 0.0f, minY = bufferHeight, maxY = 0.0f;
+    float nearest = 0.0f; // Largest 1/w of the corners
+    for (int i = 0; i < 8; ++i) {
+        glm::vec4 clip = viewProjection * glm::vec4((i & 1) ? box.max.x : box.min.x,
+                                                     (i & 2) ? box.max.y : box.min.y,
+                                                     (i & 4) ? box.max.z : box.min.z, 1.0f);
+        // Reaches past the near plane, the camera may be inside it
+        if (clip.z < -clip.w || clip.w <= 0.0f) return true;
+        float invW = 1.0f / clip.w;
+        float x = (clip.x * invW * 0.5f + 0.5f) * bufferWidth;
+        float y = (clip.y * invW * 0.5f + 0.5f) * bufferHeight;
+        minX = std::min(minX, x); maxX = std::max(maxX, x);
+        minY = std::min(minY, y); maxY = std::max(maxY, y);
+        nearest = std::max(nearest, invW);
+    }
+    // Every pixel the box touches, not only those whose centers it covers
+    int x0 = std::max((int)std::floor(std::max(minX, 0.0f)), 0);
+    int x1 = std::min((int)std::floor(std::min(maxX, (float)bufferWidth - 1.0f)), bufferWidth - 1);
+    int y0 = std::max((int)std::floor(std::max(minY, 0.0f)), 0);
+    int y1 = std::min((int)std::floor(std::min(maxY, (float)bufferHeight - 1.0f)), bufferHeight - 1);
+    // Off the buffer, left to frustum culling
+    if (x0 > x1 || y0 > y1) return true;
+
+    nearest *= 1.0f + OCCLUSION_DEPTH_BIAS;
+    for (int ty = y0 / OCCLUSION_TILE_SIZE; ty <= y1 / OCCLUSION_TILE_SIZE; ++ty) {
+        for (int tx = x0 / OCCLUSION_TILE_SIZE; tx <= x1 / OCCLUSION_TILE_SIZE; ++tx) {
+            // The whole tile is in front of the box
+            if (tiles[(size_t)ty * tilesX + tx] >= nearest) continue;
+
+            int rowEnd = std::min(y1, ty * OCCLUSION_TILE_SIZE + OCCLUSION_TILE_SIZE - 1);
+            int columnEnd = std::min(x1, tx * OCCLUSION_TILE_SIZE + OCCLUSION_TILE_SIZE - 1);
+            for (int y = std::max(y0, ty * OCCLUSION_TILE_SIZE); y <= rowEnd; ++y) {
+                const float *line = pixels.data() + (size_t)y * bufferWidth;
+                for (int x = std::max(x0, tx * OCCLUSION_TILE_SIZE); x <= columnEnd; ++x) {
+                    if (line[x] < nearest) return true;
+                }
+            }
+        }
+    }
+    return false;
+}
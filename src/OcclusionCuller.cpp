@@ -0,0 +1,197 @@
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+OcclusionCuller::OcclusionCuller(WorkerPool &workers, const OcclusionCullerSettings &settings)
+: settings(settings), workers(workers), depthBuffer(workers, settings.width, settings.height) {
+}
+
+// Two triangles facing along outward, whichever way the corners go round
+static void addQuad(std::vector<glm::vec3> &triangles, const glm::vec3 &a, const glm::vec3 &b,
+    const glm::vec3 &c, const glm::vec3 &d, const glm::vec3 &outward) {
+    bool flip = glm::dot(glm::cross(b - a, c - a), outward) < 0.0f;
+    const glm::vec3 *quad[4] = { &a, flip ? &d : &b, &c, flip ? &b : &d };
+    triangles.insert(triangles.end(), { *quad[0], *quad[1], *quad[2], *quad[0], *quad[2], *quad[3] });
+}
+
+void OcclusionCuller::buildInnerBoxes(const Object &object, std::vector<glm::vec3> &triangles) const {
+    const float *vertices = object.vertices.data();
+    size_t vertexCount = object.opaqueVertexCount;
+
+    AABB bounds;
+    for (size_t i = 0; i < vertexCount; ++i)
+        bounds.expand(glm::vec3(vertices[i * OBJECT_STRIDE], vertices[i * OBJECT_STRIDE + 1], vertices[i * OBJECT_STRIDE + 2]));
+    glm::vec3 size = bounds.max - bounds.min;
+    float longest = std::max(size.x, std::max(size.y, size.z));
+    if (!(longest > 0.0f)) return;
+
+    // Cubic cells with a ring of empty ones around the bounds, where the flood fill starts
+    float cell = longest / (float)settings.voxelResolution;
+    glm::ivec3 dims = glm::ivec3(glm::floor(size / cell)) + 1;
+    glm::ivec3 padded = dims + 2;
+    glm::vec3 origin = bounds.min - glm::vec3(cell);
+    auto index = [&](int x, int y, int z) { return ((size_t)z * padded.y + y) * padded.x + x; };
+
+    enum : unsigned char { Unknown, Surface, Outside };
+    std::vector<unsigned char> cells((size_t)padded.x * padded.y * padded.z, Unknown);
+
+    // Cells the triangle's plane crosses within its bounds, a superset of those it touches
+    for (size_t i = 0; i + 2 < vertexCount; i += 3) {
+        glm::vec3 p[3];
+        for (int v = 0; v < 3; ++v) {
+            const float *point = vertices + (i + v) * OBJECT_STRIDE;
+            p[v] = glm::vec3(point[0], point[1], point[2]);
+        }
+        glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        float reach = 0.5f * cell * (std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z)) * 1.01f;
+
+        glm::ivec3 low = glm::ivec3(glm::floor((glm::min(p[0], glm::min(p[1], p[2])) - origin) / cell));
+        glm::ivec3 high = glm::ivec3(glm::floor((glm::max(p[0], glm::max(p[1], p[2])) - origin) / cell));
+        low = glm::clamp(low, glm::ivec3(1), dims);
+        high = glm::clamp(high, glm::ivec3(1), dims);
+        for (int z = low.z; z <= high.z; ++z)
+            for (int y = low.y; y <= high.y; ++y)
+                for (int x = low.x; x <= high.x; ++x) {
+                    glm::vec3 center = origin + (glm::vec3(x, y, z) + 0.5f) * cell;
+                    if (std::fabs(glm::dot(normal, center - p[0])) <= reach)
+                        cells[index(x, y, z)] = Surface;
+                }
+    }
+
+    // Whatever the outside can't reach is enclosed. An open mesh leaks and keeps no boxes.
+    std::vector<glm::ivec3> stack = { glm::ivec3(0) };
+    cells[index(0, 0, 0)] = Outside;
+    while (!stack.empty()) {
+        glm::ivec3 c = stack.back();
+        stack.pop_back();
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int step = -1; step <= 1; step += 2) {
+                glm::ivec3 n = c;
+                n[axis] += step;
+                if (n[axis] < 0 || n[axis] >= padded[axis]) continue;
+                unsigned char &state = cells[index(n.x, n.y, n.z)];
+                if (state != Unknown) continue;
+                state = Outside;
+                stack.push_back(n);
+            }
+        }
+    }
+
+    // Greedy merge of the enclosed cells, along x, then y, then z
+    std::vector<AABB> boxes;
+    std::vector<bool> claimed(cells.size(), false);
+    auto unclaimed = [&](int x, int y, int z) { size_t i = index(x, y, z); return cells[i] == Unknown && !claimed[i]; };
+    for (int z = 1; z <= dims.z; ++z)
+        for (int y = 1; y <= dims.y; ++y)
+            for (int x = 1; x <= dims.x; ++x) {
+                if (!unclaimed(x, y, z)) continue;
+                int x1 = x, y1 = y, z1 = z;
+                while (x1 < dims.x && unclaimed(x1 + 1, y, z)) ++x1;
+                auto rowFree = [&](int row, int slice) {
+                    for (int i = x; i <= x1; ++i) if (!unclaimed(i, row, slice)) return false;
+                    return true;
+                };
+                while (y1 < dims.y && rowFree(y1 + 1, z)) ++y1;
+                for (;;) {
+                    if (z1 >= dims.z) break;
+                    bool slabFree = true;
+                    for (int j = y; j <= y1 && slabFree; ++j) slabFree = rowFree(j, z1 + 1);
+                    if (!slabFree) break;
+                    ++z1;
+                }
+                for (int k = z; k <= z1; ++k)
+                    for (int j = y; j <= y1; ++j)
+                        for (int i = x; i <= x1; ++i) claimed[index(i, j, k)] = true;
+                boxes.push_back({ origin + glm::vec3(x, y, z) * cell, origin + glm::vec3(x1 + 1, y1 + 1, z1 + 1) * cell });
+            }
+
+    // The biggest hide the most
+    std::stable_sort(boxes.begin(), boxes.end(), [](const AABB &a, const AABB &b) {
+        glm::vec3 sa = a.max - a.min, sb = b.max - b.min;
+        return sa.x * sa.y * sa.z > sb.x * sb.y * sb.z;
+    });
+    if (boxes.size() > settings.maxBoxes) boxes.resize(settings.maxBoxes);
+
+    for (const AABB &box : boxes) {
+        glm::vec3 c[8];
+        for (int i = 0; i < 8; ++i)
+            c[i] = glm::vec3((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+        addQuad(triangles, c[0], c[2], c[6], c[4], glm::vec3(-1, 0, 0));
+        addQuad(triangles, c[1], c[3], c[7], c[5], glm::vec3( 1, 0, 0));
+        addQuad(triangles, c[0], c[1], c[5], c[4], glm::vec3(0, -1, 0));
+        addQuad(triangles, c[2], c[3], c[7], c[6], glm::vec3(0,  1, 0));
+        addQuad(triangles, c[0], c[1], c[3], c[2], glm::vec3(0, 0, -1));
+        addQuad(triangles, c[4], c[5], c[7], c[6], glm::vec3(0, 0,  1));
+    }
+}
+
+const std::vector<glm::vec3> &OcclusionCuller::meshFor(const Object &object) {
+    auto it = meshes.find(&object);
+    if (it != meshes.end()) return it->second;
+
+    std::vector<glm::vec3> &triangles = meshes[&object];
+    if (object.occluder == OccluderMode::Off) return triangles;
+
+    size_t triangleCount = object.opaqueVertexCount / 3;
+    if (triangleCount <= settings.maxMeshTriangles) {
+        triangles.reserve(triangleCount * 3);
+        for (size_t i = 0; i < triangleCount * 3; ++i) {
+            const float *point = object.vertices.data() + i * OBJECT_STRIDE;
+            triangles.emplace_back(point[0], point[1], point[2]);
+        }
+    } else {
+        buildInnerBoxes(object, triangles);
+    }
+    return triangles;
+}
+
+void OcclusionCuller::cull(const glm::mat4 &viewProjection, const glm::vec3 &cameraPos,
+    const std::vector<Object*> &objects, std::vector<Object*> &visible) {
+    auto start = std::chrono::steady_clock::now();
+
+    // Designated occluders, then the largest on screen
+    candidates.clear();
+    for (const Object *object : objects) {
+        if (object->occluder == OccluderMode::Off || !object->hasOpaque()) continue;
+        const std::vector<glm::vec3> &mesh = meshFor(*object);
+        if (mesh.empty()) continue;
+
+        float distance = glm::length(object->worldSphere.center - cameraPos);
+        float size = object->worldSphere.radius / std::max(distance, 1e-4f);
+        bool designated = object->occluder == OccluderMode::On;
+        if (!designated && size < settings.minScreenSize) continue;
+        candidates.push_back({ object, &mesh, designated, size });
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        if (a.designated != b.designated) return a.designated;
+        return a.size > b.size;
+    });
+
+    depthBuffer.begin(viewProjection);
+    size_t occluders = 0, triangles = 0;
+    for (const Candidate &candidate : candidates) {
+        if (occluders == settings.maxOccluders) break;
+        size_t count = candidate.mesh->size() / 3;
+        if (triangles + count > settings.maxTriangles) continue;
+        depthBuffer.addOccluder(*candidate.mesh, candidate.object->GetModelMatrix());
+        occluders++;
+        triangles += count;
+    }
+    depthBuffer.rasterize();
+
+    visibleFlags.assign(objects.size(), 1);
+    workers.parallelFor(objects.size(), settings.minObjectsPerWorker, [&](size_t begin, size_t end, unsigned int) {
+        for (size_t i = begin; i < end; ++i)
+            visibleFlags[i] = depthBuffer.isVisible(objects[i]->worldBounds);
+    });
+    for (size_t i = 0; i < objects.size(); ++i) {
+        if (visibleFlags[i]) visible.push_back(objects[i]);
+        else stats.occluded++;
+    }
+
+    stats.occluders += occluders;
+    stats.triangles += depthBuffer.rasterizedTriangles();
+    stats.tested += objects.size();
+    stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,279 @@
+#include "OcclusionQueries.h"
+#include <glad/gl.h>
+#include <algorithm>
+
+OcclusionQueries::OcclusionQueries(const Shader *boxShader, const OcclusionQuerySettings &settings)
+: settings(settings), boxShader(boxShader) {
+    // Box centers and extents, one instance per query
+    glGenVertexArrays(1, &boxVAO);
+    glGenBuffers(1, &boxVBO);
+    glBindVertexArray(boxVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribDivisor(0, 1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+OcclusionQueries::~OcclusionQueries() {
+    for (const PendingQuery &query : pending) freeQueries.push_back(query.id);
+    if (!freeQueries.empty()) glDeleteQueries((GLsizei)freeQueries.size(), freeQueries.data());
+    glDeleteBuffers(1, &boxVBO);
+    glDeleteVertexArrays(1, &boxVAO);
+}
+
+unsigned int OcclusionQueries::acquireQuery() {
+    if (freeQueries.empty()) {
+        unsigned int query;
+        glGenQueries(1, &query);
+        return query;
+    }
+    unsigned int query = freeQueries.back();
+    freeQueries.pop_back();
+    return query;
+}
+
+OcclusionQueries::NodeState &OcclusionQueries::state(int node) {
+    NodeState &state = nodes[node];
+    unsigned int version = tree->node(node).version;
+    if (state.version != version) {
+        // Everything unknown, so visible until queried
+        state = NodeState();
+        state.version = version;
+    }
+    return state;
+}
+
+void OcclusionQueries::issue(unsigned int query, int node) {
+    pending.push_back({ query, node, frame, tree->node(node).version });
+}
+
+void OcclusionQueries::applyResult(int node, bool visible) {
+    state(node).visible = visible;
+    if (visible) {
+        // The walk reaches it again through its ancestors
+        for (int parent = tree->node(node).parent; parent != -1 && !state(parent).visible;
+            parent = tree->node(parent).parent)
+            state(parent).visible = true;
+        return;
+    }
+
+    // Pull up: a node whose children were both walked last frame and are hidden is hidden
+    auto hidden = [&](int child) {
+        const NodeState &childState = state(child);
+        return !childState.visible && childState.visitedFrame + 1 >= frame;
+    };
+    for (int parent = tree->node(node).parent; parent != -1; parent = tree->node(parent).parent) {
+        const AABBTree::Node &n = tree->node(parent);
+        if (!hidden(n.left) || !hidden(n.right)) break;
+        state(parent).visible = false;
+    }
+}
+
+void OcclusionQueries::collectResults() {
+    stats.pending += pending.size();
+    // Results arrive in the order the queries were issued, stop at the first that hasn't
+    while (!pending.empty()) {
+        const PendingQuery &query = pending.front();
+        GLuint available = 0;
+        glGetQueryObjectuiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+
+        GLuint passed = 0;
+        glGetQueryObjectuiv(query.id, GL_QUERY_RESULT, &passed);
+        // Results for a node whose subtree changed since describe other objects now
+        bool current = query.node < (int)nodes.size() && tree->node(query.node).height >= 0 &&
+                       tree->node(query.node).version == query.nodeVersion;
+        if (current && query.frame > state(query.node).resultFrame) {
+            state(query.node).resultFrame = query.frame;
+            applyResult(query.node, passed != 0);
+        }
+        freeQueries.push_back(query.id);
+        pending.pop_front();
+    }
+}
+
+size_t OcclusionQueries::cull(const AABBTree &tree, const Frustum &frustum, const glm::vec3 &cameraPos,
+    float nearPlane, std::vector<Object*> &visible, const std::function<bool(const Object&)> &potentiallyVisible) {
+    frame++;
+    this->tree = &tree;
+    // New slots start unknown, the rest are checked against their node's version as they're used
+    nodes.resize(tree.nodeCapacity());
+    collectResults();
+
+    visibleLeaves.clear();
+    checkedLeaves.clear();
+    hiddenLeaves.clear();
+    hiddenConditions.clear();
+    boxNodes.clear();
+    if (tree.rootNode() == -1) return 0;
+
+    glm::vec3 margin(settings.nearMargin * nearPlane);
+    auto distance = [&](int index) {
+        const AABB &box = tree.node(index).box;
+        glm::vec3 d = glm::clamp(cameraPos, box.min, box.max) - cameraPos;
+        return glm::dot(d, d);
+    };
+
+    size_t inFrustum = 0;
+    stack.assign(1, tree.rootNode());
+    while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        const AABBTree::Node &node = tree.node(index);
+        NodeState &state = this->state(index);
+        stats.visited++;
+
+        if (!frustum.intersects(node.box)) continue;
+        // Not walked last frame, like a subtree just pulled down or back in the frustum
+        bool known = state.visitedFrame + 1 >= frame;
+        if (!known) state.visible = true;
+        state.visitedFrame = frame;
+        // The near plane could cut into the box and hide it from its own query
+        bool near = glm::all(glm::greaterThanEqual(cameraPos, node.box.min - margin)) &&
+                    glm::all(glm::lessThanEqual(cameraPos, node.box.max + margin));
+        if (near) state.visible = true;
+
+        if (node.isLeaf()) {
+            Object *object = node.object;
+            if (!frustum.intersects(object->worldBounds)) continue;
+            if (potentiallyVisible && !potentiallyVisible(*object)) continue;
+            inFrustum++;
+            visible.push_back(object);
+
+            if (!state.visible) {
+                hiddenLeaves.push_back(index);
+                hiddenConditions.push_back(index);
+                boxNodes.push_back(index);
+                stats.hidden++;
+                continue;
+            }
+            visibleLeaves.push_back(index);
+            // Re-checked when new and then every interval, leaves spread over the frames
+            unsigned int offset = ((unsigned int)index * 2654435761u) >> 16;
+            bool due = !known || (frame + offset) % settings.visibleQueryInterval == 0;
+            if (near || !due) continue;
+            // Without opaque faces there's no depth draw to query
+            if (object->hasOpaque()) checkedLeaves.push_back(index);
+            else boxNodes.push_back(index);
+        } else if (state.visible) {
+            int first = node.left, second = node.right;
+            if (distance(second) < distance(first)) std::swap(first, second);
+            stack.push_back(second);
+            stack.push_back(first);
+        } else {
+            // Hidden subtree, only its bounds are queried. Its leaves wait on
+            // that one query, and the walk goes into it once a result says visible.
+            boxNodes.push_back(index);
+            subtree.assign(1, index);
+            while (!subtree.empty()) {
+                int innerIndex = subtree.back();
+                subtree.pop_back();
+                const AABBTree::Node &inner = tree.node(innerIndex);
+                if (!frustum.intersects(inner.box)) continue;
+                if (!inner.isLeaf()) {
+                    subtree.push_back(inner.right);
+                    subtree.push_back(inner.left);
+                    continue;
+                }
+                if (!frustum.intersects(inner.object->worldBounds)) continue;
+                if (potentiallyVisible && !potentiallyVisible(*inner.object)) continue;
+                inFrustum++;
+                visible.push_back(inner.object);
+                hiddenLeaves.push_back(innerIndex);
+                hiddenConditions.push_back(index);
+                stats.hidden++;
+            }
+        }
+    }
+    return inFrustum;
+}
+
+void OcclusionQueries::drawDepth(const glm::mat4 &view, const glm::mat4 &projection, const Shader &depthShader) {
+    // Nearest first, so the queried draws test against what's in front of them
+    size_t checked = 0;
+    for (int index : visibleLeaves) {
+        const Object *object = tree->node(index).object;
+        bool check = checked < checkedLeaves.size() && checkedLeaves[checked] == index;
+        if (check) checked++;
+        if (!object->hasOpaque()) continue;
+
+        unsigned int query = 0;
+        if (check) {
+            query = acquireQuery();
+            glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, query);
+        }
+        object->draw(view, projection, depthShader, ObjectPart::Opaque);
+        if (check) {
+            glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+            issue(query, index);
+            stats.geometryQueries++;
+        }
+    }
+}
+
+void OcclusionQueries::queryHidden(const glm::mat4 &view, const glm::mat4 &projection, const Shader &depthShader) {
+    if (boxNodes.empty()) return;
+
+    boxData.clear();
+    for (int index : boxNodes) {
+        const AABB &box = tree->node(index).box;
+        glm::vec3 center = box.center(), extents = box.extents();
+        boxData.insert(boxData.end(), { center.x, center.y, center.z, extents.x, extents.y, extents.z });
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+    glBufferData(GL_ARRAY_BUFFER, boxData.size() * sizeof(float), boxData.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // All the boxes in one batch, tested without writing anything
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+    boxShader->use();
+    boxShader->setMat4("viewProjection", projection * view);
+    glBindVertexArray(boxVAO);
+    for (size_t i = 0; i < boxNodes.size(); ++i) {
+        unsigned int query = acquireQuery();
+        glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, query);
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 14, 1, (GLuint)i);
+        glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+        issue(query, boxNodes[i]);
+
+        NodeState &state = nodes[boxNodes[i]];
+        state.query = query;
+        state.queryFrame = frame;
+    }
+    glBindVertexArray(0);
+    glEnable(GL_CULL_FACE);
+    glDepthMask(GL_TRUE);
+    stats.boxQueries += boxNodes.size();
+
+    // Hidden leaves the GPU finds visible join the depth, no CPU round trip
+    for (size_t i = 0; i < hiddenLeaves.size(); ++i) {
+        int index = hiddenLeaves[i];
+        NodeState &leaf = state(index);
+        leaf.query = nodes[hiddenConditions[i]].query;
+        leaf.queryFrame = frame;
+        const Object *object = tree->node(index).object;
+        if (!object->hasOpaque()) continue;
+        glBeginConditionalRender(leaf.query, GL_QUERY_WAIT);
+        object->draw(view, projection, depthShader, ObjectPart::Opaque);
+        glEndConditionalRender();
+    }
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+bool OcclusionQueries::beginConditional(const Object &object) const {
+    int index = object.spatialProxy;
+    if (index < 0 || index >= (int)nodes.size() || nodes[index].queryFrame != frame) return false;
+    glBeginConditionalRender(nodes[index].query, GL_QUERY_WAIT);
+    return true;
+}
+
+void OcclusionQueries::endConditional() const {
+    glEndConditionalRender();
+}
@@ -0,0 +1,496 @@
+#include "PotentiallyVisibleSet.h"
+#include "AABBTree.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <bit>
+
+namespace {
+
+// World space triangle the bake's rays are traced against
+struct BakeTriangle {
+    glm::vec3 a, edge1, edge2;
+    uint32_t object; // In staticObjects
+    bool opaque;
+};
+
+struct BakeNode {
+    AABB box;
+    uint32_t first = 0, count = 0; // A leaf's triangles
+    int left = -1;                 // Children at left and left + 1
+};
+
+// Bounding volume hierarchy over the static triangles, split at the centroid
+// median of the longest axis. Built once per bake, never changed.
+struct TriangleBVH {
+    std::vector<BakeTriangle> triangles;
+    std::vector<BakeNode> nodes;
+
+    void build() {
+        nodes.clear();
+        if (triangles.empty()) return;
+        nodes.emplace_back();
+        split(0, 0, (uint32_t)triangles.size());
+    }
+
+private:
+    static glm::vec3 centroid(const BakeTriangle &t) { return t.a + (t.edge1 + t.edge2) * (1.0f / 3.0f); }
+
+    void split(int index, uint32_t first, uint32_t count) {
+        AABB box, centers;
+        for (uint32_t i = first; i < first + count; ++i) {
+            const BakeTriangle &t = triangles[i];
+            box.expand(t.a);
+            box.expand(t.a + t.edge1);
+            box.expand(t.a + t.edge2);
+            centers.expand(centroid(t));
+        }
+        nodes[index].box = box;
+
+        glm::vec3 extent = centers.max - centers.min;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        if (count <= PVS_LEAF_TRIANGLES || !(extent[axis] > 0.0f)) {
+            nodes[index].first = first;
+            nodes[index].count = count;
+            return;
+        }
+
+        uint32_t half = count / 2;
+        std::nth_element(triangles.begin() + first, triangles.begin() + first + half, triangles.begin() + first + count,
+            [axis](const BakeTriangle &a, const BakeTriangle &b) { return centroid(a)[axis] < centroid(b)[axis]; });
+        int left = (int)nodes.size();
+        nodes.emplace_back();
+        nodes.emplace_back();
+        nodes[index].left = left;
+        split(left, first, half);
+        split(left + 1, first + half, count - half);
+    }
+};
+
+struct BakeScratch {
+    std::vector<int> stack;
+    std::vector<std::pair<float, uint32_t>> translucent; // Distance and object of translucent hits
+    std::vector<Object*> found;
+    std::vector<uint32_t> targets; // Objects the cell aims rays at
+};
+
+// splitmix64, seeded per cell so the bake doesn't depend on how it's split over workers
+struct BakeRandom {
+    uint64_t state;
+
+    float next() {
+        state += 0x9E3779B97F4A7C15ull;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        return (float)(z >> 40) * (1.0f / 16777216.0f);
+    }
+    glm::vec3 next3() {
+        glm::vec3 v;
+        v.x = next();
+        v.y = next();
+        v.z = next();
+        return v;
+    }
+};
+
+void markObject(uint8_t *bits, uint32_t object) {
+    bits[object >> 3] |= (uint8_t)(1u << (object & 7));
+}
+
+// Mark the object of the first opaque front face along the ray, and of every
+// translucent face before it. Back faces are culled when drawn, rays pass them.
+void trace(const TriangleBVH &bvh, const glm::vec3 &origin, const glm::vec3 &direction,
+    BakeScratch &scratch, uint8_t *bits) {
+    glm::vec3 invDirection = 1.0f / direction;
+    float nearest = std::numeric_limits<float>::max();
+    uint32_t hit = std::numeric_limits<uint32_t>::max();
+    scratch.translucent.clear();
+
+    scratch.stack.assign(1, 0);
+    while (!scratch.stack.empty()) {
+        const BakeNode &node = bvh.nodes[scratch.stack.back()];
+        scratch.stack.pop_back();
+        if (!rayIntersectsAABB(origin, invDirection, nearest, node.box)) continue;
+        if (node.left != -1) {
+            scratch.stack.push_back(node.left);
+            scratch.stack.push_back(node.left + 1);
+            continue;
+        }
+
+        // Moller-Trumbore, the determinant is positive on the counter-clockwise side
+        for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+            const BakeTriangle &t = bvh.triangles[i];
+            glm::vec3 p = glm::cross(direction, t.edge2);
+            float det = glm::dot(t.edge1, p);
+            if (t.opaque ? det <= 1e-12f : std::fabs(det) <= 1e-12f) continue;
+            float invDet = 1.0f / det;
+            glm::vec3 s = origin - t.a;
+            float u = glm::dot(s, p) * invDet;
+            if (u < 0.0f || u > 1.0f) continue;
+            glm::vec3 q = glm::cross(s, t.edge1);
+            float v = glm::dot(direction, q) * invDet;
+            if (v < 0.0f || u + v > 1.0f) continue;
+            float distance = glm::dot(t.edge2, q) * invDet;
+            if (distance <= 0.0f || distance >= nearest) continue;
+
+            if (t.opaque) {
+                nearest = distance;
+                hit = t.object;
+            } else {
+                scratch.translucent.push_back({ distance, t.object });
+            }
+        }
+    }
+
+    if (hit != std::numeric_limits<uint32_t>::max()) markObject(bits, hit);
+    for (const auto &[distance, object] : scratch.translucent)
+        if (distance < nearest) markObject(bits, object);
+}
+
+// Nonzero bytes are stored as they are, a run of zero bytes as a 0 and the run length
+void compressRow(const uint8_t *bits, size_t size, std::vector<uint8_t> &out) {
+    for (size_t i = 0; i < size;) {
+        if (bits[i]) {
+            out.push_back(bits[i++]);
+            continue;
+        }
+        size_t run = 0;
+        while (i < size && bits[i] == 0 && run < 255) { run++; i++; }
+        out.push_back(0);
+        out.push_back((uint8_t)run);
+    }
+}
+
+void decompressRow(const uint8_t *in, const uint8_t *end, uint8_t *bits, size_t size) {
+    size_t i = 0;
+    while (i < size && in < end) {
+        uint8_t value = *in++;
+        if (value) {
+            bits[i++] = value;
+            continue;
+        }
+        size_t run = in < end ? *in++ : size - i;
+        run = std::min(run, size - i);
+        std::fill(bits + i, bits + i + run, 0);
+        i += run;
+    }
+    // Cut short, whatever is missing counts as visible
+    std::fill(bits + i, bits + size, 0xFF);
+}
+
+// FNV-1a
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+template <typename T>
+uint64_t hashValue(uint64_t hash, const T &value) {
+    return hashBytes(hash, &value, sizeof(T));
+}
+
+template <typename T>
+void writeValue(std::ofstream &out, const T &value) {
+    out.write((const char*)&value, sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::ifstream &in, T &value) {
+    return (bool)in.read((char*)&value, sizeof(T));
+}
+
+} // namespace
+
+bool PotentiallyVisibleSet::loadOrBake(const std::string &mapPath, const Scene &scene, WorkerPool &workers) {
+    staticObjects.clear();
+    dynamicObjects.clear();
+    staticIndex.clear();
+    for (Object *object : scene.sceneObjects) {
+        if (!object->isStatic) {
+            dynamicObjects.push_back(object);
+            continue;
+        }
+        staticIndex[object] = staticObjects.size();
+        staticObjects.push_back(object);
+    }
+
+    offsets.clear();
+    data.clear();
+    current = -1;
+    visible.clear();
+    if (staticObjects.empty()) return false;
+    rowBytes = (staticObjects.size() + 7) / 8;
+    row.assign(rowBytes, 0);
+
+    std::string path = std::filesystem::path(mapPath).replace_extension(".pvs").string();
+    uint64_t key = bakeKey(mapPath);
+    if (load(path, key)) {
+        std::cout << "Loaded PVS: " << path << " (" << offsets.size() << " cells, " << data.size() << " bytes)" << std::endl;
+        return true;
+    }
+
+    setupGrid();
+    bake(workers);
+    if (!save(path, key)) std::cerr << "Failed to write PVS file: " << path << "\n";
+    return true;
+}
+
+uint64_t PotentiallyVisibleSet::bakeKey(const std::string &mapPath) const {
+    uint64_t key = 14695981039346656037ull;
+    key = hashValue(key, PVS_FILE_VERSION);
+
+    std::ifstream in(mapPath, std::ios::binary);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    key = hashBytes(key, text.data(), text.size());
+
+    key = hashValue(key, settings.cellSize);
+    key = hashValue(key, settings.maxCells);
+    key = hashValue(key, settings.padding);
+    key = hashValue(key, settings.raysPerCell);
+    key = hashValue(key, settings.raysPerObject);
+    key = hashValue(key, settings.objectRayDistance);
+    key = hashValue(key, settings.objectRaysPerCell);
+    key = hashValue(key, settings.dilation);
+
+    // The meshes aren't in the map, a changed asset changes the bounds or the counts
+    for (const Object *object : staticObjects) {
+        key = hashValue(key, object->vertexCount());
+        key = hashValue(key, object->opaqueVertexCount);
+        key = hashValue(key, object->worldBounds.min);
+        key = hashValue(key, object->worldBounds.max);
+    }
+    return key;
+}
+
+void PotentiallyVisibleSet::setupGrid() {
+    AABB bounds;
+    for (const Object *object : staticObjects) bounds.expand(object->worldBounds);
+
+    glm::vec3 size = bounds.max - bounds.min;
+    cellSize = std::max(settings.cellSize, 1e-3f);
+    for (;;) {
+        dims = glm::max(glm::ivec3(glm::ceil(size / cellSize)), glm::ivec3(1)) + 2 * settings.padding;
+        if ((size_t)dims.x * dims.y * dims.z <= settings.maxCells) break;
+        cellSize *= 1.25f;
+    }
+    origin = bounds.min - glm::vec3((float)settings.padding * cellSize);
+}
+
+void PotentiallyVisibleSet::bake(WorkerPool &workers) {
+    auto start = std::chrono::steady_clock::now();
+
+    TriangleBVH bvh;
+    for (uint32_t i = 0; i < (uint32_t)staticObjects.size(); ++i) {
+        const Object &object = *staticObjects[i];
+        glm::mat4 model = object.GetModelMatrix();
+        // Mirrored objects turn their faces inside out
+        bool flip = glm::determinant(glm::mat3(model)) < 0.0f;
+        size_t vertexCount = object.vertexCount() / 3 * 3;
+        for (size_t v = 0; v < vertexCount; v += 3) {
+            glm::vec3 p[3];
+            for (int k = 0; k < 3; ++k) {
+                const float *point = object.vertices.data() + (v + k) * OBJECT_STRIDE;
+                p[k] = glm::vec3(model * glm::vec4(point[0], point[1], point[2], 1.0f));
+            }
+            if (flip) std::swap(p[1], p[2]);
+            bvh.triangles.push_back({ p[0], p[1] - p[0], p[2] - p[0], i, v < object.opaqueVertexCount });
+        }
+    }
+    bvh.build();
+
+    // Finds the objects overlapping or near a cell
+    AABBTree objectTree;
+    for (Object *object : staticObjects) objectTree.insert(object, object->worldBounds);
+    objectTree.rebuild();
+
+    size_t cells = (size_t)dims.x * dims.y * dims.z;
+    std::vector<uint8_t> rows(cells * rowBytes, 0);
+    std::vector<BakeScratch> scratch(workers.workerCount());
+    auto cellCoordinates = [&](size_t cell) {
+        return glm::ivec3((int)(cell % dims.x), (int)(cell / dims.x % dims.y), (int)(cell / ((size_t)dims.x * dims.y)));
+    };
+
+    workers.parallelFor(cells, settings.minCellsPerWorker, [&](size_t begin, size_t end, unsigned int worker) {
+        BakeScratch &s = scratch[worker];
+        for (size_t cell = begin; cell < end; ++cell) {
+            uint8_t *bits = rows.data() + cell * rowBytes;
+            glm::ivec3 c = cellCoordinates(cell);
+            AABB box = { origin + glm::vec3(c) * cellSize, origin + glm::vec3(c + 1) * cellSize };
+
+            // From inside an object's bounds it can be seen whichever way its faces point.
+            // The tree's leaves are fattened, test the bounds themselves.
+            s.found.clear();
+            objectTree.queryAABB(box, s.found);
+            for (const Object *object : s.found)
+                if (object->worldBounds.intersects(box)) markObject(bits, staticIndex.at(object));
+            if (bvh.nodes.empty()) continue;
+
+            BakeRandom random{ (uint64_t)cell * 0xD1B54A32D192ED03ull };
+            for (size_t r = 0; r < settings.raysPerCell; ++r) {
+                glm::vec3 from = box.min + random.next3() * cellSize;
+                // Uniform on the sphere
+                float z = 1.0f - 2.0f * random.next();
+                float phi = 6.2831853f * random.next();
+                float radius = std::sqrt(std::max(0.0f, 1.0f - z * z));
+                trace(bvh, from, glm::vec3(radius * std::cos(phi), radius * std::sin(phi), z), s, bits);
+            }
+            // Small objects are easy to miss with random directions, aim at the nearby ones
+            float reach = settings.objectRayDistance;
+            s.found.clear();
+            objectTree.queryAABB({ box.min - glm::vec3(reach), box.max + glm::vec3(reach) }, s.found);
+            s.targets.clear();
+            for (const Object *object : s.found) {
+                const AABB &bounds = object->worldBounds;
+                glm::vec3 gap = glm::max(glm::max(bounds.min - box.max, box.min - bounds.max), glm::vec3(0.0f));
+                if (glm::dot(gap, gap) <= reach * reach) s.targets.push_back((uint32_t)staticIndex.at(object));
+            }
+            // In static order, so the subset only depends on the cell's seed
+            std::sort(s.targets.begin(), s.targets.end());
+            size_t budget = settings.raysPerObject == 0 ? 0 : settings.objectRaysPerCell / settings.raysPerObject;
+            if (s.targets.size() > budget) {
+                for (size_t i = 0; i < budget; ++i) {
+                    size_t pick = i + std::min((size_t)(random.next() * (s.targets.size() - i)), s.targets.size() - i - 1);
+                    std::swap(s.targets[i], s.targets[pick]);
+                }
+                s.targets.resize(budget);
+            }
+            for (uint32_t target : s.targets) {
+                const AABB &bounds = staticObjects[target]->worldBounds;
+                for (size_t r = 0; r < settings.raysPerObject; ++r) {
+                    glm::vec3 from = box.min + random.next3() * cellSize;
+                    glm::vec3 to = bounds.min + random.next3() * (bounds.max - bounds.min);
+                    float length = glm::length(to - from);
+                    if (length > 1e-6f) trace(bvh, from, (to - from) / length, s, bits);
+                }
+            }
+        }
+    });
+
+    // Merge each set with its neighbours', one axis at a time
+    if (settings.dilation > 0) {
+        std::vector<uint8_t> source;
+        for (int axis = 0; axis < 3; ++axis) {
+            source = rows;
+            long long stride = axis == 0 ? 1 : axis == 1 ? dims.x : (long long)dims.x * dims.y;
+            workers.parallelFor(cells, settings.minCellsPerWorker, [&](size_t begin, size_t end, unsigned int) {
+                for (size_t cell = begin; cell < end; ++cell) {
+                    int coordinate = cellCoordinates(cell)[axis];
+                    uint8_t *bits = rows.data() + cell * rowBytes;
+                    for (int d = -settings.dilation; d <= settings.dilation; ++d) {
+                        if (d == 0 || coordinate + d < 0 || coordinate + d >= dims[axis]) continue;
+                        const uint8_t *other = source.data() + ((long long)cell + d * stride) * rowBytes;
+                        for (size_t b = 0; b < rowBytes; ++b) bits[b] |= other[b];
+                    }
+                }
+            });
+        }
+    }
+
+    // Neighbouring cells often see the same, each distinct set is stored once
+    std::unordered_map<std::string, uint32_t> shared;
+    offsets.resize(cells);
+    data.clear();
+    size_t visibleTotal = 0;
+    for (size_t cell = 0; cell < cells; ++cell) {
+        const uint8_t *bits = rows.data() + cell * rowBytes;
+        for (size_t b = 0; b < rowBytes; ++b) visibleTotal += std::popcount(bits[b]);
+        auto [it, inserted] = shared.emplace(std::string((const char*)bits, rowBytes), (uint32_t)data.size());
+        if (inserted) compressRow(bits, rowBytes, data);
+        offsets[cell] = it->second;
+    }
+
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Baked PVS: " << cells << " cells of " << cellSize << " (" << dims.x << "x" << dims.y << "x" << dims.z
+              << "), " << bvh.triangles.size() << " tris, " << (int)milliseconds << " ms on " << workers.workerCount()
+              << " threads, " << (double)visibleTotal / cells << "/" << staticObjects.size() << " visible per cell, "
+              << shared.size() << " distinct sets in " << data.size() << " bytes" << std::endl;
+}
+
+bool PotentiallyVisibleSet::save(const std::string &path, uint64_t key) const {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) return false;
+
+    // Native byte order, a file from another machine fails the key and is rebaked
+    out.write("PVS", 4);
+    writeValue(out, PVS_FILE_VERSION);
+    writeValue(out, key);
+    writeValue(out, origin);
+    writeValue(out, cellSize);
+    writeValue(out, dims);
+    writeValue(out, (uint32_t)staticObjects.size());
+    writeValue(out, (uint32_t)offsets.size());
+    writeValue(out, (uint32_t)data.size());
+    out.write((const char*)offsets.data(), offsets.size() * sizeof(uint32_t));
+    out.write((const char*)data.data(), data.size());
+    return out.good();
+}
+
+bool PotentiallyVisibleSet::load(const std::string &path, uint64_t key) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+
+    char magic[4];
+    uint32_t version = 0, objectCount = 0, cellTotal = 0, dataSize = 0;
+    uint64_t fileKey = 0;
+    if (!in.read(magic, 4) || std::memcmp(magic, "PVS", 4) != 0) return false;
+    if (!readValue(in, version) || version != PVS_FILE_VERSION) return false;
+    if (!readValue(in, fileKey) || fileKey != key) {
+        std::cout << "PVS out of date, rebaking: " << path << std::endl;
+        return false;
+    }
+    if (!readValue(in, origin) || !readValue(in, cellSize) || !readValue(in, dims) ||
+        !readValue(in, objectCount) || !readValue(in, cellTotal) || !readValue(in, dataSize)) return false;
+    if (objectCount != staticObjects.size() || glm::any(glm::lessThan(dims, glm::ivec3(1))) ||
+        (size_t)dims.x * dims.y * dims.z != cellTotal) return false;
+
+    offsets.resize(cellTotal);
+    data.resize(dataSize);
+    in.read((char*)offsets.data(), offsets.size() * sizeof(uint32_t));
+    in.read((char*)data.data(), data.size());
+    bool valid = (bool)in && std::all_of(offsets.begin(), offsets.end(), [&](uint32_t offset) { return offset < dataSize; });
+    if (!valid) {
+        std::cerr << "Corrupt PVS file: " << path << "\n";
+        offsets.clear();
+        data.clear();
+    }
+    return valid;
+}
+
+bool PotentiallyVisibleSet::update(const glm::vec3 &position) {
+    if (!baked()) return false;
+
+    glm::ivec3 c = glm::ivec3(glm::floor((position - origin) / cellSize));
+    if (glm::any(glm::lessThan(c, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(c, dims))) {
+        current = -1;
+        return false;
+    }
+    int cell = (c.z * dims.y + c.y) * dims.x + c.x;
+    if (cell == current) return true;
+
+    current = cell;
+    decompressRow(data.data() + offsets[cell], data.data() + data.size(), row.data(), rowBytes);
+    visible.clear();
+    for (size_t i = 0; i < staticObjects.size(); ++i)
+        if (row[i >> 3] & (1u << (i & 7))) visible.push_back(staticObjects[i]);
+    visible.insert(visible.end(), dynamicObjects.begin(), dynamicObjects.end());
+    return true;
+}
+
+bool PotentiallyVisibleSet::isVisible(const Object &object) const noexcept {
+    if (current == -1) return true;
+    auto it = staticIndex.find(&object);
+    if (it == staticIndex.end()) return true;
+    return row[it->second >> 3] & (1u << (it->second & 7));
+}
@@ -0,0 +1,147 @@
+#include "ShadowBatch.h"
+#include "ShadowPool.h"
+#include <glad/gl.h>
+#include <array>
+#include <bit>
+
+// Upload into a buffer, growing it when the data doesn't fit
+static void uploadBuffer(GLenum target, unsigned int buffer, size_t &capacity, const void *data, size_t bytes) {
+    glBindBuffer(target, buffer);
+    if (bytes > capacity) {
+        capacity = bytes * 2;
+        glBufferData(target, capacity, nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBufferSubData(target, 0, bytes, data);
+    glBindBuffer(target, 0);
+}
+
+ShadowBatch::ShadowBatch(GPUScene &scene, const Shader *batchShader)
+: scene(scene), batchShader(batchShader) {
+    if (!supported()) return;
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &instanceBuffer);
+    glGenBuffers(1, &commandBuffer);
+    glGenBuffers(1, &lightBuffer);
+
+    // Positions from the packed scene, plus the per-instance (object, light face) pair
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, scene.VBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, OBJECT_STRIDE*sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glVertexAttribIPointer(6, 2, GL_UNSIGNED_INT, 2*sizeof(unsigned int), (void*)0);
+    glVertexAttribDivisor(6, 1);
+    glEnableVertexAttribArray(6);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+ShadowBatch::~ShadowBatch() {
+    if (VAO != 0) glDeleteVertexArrays(1, &VAO);
+    if (instanceBuffer != 0) glDeleteBuffers(1, &instanceBuffer);
+    if (commandBuffer != 0) glDeleteBuffers(1, &commandBuffer);
+    if (lightBuffer != 0) glDeleteBuffers(1, &lightBuffer);
+}
+
+unsigned int ShadowBatch::render(const std::vector<ShadowDraw> &draws) {
+    if (!supported() || draws.empty()) return 0;
+
+    unsigned int commands = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        // Each tier is its own cubemap array and FBO
+        for (std::vector<const ShadowDraw*> &tier : tiers) tier.clear();
+        for (const ShadowDraw &draw : draws) {
+            if (draw.pass != pass || draw.light->shadowTier < 0) continue;
+            draw.light->beginShadowDraw(draw);
+            tiers[draw.light->shadowTier].push_back(&draw);
+        }
+
+        for (const std::vector<const ShadowDraw*> &tier : tiers) {
+            if (!tier.empty()) commands += renderTier(tier);
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return commands;
+}
+
+unsigned int ShadowBatch::renderTier(const std::vector<const ShadowDraw*> &draws) {
+    // Count every (light, face) each object is drawn into
+    lights.clear();
+    objectFirst.assign(scene.size() + 1, 0);
+    for (const ShadowDraw *draw : draws) {
+        for (const ShadowCaster &caster : draw->casters) {
+            unsigned int object = scene.indexOf(caster.object);
+            if (object != NO_OBJECT) objectFirst[object + 1] += std::popcount(caster.faceMask & 0x3Fu);
+        }
+    }
+    for (size_t i = 1; i < objectFirst.size(); ++i) objectFirst[i] += objectFirst[i - 1];
+    objectNext.assign(objectFirst.begin(), objectFirst.end() - 1);
+    instances.resize(objectFirst.back());
+
+    // Then place them, each object's instances consecutive
+    for (const ShadowDraw *draw : draws) {
+        const Light &light = *draw->light;
+        unsigned int lightIndex = lights.size();
+
+        ShadowBatchLight record{};
+        std::array<glm::mat4, 6> matrices = light.shadowMatrices();
+        for (int face = 0; face < 6; ++face) record.faceMatrices[face] = matrices[face];
+        record.positionFar = glm::vec4(light.position, light.shadowFarPlane);
+        record.layer = draw->layer;
+        record.mode = light.type == LightType::Directional ? SHADOW_BATCH_ORTHO :
+            light.dualParaboloid ? SHADOW_BATCH_PARABOLOID : SHADOW_BATCH_PERSPECTIVE;
+        lights.push_back(record);
+
+        for (const ShadowCaster &caster : draw->casters) {
+            unsigned int object = scene.indexOf(caster.object);
+            if (object == NO_OBJECT) continue;
+            for (unsigned int face = 0; face < 6; ++face) {
+                if (caster.faceMask & (1u << face))
+                    instances[objectNext[object]++] = { object, lightIndex * 6 + face };
+            }
+        }
+    }
+
+    // One command per object, its instances are consecutive from baseInstance
+    commands.clear();
+    for (size_t i = 0; i + 1 < objectFirst.size(); ++i) {
+        unsigned int count = objectFirst[i + 1] - objectFirst[i];
+        if (count == 0) continue;
+
+        const GPUObject &object = scene.gpuObjects[i];
+        commands.push_back({ object.vertexCount, count, object.firstVertex, objectFirst[i] });
+    }
+    if (commands.empty()) return 0;
+
+    uploadBuffer(GL_ARRAY_BUFFER, instanceBuffer, instanceCapacity,
+        instances.data(), instances.size() * sizeof(glm::uvec2));
+    uploadBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer, commandCapacity,
+        commands.data(), commands.size() * sizeof(DrawCommand));
+    uploadBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer, lightCapacity,
+        lights.data(), lights.size() * sizeof(ShadowBatchLight));
+
+    // Every light of the tier shares its layered FBO
+    const Light &first = *draws.front()->light;
+    glBindFramebuffer(GL_FRAMEBUFFER, first.depthMapFBO);
+    glViewport(0, 0, first.shadowMapSize, first.shadowMapSize);
+
+    batchShader->use();
+    batchShader->setFloat("mapSize", (float)first.shadowMapSize);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, scene.objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SHADOW_BATCH_BINDING, lightBuffer);
+
+    // Paraboloid hemispheres clip what's behind them
+    glEnable(GL_CLIP_DISTANCE0);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glMultiDrawArraysIndirect(GL_TRIANGLES, nullptr, commands.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glDisable(GL_CLIP_DISTANCE0);
+
+    return commands.size();
+}
@@ -0,0 +1,104 @@
+#include "ShadowMask.h"
+#include "RenderTarget.h"
+#include <glad/gl.h>
+#include <algorithm>
+#include <iostream>
+
+ShadowMask::ShadowMask(const Shader *resolveShader)
+: resolveShader(resolveShader) {
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+ShadowMask::~ShadowMask() {
+    destroyTargets();
+    if (emptyVAO != 0) glDeleteVertexArrays(1, &emptyVAO);
+}
+
+void ShadowMask::createTargets() {
+    maskTexture = createRenderTarget(GL_RGBA8, width, height, SHADOW_MASK_LAYERS);
+    depthTexture = createRenderTarget(GL_DEPTH_COMPONENT24, width, height);
+
+    GLenum drawBuffers[SHADOW_MASK_LAYERS];
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    for (int layer = 0; layer < SHADOW_MASK_LAYERS; ++layer) {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + layer, maskTexture, 0, layer);
+        drawBuffers[layer] = GL_COLOR_ATTACHMENT0 + layer;
+    }
+    glDrawBuffers(SHADOW_MASK_LAYERS, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "ERROR::SHADOW_MASK: Framebuffer is not complete" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadowMask::destroyTargets() {
+    if (fbo != 0) glDeleteFramebuffers(1, &fbo);
+    if (maskTexture != 0) glDeleteTextures(1, &maskTexture);
+    if (depthTexture != 0) glDeleteTextures(1, &depthTexture);
+    fbo = maskTexture = depthTexture = 0;
+}
+
+void ShadowMask::selectLights(const std::vector<Light*> &lights, const ShadowPool &pool,
+    const glm::vec3 &cameraPos, const glm::mat4 &projection) {
+    std::vector<std::pair<float, int>> ranked;
+    for (size_t i = 0; i < lights.size(); ++i) {
+        Light *light = lights[i];
+        light->shadowMaskChannel = -1;
+        // Nothing to resolve for lights without a visible shadow
+        if (light->shadowTier < 0 || light->shadowFade <= 0.0f) continue;
+        ranked.push_back({ pool.importance(*light, cameraPos, projection), (int)i });
+    }
+    size_t count = std::min(ranked.size(), (size_t)MAX_SHADOW_MASK_LIGHTS);
+    std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+        [](const auto &a, const auto &b) { return a.first > b.first; });
+
+    channelLights.clear();
+    for (size_t channel = 0; channel < count; ++channel) {
+        lights[ranked[channel].second]->shadowMaskChannel = (int)channel;
+        channelLights.push_back(ranked[channel].second);
+    }
+}
+
+void ShadowMask::resolve(int viewportWidth, int viewportHeight, const glm::mat4 &view, const glm::mat4 &projection) {
+    if (viewportWidth != width || viewportHeight != height || fbo == 0) {
+        destroyTargets();
+        width = viewportWidth;
+        height = viewportHeight;
+        createTargets();
+    }
+
+    // The window's depth can't be sampled, copy it
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+    glDisable(GL_DEPTH_TEST);
+
+    glm::mat4 viewProjection = projection * view;
+    std::vector<int> channels = channelLights;
+    channels.resize(MAX_SHADOW_MASK_LIGHTS, -1);
+
+    resolveShader->use();
+    resolveShader->setInt("sceneDepth", 0);
+    resolveShader->setMat4("inverseViewProjection", glm::inverse(viewProjection));
+    resolveShader->setVec2("viewportSize", (float)width, (float)height);
+    resolveShader->setIntArray("channelLights", channels);
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Render target writes are visible to later draws' image loads
+    glBindImageTexture(SHADOW_MASK_IMAGE_UNIT, maskTexture, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA8);
+}
+
+void ShadowMask::bind(const Shader &shader, bool enabled) const {
+    shader.use();
+    shader.setBool("shadowMaskEnabled", enabled && fbo != 0);
+}
@@ -0,0 +1,399 @@
+#include "ShadowPool.h"
+#include <glad/gl.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+static GLenum internalFormat(ShadowDepthFormat format) {
+    switch (format) {
+    case ShadowDepthFormat::Depth16:  return GL_DEPTH_COMPONENT16;
+    case ShadowDepthFormat::Depth32F: return GL_DEPTH_COMPONENT32F;
+    default:                          return GL_DEPTH_COMPONENT24;
+    }
+}
+
+// Immutable cubemap array, clamped at the edges
+static unsigned int createCubeArray(GLenum format, unsigned int size, size_t layers, GLint filter) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, texture);
+    glTexStorage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 1, format, size, size, layers);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+ShadowPool::ShadowPool(const ShadowPoolSettings &settings)
+: settings(settings) {
+    // The depth textures stay nearest without compares, PCF reads them through this
+    glGenSamplers(1, &compareSampler);
+    glSamplerParameteri(compareSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(compareSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(compareSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(compareSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(compareSampler, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(compareSampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glSamplerParameteri(compareSampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    for (unsigned int size = settings.minSize; size <= settings.maxSize && tiers.size() < MAX_SHADOW_TIERS; size *= 2) {
+        Tier tier;
+        tier.size = size;
+        tiers.push_back(tier);
+    }
+    if (tiers.empty())
+        std::cerr << "ShadowPool: no resolution tiers between " << settings.minSize << " and " << settings.maxSize << "\n";
+    else if (tiers.back().size < settings.maxSize)
+        std::cerr << "ShadowPool: more than " << MAX_SHADOW_TIERS << " tiers, largest is " << tiers.back().size << "\n";
+}
+
+ShadowPool::~ShadowPool() {
+    for (Tier &tier : tiers) {
+        if (tier.fbo != 0) glDeleteFramebuffers(1, &tier.fbo);
+        if (tier.faceFBO != 0) glDeleteFramebuffers(1, &tier.faceFBO);
+        if (tier.texture != 0) glDeleteTextures(1, &tier.texture);
+        if (tier.momentTexture != 0) glDeleteTextures(1, &tier.momentTexture);
+    }
+    if (compareSampler != 0) glDeleteSamplers(1, &compareSampler);
+}
+
+size_t ShadowPool::cubeBytes(unsigned int size) const noexcept {
+    // 24 bit depth is padded to 4 bytes by most drivers
+    size_t texelBytes = settings.depthFormat == ShadowDepthFormat::Depth16 ? 2 : 4;
+    if (settings.filter == ShadowFilter::EVSM) texelBytes += 8; // RGBA16F moments
+    return size_t(size) * size * 6 * texelBytes;
+}
+
+size_t ShadowPool::allocatedBytes() const noexcept {
+    size_t bytes = 0;
+    for (const Tier &tier : tiers)
+        bytes += tier.used.size() * cubeBytes(tier.size);
+    return bytes;
+}
+
+float ShadowPool::screenCoverage(const Light &light, const glm::vec3 &cameraPos,
+    const glm::mat4 &projection) const {
+    if (light.type == LightType::Directional) return 1.0f;
+
+    float distance = glm::length(light.position - cameraPos);
+    float range = light.shadowFarPlane;
+    if (distance <= range) return 1.0f;
+    float tanHalfAngle = range / std::sqrt(distance * distance - range * range);
+    return std::min(tanHalfAngle * projection[1][1], 1.0f);
+}
+
+float ShadowPool::importance(const Light &light, const glm::vec3 &cameraPos, const glm::mat4 &projection) const {
+    float luminance = glm::dot(light.color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+    return light.intensity * luminance * screenCoverage(light, cameraPos, projection);
+}
+
+void ShadowPool::selectShadowedLights(const std::vector<Light*> &lights, const glm::vec3 &cameraPos,
+    const glm::mat4 &projection, std::vector<float> &targets) const {
+    targets.assign(lights.size(), 1.0f);
+    if (settings.maxShadowedLights == 0 || lights.size() <= settings.maxShadowedLights) return;
+
+    // Lights already shadowed get a head start, so two close in rank don't trade places every frame
+    std::vector<std::pair<float, size_t>> ranked;
+    ranked.reserve(lights.size());
+    for (size_t i = 0; i < lights.size(); ++i) {
+        float score = importance(*lights[i], cameraPos, projection);
+        if (lights[i]->shadowTier >= 0 && lights[i]->shadowFade > 0.0f) score *= 1.25f;
+        ranked.push_back({ score, i });
+    }
+    std::nth_element(ranked.begin(), ranked.begin() + settings.maxShadowedLights, ranked.end(),
+        [](const auto &a, const auto &b) { return a.first > b.first; });
+
+    targets.assign(lights.size(), 0.0f);
+    for (size_t i = 0; i < settings.maxShadowedLights; ++i) targets[ranked[i].second] = 1.0f;
+}
+
+unsigned int ShadowPool::desiredSize(const Light &light, const glm::vec3 &cameraPos,
+    const glm::mat4 &projection, int viewportHeight) const {
+    // Cascades cover the whole view
+    if (light.type == LightType::Directional) {
+        float size = viewportHeight * settings.resolutionScale;
+        unsigned int result = settings.minSize;
+        while (result < size && result < settings.maxSize) result *= 2;
+        return result;
+    }
+
+    // Screen height in pixels covered by the light's range sphere
+    float pixels = screenCoverage(light, cameraPos, projection) * viewportHeight;
+
+    float size = pixels * settings.resolutionScale;
+    unsigned int result = settings.minSize;
+    while (result < size && result < settings.maxSize) result *= 2;
+    return result;
+}
+
+bool ShadowPool::growTier(int index, size_t capacity) {
+    Tier &tier = tiers[index];
+    size_t oldCapacity = tier.used.size();
+    if (allocatedBytes() + (capacity - oldCapacity) * cubeBytes(tier.size) > settings.memoryBudget)
+        return false;
+
+    unsigned int texture = createCubeArray(internalFormat(settings.depthFormat), tier.size, capacity * 6, GL_NEAREST);
+
+    // Keep the cached maps of lights already in this tier
+    if (tier.texture != 0) {
+        glCopyImageSubData(tier.texture, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 0,
+            texture, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 0,
+            tier.size, tier.size, oldCapacity * 6);
+        glDeleteTextures(1, &tier.texture);
+    }
+    tier.texture = texture;
+
+    // And their filtered moments
+    if (tier.momentTexture != 0) {
+        unsigned int moments = createCubeArray(GL_RGBA16F, tier.size, capacity * 6, GL_LINEAR);
+        glCopyImageSubData(tier.momentTexture, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 0,
+            moments, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 0,
+            tier.size, tier.size, oldCapacity * 6);
+        glDeleteTextures(1, &tier.momentTexture);
+        tier.momentTexture = moments;
+    }
+    tier.used.resize(capacity, false);
+
+    // Layered attachment, the geometry shader picks the layer
+    if (tier.fbo == 0) glGenFramebuffers(1, &tier.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, tier.fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tier.texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    if (tier.faceFBO == 0) glGenFramebuffers(1, &tier.faceFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, tier.faceFBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tier.texture, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Point the tier's lights at the new texture
+    for (auto &entry : allocations) {
+        if (entry.second.tier == index) assign(*entry.first, entry.second);
+    }
+    return true;
+}
+
+int ShadowPool::allocateSlot(int index) {
+    Tier &tier = tiers[index];
+    auto it = std::find(tier.used.begin(), tier.used.end(), false);
+    if (it != tier.used.end()) {
+        *it = true;
+        return it - tier.used.begin();
+    }
+
+    // Double the array, or grow by one slot when doubling is over budget
+    size_t capacity = tier.used.size();
+    if (!growTier(index, std::max<size_t>(capacity * 2, 1)) && !growTier(index, capacity + 1))
+        return -1;
+
+    tier.used[capacity] = true;
+    return capacity;
+}
+
+void ShadowPool::release(Allocation &allocation) {
+    if (allocation.tier >= 0) {
+        Tier &tier = tiers[allocation.tier];
+        if (allocation.slot >= 0) tier.used[allocation.slot] = false;
+        if (allocation.staticSlot >= 0) tier.used[allocation.staticSlot] = false;
+    }
+    allocation = Allocation();
+}
+
+void ShadowPool::assign(Light &light, Allocation &allocation) {
+    light.shadowPool = this;
+
+    if (allocation.tier < 0) {
+        light.shadowMapSize = 0;
+        light.shadowTexture = 0;
+        light.depthMapFBO = 0;
+        light.faceFBO = 0;
+        light.shadowTier = -1;
+        light.shadowLayer = 0;
+        light.staticLayer = -1;
+        return;
+    }
+
+    const Tier &tier = tiers[allocation.tier];
+
+    // A new slot holds someone else's depth
+    if (light.shadowMapSize != tier.size || light.shadowLayer != allocation.slot * 6)
+        light.invalidateShadowMap();
+
+    light.shadowMapSize = tier.size;
+    light.shadowTexture = tier.texture;
+    light.depthMapFBO = tier.fbo;
+    light.faceFBO = tier.faceFBO;
+    light.shadowTier = allocation.tier;
+    light.shadowLayer = allocation.slot * 6;
+    light.staticLayer = allocation.staticSlot >= 0 ? allocation.staticSlot * 6 : -1;
+}
+
+void ShadowPool::bindTextures(const Shader &shader, int textureUnit) const {
+    // Tiers without a texture still get their own unit, so the samplerCubeArray
+    // uniforms never share one with the object textures
+    bool moments = settings.filter == ShadowFilter::EVSM;
+    for (unsigned int i = 0; i < MAX_SHADOW_TIERS; ++i) {
+        unsigned int depth = i < tiers.size() ? tiers[i].texture : 0;
+        glActiveTexture(GL_TEXTURE0 + textureUnit + i);
+        glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, moments && i < tiers.size() ? tiers[i].momentTexture : depth);
+        shader.setInt("shadowMaps[" + std::to_string(i) + "]", textureUnit + i);
+
+        int compareUnit = textureUnit + SHADOW_TEXTURE_UNITS / 2 + i;
+        glActiveTexture(GL_TEXTURE0 + compareUnit);
+        glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, depth);
+        glBindSampler(compareUnit, compareSampler);
+        shader.setInt("shadowCompareMaps[" + std::to_string(i) + "]", compareUnit);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    shader.setInt("shadowFilter", (int)settings.filter);
+}
+
+void ShadowPool::updateMoments() {
+    for (size_t i = 0; i < tiers.size(); ++i) {
+        Tier &tier = tiers[i];
+        bool wanted = settings.filter == ShadowFilter::EVSM && tier.texture != 0;
+        if (wanted && tier.momentTexture == 0) {
+            tier.momentTexture = createCubeArray(GL_RGBA16F, tier.size, tier.used.size() * 6, GL_LINEAR);
+            // Nothing is filtered yet, redraw the tier's lights so the prefilter sees them
+            for (auto &entry : allocations) {
+                if (entry.second.tier == (int)i) entry.first->invalidateShadowMap();
+            }
+        } else if (!wanted && tier.momentTexture != 0) {
+            glDeleteTextures(1, &tier.momentTexture);
+            tier.momentTexture = 0;
+        }
+    }
+}
+
+bool ShadowPool::allocateStaticLayer(Light &light) {
+    auto it = allocations.find(&light);
+    if (it == allocations.end() || it->second.tier < 0) return false;
+
+    Allocation &allocation = it->second;
+    if (allocation.staticSlot < 0) {
+        allocation.staticSlot = allocateSlot(allocation.tier);
+        if (allocation.staticSlot < 0) return false;
+        assign(light, allocation);
+    }
+    return true;
+}
+
+void ShadowPool::update(const std::vector<Light*> &lights, const glm::vec3 &cameraPos,
+    const glm::mat4 &projection, int viewportHeight, float deltaTime) {
+    if (tiers.empty()) return;
+
+    // Give back the slots of lights that are gone
+    for (auto it = allocations.begin(); it != allocations.end();) {
+        if (std::find(lights.begin(), lights.end(), it->first) == lights.end()) {
+            release(it->second);
+            it = allocations.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    struct Request {
+        Light *light;
+        int tier;
+    };
+    std::vector<Request> requests;
+    requests.reserve(lights.size());
+
+    // Ease each shadow toward its target, lights new to the pool start there
+    std::vector<float> targets;
+    selectShadowedLights(lights, cameraPos, projection, targets);
+    float fadeStep = settings.shadowFadeTime > 0.0f ? deltaTime / settings.shadowFadeTime : 1.0f;
+    shadowedCount = 0;
+
+    for (size_t i = 0; i < lights.size(); ++i) {
+        Light *light = lights[i];
+        if (allocations.find(light) == allocations.end()) light->shadowFade = targets[i];
+        else if (light->shadowFade < targets[i]) light->shadowFade = std::min(light->shadowFade + fadeStep, targets[i]);
+        else light->shadowFade = std::max(light->shadowFade - fadeStep, targets[i]);
+
+        // Faded out, the map goes back to the pool
+        if (light->shadowFade <= 0.0f) {
+            Allocation &allocation = allocations[light];
+            release(allocation);
+            assign(*light, allocation);
+            continue;
+        }
+        shadowedCount++;
+
+        // Far lights get two hemispheres instead of six faces. Switch back a
+        // little closer than the threshold so lights on it don't flip.
+        // Spot and directional maps are always 2D.
+        bool paraboloid = light->shadowMode == ShadowMode::DualParaboloid;
+        if (light->shadowMode == ShadowMode::Auto && settings.paraboloidDistance > 0.0f) {
+            float distance = glm::length(light->position - cameraPos);
+            float threshold = settings.paraboloidDistance * (light->dualParaboloid ? 0.9f : 1.0f);
+            paraboloid = distance > threshold;
+        }
+        light->setDualParaboloid(paraboloid && settings.paraboloidShadows && light->type == LightType::Point);
+
+        unsigned int size = desiredSize(*light, cameraPos, projection, viewportHeight);
+        int tier = 0;
+        while (tiers[tier].size < size && tier + 1 < (int)tiers.size()) tier++;
+
+        // Only drop one tier once the light asks for two less, so a light
+        // near a tier boundary doesn't flip back and forth
+        Allocation &allocation = allocations[light];
+        if (allocation.tier == tier + 1) tier = allocation.tier;
+
+        if (allocation.tier > tier) release(allocation);
+        requests.push_back({ light, tier });
+    }
+
+    // Largest on screen first, they get the budget before the rest
+    std::stable_sort(requests.begin(), requests.end(),
+        [](const Request &a, const Request &b) { return a.tier > b.tier; });
+
+    for (Tier &tier : tiers) {
+        // Free tiers nobody uses anymore so the budget goes to the rest
+        if (tier.texture != 0 && std::find(tier.used.begin(), tier.used.end(), true) == tier.used.end()) {
+            glDeleteFramebuffers(1, &tier.fbo);
+            glDeleteFramebuffers(1, &tier.faceFBO);
+            glDeleteTextures(1, &tier.texture);
+            if (tier.momentTexture != 0) glDeleteTextures(1, &tier.momentTexture);
+            tier.momentTexture = 0;
+            tier.fbo = 0;
+            tier.faceFBO = 0;
+            tier.texture = 0;
+            tier.used.clear();
+        }
+    }
+
+    bool exhausted = false;
+    for (const Request &request : requests) {
+        Allocation &allocation = allocations[request.light];
+        if (allocation.tier < 0) {
+            // Step down until a tier has room
+            for (int tier = request.tier; tier >= 0; --tier) {
+                int slot = allocateSlot(tier);
+                if (slot < 0) continue;
+                allocation.tier = tier;
+                allocation.slot = slot;
+                break;
+            }
+            exhausted |= allocation.tier < 0;
+        } else if (allocation.tier < request.tier) {
+            // Held back by the budget earlier, upgrade once there's room
+            int slot = allocateSlot(request.tier);
+            if (slot >= 0) {
+                release(allocation);
+                allocation.tier = request.tier;
+                allocation.slot = slot;
+            }
+        }
+        assign(*request.light, allocation);
+    }
+    updateMoments();
+
+    if (exhausted && !budgetWarned)
+        std::cerr << "ShadowPool: memory budget exhausted, some lights have no shadow map\n";
+    budgetWarned = exhausted;
+}
@@ -0,0 +1,77 @@
+#include "ShadowPrefilter.h"
+#include <glad/gl.h>
+#include <algorithm>
+#include <unordered_map>
+#include <bit>
+
+ShadowPrefilter::ShadowPrefilter(ShadowPool &pool, const Shader *prefilterShader)
+: pool(pool), prefilterShader(prefilterShader) {}
+
+ShadowPrefilter::~ShadowPrefilter() {
+    if (scratchTexture != 0) glDeleteTextures(1, &scratchTexture);
+}
+
+unsigned int ShadowPrefilter::filter(const Light &light, unsigned int faceMask) {
+    faceMask &= light.allFacesMask();
+    if (faceMask == 0 || light.shadowTier < 0) return 0;
+    unsigned int moments = pool.momentTexture(light.shadowTier);
+    if (moments == 0) return 0;
+
+    // Scratch big enough for the largest tier seen so far
+    unsigned int size = light.shadowMapSize;
+    if (size > scratchSize) {
+        if (scratchTexture != 0) glDeleteTextures(1, &scratchTexture);
+        glGenTextures(1, &scratchTexture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, scratchTexture);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA32F, size, size, 6);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        scratchSize = size;
+    }
+
+    // Dispatch z walks the faces in the mask
+    std::vector<int> faces;
+    for (int face = 0; face < 6; ++face) {
+        if (faceMask & (1u << face)) faces.push_back(face);
+    }
+    faces.resize(6, 0);
+
+    prefilterShader->use();
+    prefilterShader->setInt("depthMaps", 0);
+    prefilterShader->setInt("mapSize", size);
+    prefilterShader->setInt("cube", light.shadowLayer / 6);
+    prefilterShader->setIntArray("faces", faces);
+    prefilterShader->setInt("radius", std::clamp(radius, 0, MAX_PREFILTER_RADIUS));
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, light.shadowTexture);
+    glBindSampler(0, 0);
+    glBindImageTexture(0, scratchTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(1, moments, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+    unsigned int groups = (size + PREFILTER_GROUP_SIZE - 1) / PREFILTER_GROUP_SIZE;
+    unsigned int count = std::popcount(faceMask);
+    for (int pass = 0; pass < 2; ++pass) {
+        prefilterShader->setInt("pass", pass);
+        glDispatchCompute(groups, groups, count);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+    return count;
+}
+
+unsigned int ShadowPrefilter::filter(const std::vector<ShadowDraw> &draws) {
+    // Faces each light's sampled layer got cleared, restored or drawn into
+    std::unordered_map<const Light*, unsigned int> changed;
+    std::vector<const Light*> order;
+    for (const ShadowDraw &draw : draws) {
+        if (draw.layer != draw.light->shadowLayer) continue;
+        auto inserted = changed.emplace(draw.light, 0u);
+        if (inserted.second) order.push_back(draw.light);
+        inserted.first->second |= draw.clearMask | draw.copyMask;
+    }
+
+    unsigned int faces = 0;
+    for (const Light *light : order)
+        faces += filter(*light, changed[light]);
+    return faces;
+}
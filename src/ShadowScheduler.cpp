@@ -0,0 +1,72 @@
+#include "ShadowScheduler.h"
+#include <algorithm>
+#include <cmath>
+
+unsigned int ShadowScheduler::budget() const noexcept {
+    unsigned int faces = settings.faceBudget;
+    if (settings.millisecondBudget > 0.0 && millisecondsPerFace > 0.0) {
+        unsigned int timed = std::max(1u, (unsigned int)(settings.millisecondBudget / millisecondsPerFace));
+        faces = faces > 0 ? std::min(faces, timed) : timed;
+    }
+    return faces;
+}
+
+void ShadowScheduler::measure(double milliseconds, double faces) {
+    if (faces < 1.0) return;
+
+    // Smoothed, a single slow frame shouldn't starve the next ones
+    double sample = milliseconds / faces;
+    millisecondsPerFace = millisecondsPerFace > 0.0 ? glm::mix(millisecondsPerFace, sample, 0.25) : sample;
+}
+
+unsigned int ShadowScheduler::schedule(const std::vector<Light*> &lights, const glm::vec3 &cameraPos,
+    std::vector<unsigned int> &faceMasks) {
+    faceMasks.assign(lights.size(), 0);
+    frame++;
+
+    struct Candidate {
+        unsigned int light;
+        unsigned int face;
+        bool unrendered; // Cleared until drawn, goes first
+        float priority;
+        unsigned int order; // Rotates every frame to break ties
+    };
+    std::vector<Candidate> candidates;
+
+    for (unsigned int i = 0; i < lights.size(); ++i) {
+        const Light &light = *lights[i];
+        unsigned int dirty = light.dirtyFaceMask();
+        if (dirty == 0) continue;
+
+        // Brighter lights matter more, and lights lose weight with their
+        // distance beyond their own range
+        // Directional cascades follow the camera, they're always close
+        float range = light.shadowFarPlane;
+        float distance = glm::length(light.position - cameraPos);
+        float proximity = light.type == LightType::Directional ? 1.0f : range / std::max(distance, range);
+        float importance = light.intensity * proximity * proximity;
+
+        unsigned int unrendered = light.unrenderedFaceMask();
+        for (unsigned int face = 0; face < 6; ++face) {
+            if ((dirty & (1u << face)) == 0) continue;
+            float staleness = 1.0f + light.faceStaleness(face);
+            candidates.push_back({ i, face, (unrendered & (1u << face)) != 0, importance * staleness,
+                (i * 6 + face + frame) % (unsigned int)(lights.size() * 6) });
+        }
+    }
+
+    unsigned int limit = budget();
+    if (limit > 0 && candidates.size() > limit) {
+        std::partial_sort(candidates.begin(), candidates.begin() + limit, candidates.end(),
+            [](const Candidate &a, const Candidate &b) {
+                if (a.unrendered != b.unrendered) return a.unrendered;
+                if (a.priority != b.priority) return a.priority > b.priority;
+                return a.order < b.order;
+            });
+        candidates.resize(limit);
+    }
+
+    for (const Candidate &candidate : candidates)
+        faceMasks[candidate.light] |= 1u << candidate.face;
+    return candidates.size();
+}
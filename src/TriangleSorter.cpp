@@ -0,0 +1,222 @@
+#include "TriangleSorter.h"
+#include <glad/gl.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+TriangleSorter::TriangleSorter(WorkerPool &workers, const TriangleSorterSettings &settings)
+: settings(settings), workers(workers) {
+}
+
+TriangleSorter::~TriangleSorter() {
+    for (auto &[object, entry] : entries) {
+        if (entry.indexBuffer != 0) glDeleteBuffers(1, &entry.indexBuffer);
+    }
+}
+
+TriangleSorter::Entry &TriangleSorter::entryFor(const Object &object) {
+    auto it = entries.find(&object);
+    if (it != entries.end()) return it->second;
+
+    Entry &entry = entries[&object];
+    size_t first = object.opaqueVertexCount;
+    entry.triangleCount = (object.vertexCount() - first) / 3;
+
+    entry.centroidX.resize(entry.triangleCount);
+    entry.centroidY.resize(entry.triangleCount);
+    entry.centroidZ.resize(entry.triangleCount);
+    for (size_t i = 0; i < entry.triangleCount; ++i) {
+        const float *v = object.vertices.data() + (first + i * 3) * OBJECT_STRIDE;
+        entry.centroidX[i] = (v[0] + v[OBJECT_STRIDE + 0] + v[2 * OBJECT_STRIDE + 0]) / 3.0f;
+        entry.centroidY[i] = (v[1] + v[OBJECT_STRIDE + 1] + v[2 * OBJECT_STRIDE + 1]) / 3.0f;
+        entry.centroidZ[i] = (v[2] + v[OBJECT_STRIDE + 2] + v[2 * OBJECT_STRIDE + 2]) / 3.0f;
+    }
+    entry.distances.resize(entry.triangleCount);
+    entry.keys.resize(entry.triangleCount);
+    entry.scratch.resize(entry.triangleCount);
+    entry.indices.resize(entry.triangleCount * 3);
+    // Mesh order until the first sort
+    entry.order.resize(entry.triangleCount);
+    for (size_t i = 0; i < entry.triangleCount; ++i) entry.order[i] = (uint32_t)i;
+
+    glGenBuffers(1, &entry.indexBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, entry.indexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, entry.indices.size() * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return entry;
+}
+
+void TriangleSorter::computeKeys(Entry &entry, const Object &object, const glm::vec3 &cameraPos) {
+    // Distances in world units from object-space offsets, scaling included
+    glm::mat4 model = object.GetModelMatrix();
+    glm::mat3 linear(model);
+    glm::mat3 metric = glm::transpose(linear) * linear;
+    glm::vec3 camera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPos, 1.0f));
+
+    size_t count = entry.triangleCount;
+    unsigned int workerCount = workers.workersFor(count, settings.minTrianglesPerWorker);
+    minimums.assign(workerCount, std::numeric_limits<float>::max());
+    maximums.assign(workerCount, 0.0f);
+
+    workers.parallelFor(count, settings.minTrianglesPerWorker, [&](size_t begin, size_t end, unsigned int worker) {
+        const float *cx = entry.centroidX.data(), *cy = entry.centroidY.data(), *cz = entry.centroidZ.data();
+        float *distances = entry.distances.data();
+        float low = std::numeric_limits<float>::max(), high = 0.0f;
+        for (size_t i = begin; i < end; ++i) {
+            float dx = cx[i] - camera.x, dy = cy[i] - camera.y, dz = cz[i] - camera.z;
+            float squared = dx * (metric[0][0] * dx + metric[1][0] * dy + metric[2][0] * dz) +
+                            dy * (metric[0][1] * dx + metric[1][1] * dy + metric[2][1] * dz) +
+                            dz * (metric[0][2] * dx + metric[1][2] * dy + metric[2][2] * dz);
+            float distance = std::sqrt(std::max(squared, 0.0f));
+            distances[i] = distance;
+            low = std::min(low, distance);
+            high = std::max(high, distance);
+        }
+        minimums[worker] = low;
+        maximums[worker] = high;
+    });
+
+    float low = *std::min_element(minimums.begin(), minimums.end());
+    float high = *std::max_element(maximums.begin(), maximums.end());
+    float scale = high > low ? 65535.0f / (high - low) : 0.0f;
+
+    // Farthest gets key 0, so an ascending sort is back to front
+    workers.parallelFor(count, settings.minTrianglesPerWorker, [&](size_t begin, size_t end, unsigned int) {
+        const float *distances = entry.distances.data();
+        uint16_t *keys = entry.keys.data();
+        for (size_t i = begin; i < end; ++i)
+            keys[i] = (uint16_t)(65535.0f - (distances[i] - low) * scale + 0.5f);
+    });
+}
+
+bool TriangleSorter::insertionSort(Entry &entry) const {
+    const uint16_t *keys = entry.keys.data();
+    uint32_t *order = entry.order.data();
+    size_t budget = entry.triangleCount * settings.insertionSortMoves;
+    size_t moves = 0;
+
+    for (size_t i = 1; i < entry.triangleCount; ++i) {
+        uint32_t triangle = order[i];
+        uint16_t key = keys[triangle];
+        size_t j = i;
+        while (j > 0 && keys[order[j - 1]] > key) {
+            order[j] = order[j - 1];
+            --j;
+            // Far from sorted after all, leave it to the radix sort
+            if (++moves > budget) {
+                order[j] = triangle;
+                return false;
+            }
+        }
+        order[j] = triangle;
+    }
+    return true;
+}
+
+void TriangleSorter::radixSort(Entry &entry) {
+    size_t count = entry.triangleCount;
+    size_t minPerWorker = settings.minTrianglesPerWorker;
+    unsigned int workerCount = workers.workersFor(count, minPerWorker);
+    histograms.assign(workerCount * 256, 0);
+    const uint16_t *keys = entry.keys.data();
+
+    // Least significant byte first, each pass stable, so equal keys keep last frame's order
+    for (int shift = 0; shift < 16; shift += 8) {
+        const uint32_t *source = entry.order.data();
+        uint32_t *destination = entry.scratch.data();
+
+        workers.parallelFor(count, minPerWorker, [&](size_t begin, size_t end, unsigned int worker) {
+            uint32_t *histogram = histograms.data() + worker * 256;
+            std::fill(histogram, histogram + 256, 0u);
+            for (size_t i = begin; i < end; ++i) histogram[(keys[source[i]] >> shift) & 0xFF]++;
+        });
+
+        // Each worker's first slot per bucket, buckets in order and workers in range order
+        uint32_t offset = 0;
+        for (int bucket = 0; bucket < 256; ++bucket) {
+            for (unsigned int worker = 0; worker < workerCount; ++worker) {
+                uint32_t &slot = histograms[worker * 256 + bucket];
+                uint32_t bucketCount = slot;
+                slot = offset;
+                offset += bucketCount;
+            }
+        }
+
+        workers.parallelFor(count, minPerWorker, [&](size_t begin, size_t end, unsigned int worker) {
+            uint32_t *next = histograms.data() + worker * 256;
+            for (size_t i = begin; i < end; ++i)
+                destination[next[(keys[source[i]] >> shift) & 0xFF]++] = source[i];
+        });
+
+        entry.order.swap(entry.scratch);
+    }
+}
+
+void TriangleSorter::upload(Entry &entry, const Object &object) {
+    uint32_t first = (uint32_t)object.opaqueVertexCount;
+    workers.parallelFor(entry.triangleCount, settings.minTrianglesPerWorker, [&](size_t begin, size_t end, unsigned int) {
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t vertex = first + entry.order[i] * 3;
+            entry.indices[i * 3 + 0] = vertex;
+            entry.indices[i * 3 + 1] = vertex + 1;
+            entry.indices[i * 3 + 2] = vertex + 2;
+        }
+    });
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, entry.indexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, entry.indices.size() * sizeof(uint32_t), entry.indices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void TriangleSorter::sort(const std::vector<Object*> &objects, const glm::vec3 &cameraPos) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (const Object *object : objects) {
+        if (!object->hasTransparency) continue;
+        Entry &entry = entryFor(*object);
+        if (entry.triangleCount < 2) continue;
+
+        stats.objects++;
+        stats.triangles += entry.triangleCount;
+
+        // Nothing moved since the last sort
+        if (entry.sorted && entry.sortedCamera == cameraPos && entry.sortedVersion == object->transformVersion) {
+            stats.kept++;
+            continue;
+        }
+        entry.sortedCamera = cameraPos;
+        entry.sortedVersion = object->transformVersion;
+
+        computeKeys(entry, *object, cameraPos);
+
+        // Last frame's order against the new keys
+        size_t descents = 0;
+        for (size_t i = 1; i < entry.triangleCount; ++i)
+            descents += entry.keys[entry.order[i - 1]] > entry.keys[entry.order[i]];
+
+        if (entry.sorted && descents == 0) {
+            stats.kept++;
+            continue;
+        }
+        if (entry.sorted && descents <= entry.triangleCount * settings.insertionSortFraction && insertionSort(entry)) {
+            stats.insertionSorted++;
+        } else {
+            radixSort(entry);
+            stats.radixSorted++;
+        }
+        upload(entry, *object);
+        entry.sorted = true;
+    }
+
+    stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TriangleSorter::draw(const Object &object, const glm::mat4 &view, const glm::mat4 &projection) const {
+    auto it = entries.find(&object);
+    if (it == entries.end() || !it->second.sorted) {
+        object.draw(view, projection, ObjectPart::Transparent);
+        return;
+    }
+    object.drawIndexed(view, projection, it->second.indexBuffer, it->second.triangleCount * 3);
+}
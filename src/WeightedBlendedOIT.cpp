@@ -0,0 +1,89 @@
+#include "WeightedBlendedOIT.h"
+#include "RenderTarget.h"
+#include <glad/gl.h>
+#include <iostream>
+
+WeightedBlendedOIT::WeightedBlendedOIT(const Shader *compositeShader)
+: compositeShader(compositeShader) {
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+WeightedBlendedOIT::~WeightedBlendedOIT() {
+    destroyTargets();
+    if (emptyVAO != 0) glDeleteVertexArrays(1, &emptyVAO);
+}
+
+void WeightedBlendedOIT::createTargets() {
+    accumulationTexture = createRenderTarget(GL_RGBA16F, width, height);
+    revealageTexture = createRenderTarget(GL_R8, width, height);
+    depthTexture = createRenderTarget(GL_DEPTH_COMPONENT24, width, height);
+
+    const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, accumulationTexture, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, revealageTexture, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "ERROR::OIT: Framebuffer is not complete" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void WeightedBlendedOIT::destroyTargets() {
+    unsigned int textures[3] = { accumulationTexture, revealageTexture, depthTexture };
+    if (fbo != 0) glDeleteFramebuffers(1, &fbo);
+    if (accumulationTexture != 0) glDeleteTextures(3, textures);
+    fbo = accumulationTexture = revealageTexture = depthTexture = 0;
+}
+
+void WeightedBlendedOIT::begin(int viewportWidth, int viewportHeight) {
+    if (viewportWidth != width || viewportHeight != height || fbo == 0) {
+        destroyTargets();
+        width = viewportWidth;
+        height = viewportHeight;
+        createTargets();
+    }
+
+    // Transparent surfaces behind opaque ones are hidden, test against the scene's depth
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &targetFBO);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, targetFBO);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    const float accumulationClear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    const float revealageClear[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, accumulationClear);
+    glClearBufferfv(GL_COLOR, 1, revealageClear);
+
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+    glDepthMask(GL_FALSE);
+}
+
+void WeightedBlendedOIT::composite() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+    glDisable(GL_DEPTH_TEST);
+    // The composite's alpha is the covered amount
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, accumulationTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, revealageTexture);
+
+    compositeShader->use();
+    compositeShader->setInt("accumulation", 0);
+    compositeShader->setInt("revealage", 1);
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glActiveTexture(GL_TEXTURE0);
+    glEnable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+}
@@ -0,0 +1,77 @@
+#include "WorkerPool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned int threadCount) {
+    if (threadCount == 0) threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned int worker = 1; worker < threadCount; ++worker)
+        threads.emplace_back(&WorkerPool::workerLoop, this, worker);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads) thread.join();
+}
+
+void WorkerPool::workerLoop(unsigned int worker) {
+    unsigned int seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+
+        const std::function<void(unsigned int)> *current = task;
+        lock.unlock();
+        (*current)(worker);
+        lock.lock();
+
+        if (--pending == 0) done.notify_one();
+    }
+}
+
+void WorkerPool::run(const std::function<void(unsigned int worker)> &work) {
+    if (threads.empty()) {
+        work(0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &work;
+        pending = (unsigned int)threads.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return pending == 0; });
+    task = nullptr;
+}
+
+unsigned int WorkerPool::workersFor(size_t count, size_t minPerWorker) const noexcept {
+    size_t useful = minPerWorker > 0 ? count / minPerWorker : count;
+    return (unsigned int)std::clamp<size_t>(useful, 1, workerCount());
+}
+
+void WorkerPool::parallelFor(size_t count, size_t minPerWorker,
+    const std::function<void(size_t begin, size_t end, unsigned int worker)> &body) {
+    unsigned int workers = workersFor(count, minPerWorker);
+    // Too little to be worth waking the threads
+    if (workers == 1) {
+        body(0, count, 0);
+        return;
+    }
+
+    run([&](unsigned int worker) {
+        if (worker >= workers) return;
+        size_t begin = count * worker / workers;
+        size_t end = count * (worker + 1) / workers;
+        body(begin, end, worker);
+    });
+}
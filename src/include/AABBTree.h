@@ -0,0 +1,83 @@
+#ifndef __AABB_TREE_H__
+#define __AABB_TREE_H__
+
+#include "Bounds.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+class Object;
+
+constexpr float AABB_TREE_MARGIN = 0.1f;   // Leaf boxes are fattened so small moves don't reinsert
+constexpr int AABB_TREE_SAH_BINS = 12;
+
+// Dynamic bounding volume hierarchy over scene objects. Leaves can be
+// inserted, removed and moved incrementally; rebuild() rebuilds the whole
+// tree top-down with the surface area heuristic, which suits static content.
+class AABBTree {
+public:
+    // Returns a proxy id used to move or remove the object later
+    int insert(Object *object, const AABB &box);
+    void remove(int proxy);
+    // Update a leaf's bounds. Returns true if the leaf had to be reinserted.
+    bool move(int proxy, const AABB &box);
+    void rebuild();
+    void clear();
+
+    void queryFrustum(const Frustum &frustum, std::vector<Object*> &result) const;
+    void querySphere(const Sphere &sphere, std::vector<Object*> &result) const;
+    void queryAABB(const AABB &box, std::vector<Object*> &result) const;
+    void queryRay(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+        std::vector<Object*> &result) const;
+
+    [[nodiscard]]
+    size_t size() const noexcept { return leafCount; }
+    [[nodiscard]]
+    int height() const noexcept { return root == -1 ? 0 : nodes[root].height; }
+
+    struct Node {
+        AABB box;
+        Object *object = nullptr;
+        int parent = -1;    // Next free node while on the free list
+        int left = -1;
+        int right = -1;
+        int height = -1;    // 0 for leaves, -1 when free
+        // structureVersion() when the node was allocated or its subtree last
+        // changed. Leaves keep theirs when moved.
+        unsigned int version = 0;
+
+        bool isLeaf() const noexcept { return left == -1; }
+    };
+
+    // Read-only traversal, for visibility algorithms that keep their own per-node state
+    [[nodiscard]]
+    int rootNode() const noexcept { return root; }
+    [[nodiscard]]
+    const Node &node(int index) const noexcept { return nodes[index]; }
+    // Node slots, free ones included
+    [[nodiscard]]
+    size_t nodeCapacity() const noexcept { return nodes.size(); }
+    // Bumped whenever nodes are added, removed or linked differently. Per-node
+    // state kept outside the tree is still valid while the node's version is.
+    [[nodiscard]]
+    unsigned int structureVersion() const noexcept { return version; }
+
+private:
+    std::vector<Node> nodes;
+    int root = -1;
+    int freeList = -1;
+    size_t leafCount = 0;
+    unsigned int version = 0;
+
+    int allocateNode();
+    void freeNode(int index);
+
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    void refit(int index);
+    int balance(int index);
+    int build(std::vector<int> &leaves, size_t begin, size_t end);
+
+    void collectLeaves(int index, std::vector<Object*> &result) const;
+};
+
+#endif
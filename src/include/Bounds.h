@@ -0,0 +1,258 @@
+#ifndef __BOUNDS_H__
+#define __BOUNDS_H__
+
+#include <glm/glm.hpp>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#define BOUNDS_X86
+#endif
+
+struct AABB {
+    glm::vec3 min = glm::vec3( std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    bool valid() const noexcept { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+    glm::vec3 center()  const noexcept { return (min + max) * 0.5f; }
+    glm::vec3 extents() const noexcept { return (max - min) * 0.5f; }
+
+    void expand(const glm::vec3 &point) noexcept {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+    void expand(const AABB &box) noexcept {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    float surfaceArea() const noexcept {
+        glm::vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+    bool contains(const AABB &box) const noexcept {
+        return glm::all(glm::lessThanEqual(min, box.min)) && glm::all(glm::greaterThanEqual(max, box.max));
+    }
+    bool intersects(const AABB &box) const noexcept {
+        return glm::all(glm::lessThanEqual(min, box.max)) && glm::all(glm::greaterThanEqual(max, box.min));
+    }
+};
+
+inline AABB unionAABB(const AABB &a, const AABB &b) noexcept {
+    return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+}
+
+struct Sphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    bool intersects(const AABB &box) const noexcept {
+        glm::vec3 d = glm::clamp(center, box.min, box.max) - center;
+        return glm::dot(d, d) <= radius * radius;
+    }
+};
+
+// Spheres and boxes in structure of arrays, tested 4 at a time
+struct SphereLanes {
+    const float *x, *y, *z, *radius2;
+};
+struct BoxLanes {
+    const float *minX, *minY, *minZ, *maxX, *maxY, *maxZ;
+};
+
+// One sphere or box in all 4 lanes, to test against 4 of the other
+struct SphereSplat {
+    float x[4], y[4], z[4], radius2[4];
+
+    SphereSplat(const glm::vec3 &center, float radius) noexcept {
+        for (int i = 0; i < 4; ++i) {
+            x[i] = center.x; y[i] = center.y; z[i] = center.z;
+            radius2[i] = radius * radius;
+        }
+    }
+    SphereLanes lanes() const noexcept { return { x, y, z, radius2 }; }
+};
+struct BoxSplat {
+    float minX[4], minY[4], minZ[4], maxX[4], maxY[4], maxZ[4];
+
+    explicit BoxSplat(const AABB &box) noexcept {
+        for (int i = 0; i < 4; ++i) {
+            minX[i] = box.min.x; minY[i] = box.min.y; minZ[i] = box.min.z;
+            maxX[i] = box.max.x; maxY[i] = box.max.y; maxZ[i] = box.max.z;
+        }
+    }
+    BoxLanes lanes() const noexcept { return { minX, minY, minZ, maxX, maxY, maxZ }; }
+};
+
+// Bit i set where sphere sphereFirst + i reaches box boxFirst + i
+#ifdef BOUNDS_X86
+inline unsigned int spheresReachBoxes(const SphereLanes &s, size_t sphereFirst,
+    const BoxLanes &b, size_t boxFirst) noexcept {
+    __m128 zero = _mm_setzero_ps();
+    __m128 cx = _mm_loadu_ps(s.x + sphereFirst), cy = _mm_loadu_ps(s.y + sphereFirst),
+           cz = _mm_loadu_ps(s.z + sphereFirst);
+
+    // Distance from each center to its box along each axis, 0 inside
+    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(b.minX + boxFirst), cx),
+                                      _mm_sub_ps(cx, _mm_loadu_ps(b.maxX + boxFirst))), zero);
+    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(b.minY + boxFirst), cy),
+                                      _mm_sub_ps(cy, _mm_loadu_ps(b.maxY + boxFirst))), zero);
+    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(b.minZ + boxFirst), cz),
+                                      _mm_sub_ps(cz, _mm_loadu_ps(b.maxZ + boxFirst))), zero);
+    __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    return _mm_movemask_ps(_mm_cmple_ps(distance2, _mm_loadu_ps(s.radius2 + sphereFirst)));
+}
+#else
+inline unsigned int spheresReachBoxes(const SphereLanes &s, size_t sphereFirst,
+    const BoxLanes &b, size_t boxFirst) noexcept {
+    unsigned int mask = 0;
+    for (size_t j = 0; j < 4; ++j) {
+        size_t i = sphereFirst + j, k = boxFirst + j;
+        float dx = glm::max(glm::max(b.minX[k] - s.x[i], s.x[i] - b.maxX[k]), 0.0f);
+        float dy = glm::max(glm::max(b.minY[k] - s.y[i], s.y[i] - b.maxY[k]), 0.0f);
+        float dz = glm::max(glm::max(b.minZ[k] - s.z[i], s.z[i] - b.maxZ[k]), 0.0f);
+        if (dx * dx + dy * dy + dz * dz <= s.radius2[i]) mask |= 1u << j;
+    }
+    return mask;
+}
+#endif
+
+// Slab test, true if the ray hits the box within maxDistance
+inline bool rayIntersectsAABB(const glm::vec3 &origin, const glm::vec3 &invDirection,
+    float maxDistance, const AABB &box) noexcept {
+    glm::vec3 t0 = (box.min - origin) * invDirection;
+    glm::vec3 t1 = (box.max - origin) * invDirection;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+    float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+    float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxDistance));
+    return enter <= exit;
+}
+
+// Bounds of an AABB after an affine transform (Arvo's method)
+inline AABB transformAABB(const AABB &box, const glm::mat4 &m) noexcept {
+    if (!box.valid()) return box;
+
+    glm::vec3 center = glm::vec3(m * glm::vec4(box.center(), 1.0f));
+    glm::vec3 extents = box.extents();
+    glm::mat3 absRot = glm::mat3(glm::abs(glm::vec3(m[0])), glm::abs(glm::vec3(m[1])), glm::abs(glm::vec3(m[2])));
+    glm::vec3 newExtents = absRot * extents;
+
+    return { center - newExtents, center + newExtents };
+}
+
+// Bounds of a sphere after an affine transform, scaled by the largest axis
+inline Sphere transformSphere(const Sphere &sphere, const glm::mat4 &m) noexcept {
+    float scale = glm::max(glm::length(glm::vec3(m[0])),
+                  glm::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+    return { glm::vec3(m * glm::vec4(sphere.center, 1.0f)), sphere.radius * scale };
+}
+
+// Bit per cube face (+X, -X, +Y, -Y, +Z, -Z) whose 90 degree frustum around
+// the light overlaps the box. Matches the face order of GL cubemaps.
+inline unsigned int cubeFaceMask(const AABB &box, const glm::vec3 &lightPos) noexcept {
+    glm::vec3 relMin = box.min - lightPos;
+    glm::vec3 relMax = box.max - lightPos;
+
+    unsigned int mask = 0;
+    for (int face = 0; face < 6; ++face) {
+        int a = face / 2;
+        int b = (a + 1) % 3;
+        int c = (a + 2) % 3;
+        // Furthest the box reaches along the face axis
+        float reach = (face % 2 == 0) ? relMax[a] : -relMin[a];
+
+        if (reach - relMin[b] >= 0.0f && reach + relMax[b] >= 0.0f &&
+            reach - relMin[c] >= 0.0f && reach + relMax[c] >= 0.0f)
+            mask |= 1u << face;
+    }
+    return mask;
+}
+
+// Bit per dual-paraboloid hemisphere (+Y, -Y) the box reaches into
+inline unsigned int paraboloidMask(const AABB &box, const glm::vec3 &lightPos) noexcept {
+    unsigned int mask = 0;
+    if (box.max.y >= lightPos.y) mask |= 1u;
+    if (box.min.y <= lightPos.y) mask |= 2u;
+    return mask;
+}
+
+// Conservative bounds of the region a box can shadow from a point light, out
+// to the light's range. The shadow lies in the cone through the box corners;
+// pushing the corners out to range / cos(widest corner angle) covers it.
+inline AABB shadowVolumeBounds(const AABB &box, const glm::vec3 &lightPos, float range) noexcept {
+    AABB lightBounds = { lightPos - glm::vec3(range), lightPos + glm::vec3(range) };
+
+    glm::vec3 axis = box.center() - lightPos;
+    if (glm::dot(axis, axis) < 1e-12f) return lightBounds;
+    axis = glm::normalize(axis);
+
+    glm::vec3 directions[8];
+    float minCos = 1.0f;
+    for (int i = 0; i < 8; ++i) {
+        glm::vec3 corner((i & 1) ? box.max.x : box.min.x,
+                         (i & 2) ? box.max.y : box.min.y,
+                         (i & 4) ? box.max.z : box.min.z);
+        glm::vec3 d = corner - lightPos;
+        float length = glm::length(d);
+        if (length < 1e-6f) return lightBounds;
+        directions[i] = d / length;
+        minCos = glm::min(minCos, glm::dot(directions[i], axis));
+    }
+    // Light is inside or right next to the box
+    if (minCos < 0.25f) return lightBounds;
+
+    AABB result;
+    result.expand(lightPos);
+    for (const glm::vec3 &d : directions)
+        result.expand(lightPos + d * (range / minCos));
+
+    return { glm::max(result.min, lightBounds.min), glm::min(result.max, lightBounds.max) };
+}
+
+enum class Containment { Outside, Intersects, Inside };
+
+struct Frustum {
+    // Left, right, bottom, top, near, far. Normals point inwards.
+    glm::vec4 planes[6];
+
+    // Extract the planes from a view-projection matrix (Gribb/Hartmann)
+    static Frustum fromMatrix(const glm::mat4 &viewProjection) noexcept {
+        glm::mat4 m = glm::transpose(viewProjection);
+        Frustum frustum;
+        frustum.planes[0] = m[3] + m[0];
+        frustum.planes[1] = m[3] - m[0];
+        frustum.planes[2] = m[3] + m[1];
+        frustum.planes[3] = m[3] - m[1];
+        frustum.planes[4] = m[3] + m[2];
+        frustum.planes[5] = m[3] - m[2];
+        for (glm::vec4 &plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    bool intersects(const AABB &box) const noexcept {
+        glm::vec3 center = box.center();
+        glm::vec3 extents = box.extents();
+        for (const glm::vec4 &plane : planes) {
+            float radius = glm::dot(extents, glm::abs(glm::vec3(plane)));
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+        }
+        return true;
+    }
+
+    Containment classify(const AABB &box) const noexcept {
+        glm::vec3 center = box.center();
+        glm::vec3 extents = box.extents();
+        Containment result = Containment::Inside;
+        for (const glm::vec4 &plane : planes) {
+            float radius = glm::dot(extents, glm::abs(glm::vec3(plane)));
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            if (distance < -radius) return Containment::Outside;
+            if (distance < radius) result = Containment::Intersects;
+        }
+        return result;
+    }
+};
+
+#endif
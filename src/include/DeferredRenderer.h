@@ -0,0 +1,73 @@
+#ifndef __DEFERRED_RENDERER_H__
+#define __DEFERRED_RENDERER_H__
+
+#include "Light.h"
+#include "Shader.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+enum class RenderPath {
+    Forward, // Every opaque fragment loops over its cluster's lights
+    Deferred // G-buffer, then each light over the pixels its volume covers
+};
+
+// Lighting programs of the deferred path, the G-buffer is drawn with GBuffer.fs
+struct DeferredShaders {
+    const Shader *light = nullptr;     // DeferredLight.vs + DeferredLight.fs + Lighting.glsl
+    const Shader *stencil = nullptr;   // DeferredLight.vs + DeferredStencil.fs
+    const Shader *composite = nullptr; // DeferredLight.vs + DeferredComposite.fs
+};
+
+// Deferred shading. Opaque objects fill a G-buffer of albedo and opacity,
+// octahedral normals and depth. Every point and spot light then marks the
+// pixels inside its range sphere in the stencil and shades only those,
+// directional lights shade the whole screen. The sum is clamped into a scene
+// color target that keeps the depth, so transparent objects are drawn over
+// it with the forward shader before it's copied to the window.
+class DeferredRenderer {
+public:
+    // Lights shaded by the last shade() call
+    size_t volumeLights = 0;
+    size_t fullscreenLights = 0;
+
+    explicit DeferredRenderer(const DeferredShaders &shaders);
+    ~DeferredRenderer() noexcept;
+
+    // Remove copying
+    DeferredRenderer(const DeferredRenderer&) = delete;
+    DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+    // Size the targets to the viewport, clear the G-buffer and bind it for the opaque draws
+    void beginGeometry(int width, int height);
+    // Light the G-buffer, in LightBuffer order. The light shader needs the
+    // LightBuffer bound. Leaves the scene target bound for forward draws.
+    void shade(const std::vector<Light*> &lights, const glm::mat4 &view, const glm::mat4 &projection);
+    // Copy the scene target to the window
+    void present() const;
+
+private:
+    DeferredShaders shaders;
+    int width = 0, height = 0;
+
+    unsigned int gbufferFBO = 0;
+    unsigned int albedoTexture = 0; // GL_RGBA8, rgb = albedo, a = opacity
+    unsigned int normalTexture = 0; // GL_RGB10_A2, rg = octahedral normal, a = lit
+    unsigned int depthTexture = 0;  // GL_DEPTH24_STENCIL8
+
+    // The lighting passes test against a copy of the depth, the G-buffer's is sampled
+    unsigned int lightFBO = 0;
+    unsigned int accumulationTexture = 0; // GL_RGBA16F, unclamped sum of the lights
+    unsigned int depthStencil = 0;        // GL_DEPTH24_STENCIL8 renderbuffer
+    unsigned int sceneFBO = 0;
+    unsigned int sceneTexture = 0; // GL_RGBA8, shared depth with lightFBO
+
+    unsigned int sphereVAO = 0, sphereVBO = 0;
+    unsigned int emptyVAO = 0;
+    int sphereVertexCount = 0;
+
+    void createTargets();
+    void destroyTargets();
+    void createSphere();
+};
+
+#endif
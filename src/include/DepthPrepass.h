@@ -0,0 +1,72 @@
+#ifndef __DEPTH_PREPASS_H__
+#define __DEPTH_PREPASS_H__
+
+enum class PrepassMode {
+    Off,
+    On,
+    Auto // On while the measured overdraw is above the threshold
+};
+
+struct DepthPrepassSettings {
+    // Fragments passing the depth test per visible pixel that turn the pre-pass on
+    float overdrawThreshold = 1.5f;
+    // While off in Auto, frames between pre-pass frames that re-measure the overdraw
+    unsigned int probeInterval = 60;
+};
+
+// Depth-only pre-pass for the opaque draws. The lit pass then tests
+// GL_EQUAL with early fragment tests, so each pixel is shaded once.
+// Sample queries around both passes measure the overdraw: fragments passing
+// the pre-pass's GL_LESS test, which the lit pass would otherwise shade, per
+// pixel passing GL_EQUAL. Results are read oldest first as soon as they're
+// available, so a probe's measurement decides Auto within a few frames.
+class DepthPrepass {
+public:
+    static const int QUERY_COUNT = 4;
+
+    PrepassMode mode = PrepassMode::Auto;
+    DepthPrepassSettings settings;
+    // Off while other occlusion queries run in the pre-pass, GL allows one
+    // at a time. The last measurement is kept.
+    bool measureOverdraw = true;
+
+    explicit DepthPrepass(const DepthPrepassSettings &settings = DepthPrepassSettings());
+    ~DepthPrepass() noexcept;
+
+    // Remove copying
+    DepthPrepass(const DepthPrepass&) = delete;
+    DepthPrepass& operator=(const DepthPrepass&) = delete;
+
+    // Decide whether this frame runs the pre-pass. If so, masks color writes
+    // for the depth-only draws that follow and returns true.
+    bool beginPrepass();
+    // After the pre-pass draws, restore color writes. Passes that read the
+    // pre-pass depth go between this and beginShading().
+    void endPrepass();
+    // After a pre-pass, switch to GL_EQUAL without depth writes for the lit draws
+    void beginShading();
+    // Back to GL_LESS with depth writes
+    void end();
+
+    // Last measured fragments per visible pixel, 0 before the first measurement
+    [[nodiscard]]
+    float overdraw() const noexcept { return measuredOverdraw; }
+    [[nodiscard]]
+    bool active() const noexcept { return running; }
+
+private:
+    unsigned int prepassQueries[QUERY_COUNT];
+    unsigned int shadingQueries[QUERY_COUNT];
+    bool pending[QUERY_COUNT] = {};
+    int current = 0; // Queries of the next measurement
+    int oldest = 0;  // Oldest measurement not read yet, if any is pending
+    bool running = false;
+    bool measuring = false; // This frame's passes are inside the sample queries
+    unsigned int framesSinceProbe = 0;
+    float measuredOverdraw = 0.0f;
+
+    // Read a measurement, false if it isn't available and wait is false
+    bool collect(int query, bool wait);
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __FRUSTUM_CULLER_H__
+#define __FRUSTUM_CULLER_H__
+
+#include "Object.h"
+#include "Bounds.h"
+#include <vector>
+
+constexpr size_t CULL_BATCH_SIZE = 8; // Objects per SIMD test
+
+// CPU frustum culling of object world bounds. Bounds are gathered into
+// structure-of-arrays batches and tested 8 at a time with AVX, or SSE
+// when AVX isn't available.
+class FrustumCuller {
+public:
+    struct Stats {
+        size_t visible = 0;
+        size_t culled = 0;
+    };
+    Stats stats;
+
+    // Append the objects intersecting the frustum to visible
+    void cull(const Frustum &frustum, const std::vector<Object*> &objects, std::vector<Object*> &visible);
+    void resetStats() noexcept { stats = Stats(); }
+
+private:
+    // SoA box centers and extents, padded to a whole batch
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    std::vector<unsigned char> inside;
+};
+
+#endif
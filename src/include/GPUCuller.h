@@ -0,0 +1,77 @@
+#ifndef __GPU_CULLER_H__
+#define __GPU_CULLER_H__
+
+#include "GPUScene.h"
+#include "Light.h"
+#include "Shader.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+constexpr unsigned int CULL_GROUP_SIZE = 64;
+constexpr unsigned int HIZ_GROUP_SIZE = 8;
+
+// Per-light record for the cull pass, matches the std430 struct in Cull.cs
+struct GPULight {
+    glm::vec4 positionRange; // xyz = position, w = shadow far plane
+    unsigned int proxyObject; // Never casts into its own light, NO_OBJECT if none
+    unsigned int pad[3];
+};
+
+// GPU-driven visibility. A compute pass tests every object against the camera
+// frustum and last frame's hierarchical depth, and every caster against each
+// light's range and cube faces, then writes the survivors as indirect draws.
+class GPUCuller {
+public:
+    bool occlusionCulling = true;
+    // Skip casters whose shadow can't reach the camera frustum
+    bool shadowFrustumCulling = true;
+
+    GPUCuller(GPUScene &scene, const Shader *cullShader, const Shader *hiZShader);
+    ~GPUCuller() noexcept;
+
+    // Remove copying
+    GPUCuller(const GPUCuller&) = delete;
+    GPUCuller& operator=(const GPUCuller&) = delete;
+
+    void cull(const glm::mat4 &view, const glm::mat4 &projection, const std::vector<Light*> &lights);
+
+    // Draw the opaque survivors with a shader using Indirect.vs. Lights are
+    // bound by the caller, from texture unit MAX_TEXTURES.
+    void drawOpaque(const Shader &shader, const glm::mat4 &view, const glm::mat4 &projection) const;
+    // Draw the transparent survivors the same way, unsorted for order-independent blending
+    void drawTransparent(const Shader &shader, const glm::mat4 &view, const glm::mat4 &projection) const;
+    // Render every light's shadow map with a shader using ShadowIndirect.vs
+    void renderShadowMaps(const Shader &shadowShader, const std::vector<Light*> &lights) const;
+
+    // Build the depth pyramid from the current depth buffer, used by next frame's cull
+    void buildDepthPyramid(int width, int height);
+    // Skip the occlusion test until the pyramid is rebuilt
+    void invalidateDepthPyramid() noexcept { hiZValid = false; }
+
+private:
+    GPUScene &scene;
+    const Shader *cullShader = nullptr;
+    const Shader *hiZShader = nullptr;
+
+    unsigned int commandBuffer = 0;
+    unsigned int countBuffer = 0;
+    unsigned int faceMaskBuffer = 0;
+    unsigned int lightBuffer = 0;
+    size_t lightCapacity = 0;
+
+    // Camera depth copy and its max-reduced mip chain
+    unsigned int depthTexture = 0;
+    unsigned int hiZTexture = 0;
+    int hiZWidth = 0, hiZHeight = 0, hiZLevels = 0;
+    bool hiZValid = false;
+    glm::mat4 hiZViewProjection = glm::mat4(1.0f);
+
+    // Counted multi-draw needs GL 4.6, otherwise every object keeps a slot
+    bool compact = false;
+
+    void allocateLists(size_t lightCount);
+    void drawList(size_t list) const;
+    void drawCameraList(const Shader &shader, const glm::mat4 &view, const glm::mat4 &projection, size_t list) const;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef __GPU_SCENE_H__
+#define __GPU_SCENE_H__
+
+#include "Object.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <unordered_map>
+
+constexpr unsigned int OBJECT_USE_LIGHTING = 1u;
+constexpr unsigned int OBJECT_TRANSPARENT  = 2u; // Has translucent faces after opaqueVertexCount
+constexpr unsigned int NO_OBJECT = 0xFFFFFFFFu;
+
+// Per-object record, matches the std430 struct in the GPU-driven shaders
+struct GPUObject {
+    glm::mat4 model;
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    unsigned int firstVertex;
+    unsigned int vertexCount;
+    unsigned int flags;
+    unsigned int opaqueVertexCount; // Opaque faces first, then the translucent ones
+};
+
+// Matches DrawArraysIndirectCommand
+struct DrawCommand {
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int first;
+    unsigned int baseInstance;
+};
+
+// All scene geometry packed into one vertex buffer so it can be drawn
+// with a single multi-draw. The draw's baseInstance selects the object.
+class GPUScene {
+public:
+    unsigned int VAO = 0, VBO = 0;
+    unsigned int objectIDBuffer = 0;
+    unsigned int objectBuffer = 0;
+
+    std::vector<Object*> objects;
+    std::vector<GPUObject> gpuObjects;
+    std::vector<unsigned int> textures;
+    std::vector<unsigned int> uploadedVersions;
+    std::unordered_map<const Object*, unsigned int> objectIndices;
+
+    explicit GPUScene(const std::vector<Object*> &sceneObjects);
+    ~GPUScene() noexcept;
+
+    // Remove copying
+    GPUScene(const GPUScene&) = delete;
+    GPUScene& operator=(const GPUScene&) = delete;
+
+    // Upload the model matrices of the objects that moved, like the scene's
+    // movedObjects. Their transforms must already be up to date.
+    void update(const std::vector<Object*> &moved);
+    void bindTextures(const Shader &shader) const;
+
+    [[nodiscard]]
+    size_t size() const noexcept { return objects.size(); }
+    // Index of the object in the GPU arrays, or NO_OBJECT
+    [[nodiscard]]
+    unsigned int indexOf(const Object *object) const noexcept {
+        auto it = objectIndices.find(object);
+        return it != objectIndices.end() ? it->second : NO_OBJECT;
+    }
+
+private:
+    void upload(size_t first, size_t last);
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef __GPU_TIMER_H__
+#define __GPU_TIMER_H__
+
+#include <glad/gl.h>
+
+// GPU time between begin() and end(), from a ring of timer queries. Results
+// are read a few frames late so the CPU never waits on the GPU.
+class GPUTimer {
+public:
+    static const int QUERY_COUNT = 4;
+
+    GPUTimer() {
+        glGenQueries(QUERY_COUNT, queries);
+    }
+    ~GPUTimer() {
+        glDeleteQueries(QUERY_COUNT, queries);
+    }
+
+    // Remove copying
+    GPUTimer(const GPUTimer&) = delete;
+    GPUTimer& operator=(const GPUTimer&) = delete;
+
+    void begin() {
+        // Collect the oldest query before reusing it
+        if (pending[current]) {
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[current], GL_QUERY_RESULT, &nanoseconds);
+            totalMilliseconds += nanoseconds / 1e6;
+            samples++;
+            pending[current] = false;
+        }
+        glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+    }
+    void end() {
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[current] = true;
+        current = (current + 1) % QUERY_COUNT;
+    }
+
+    // Average over the samples collected since the last reset
+    [[nodiscard]]
+    double averageMilliseconds() const noexcept { return samples > 0 ? totalMilliseconds / samples : 0.0; }
+    void reset() noexcept {
+        totalMilliseconds = 0.0;
+        samples = 0;
+    }
+
+private:
+    unsigned int queries[QUERY_COUNT];
+    bool pending[QUERY_COUNT] = {};
+    int current = 0;
+    double totalMilliseconds = 0.0;
+    int samples = 0;
+};
+
+#endif
@@ -3,41 +3,246 @@
 
 #include "Camera.h"
 #include "Shader.h"
+#include "Bounds.h"
 #include <glm/glm.hpp>
+#include <array>
+#include <vector>
 
 class Object;
+class AABBTree;
+class ShadowPool;
+class Light;
 
-constexpr size_t MAX_LIGHTS = 16;
+// An object drawn into a shadow map, and the cube faces it reaches
+struct ShadowCaster {
+    Object *object;
+    unsigned int faceMask;
+    unsigned int transformVersion; // Object's version when selected
+
+    bool operator==(const ShadowCaster &other) const noexcept {
+        return object == other.object && faceMask == other.faceMask &&
+            transformVersion == other.transformVersion;
+    }
+};
+
+// One shadow map render a light needs this frame. Draws with pass 1 composite
+// over a cube its pass 0 draw filled, so every pass 0 draw must come first.
+struct ShadowDraw {
+    Light *light;
+    int layer;             // First cube face layer drawn into
+    int pass;              // 0 = drawn from scratch, 1 = over the restored static layer
+    unsigned int clearMask; // Faces cleared first
+    unsigned int copyMask;  // Faces restored from the light's static layer first
+    std::vector<ShadowCaster> casters; // Face masks limited to the faces being drawn
+};
+
+enum class ShadowPipeline {
+    GeometryShader, // Shadow.gs copies each triangle to the faces it reaches
+    VertexLayer,    // One instance per face, gl_Layer from the vertex shader
+    FacePasses      // Six single-face draws, no layered rendering
+};
+
+enum class LightType {
+    Point,      // Omnidirectional, cube or dual-paraboloid shadow map
+    Spot,       // Cone, one 2D perspective shadow map
+    Directional // Sun, cascaded orthographic shadow maps fit to the camera
+};
+
+enum class ShadowMode {
+    Auto,          // Dual-paraboloid once the light is far from the camera
+    Cube,          // Six cube faces
+    DualParaboloid // Two hemispheres, a third of the cube's draws at lower quality
+};
+
+// Shadow pass programs for each pipeline. vertexLayer is null when
+// ARB_shader_viewport_layer_array is missing, which falls back to FacePasses.
+struct ShadowShaders {
+    const Shader *geometry = nullptr;    // Shadow.vs + Shadow.gs
+    const Shader *vertexLayer = nullptr; // ShadowLayer.vs
+    const Shader *face = nullptr;        // ShadowFace.vs
+    const Shader *paraboloid = nullptr;  // ShadowParaboloid.vs, one hemisphere per pass
+    const Shader *ortho = nullptr;       // ShadowFace.vs + ShadowOrtho.fs, directional cascades
+    ShadowPipeline pipeline = ShadowPipeline::GeometryShader;
+
+    [[nodiscard]]
+    ShadowPipeline resolved() const noexcept {
+        if (pipeline == ShadowPipeline::VertexLayer && !vertexLayer) return ShadowPipeline::FacePasses;
+        return pipeline;
+    }
+};
+
+constexpr unsigned int LIGHT_BUFFER_BINDING = 5;  // SSBO binding of the lit shaders' lights
+constexpr unsigned int SHADOW_MATRIX_BINDING = 7; // SSBO of spot and cascade view-projections
+constexpr unsigned int MAX_CASCADES = 6;          // One per cube face of the light's slot
 constexpr float MIN_FAR_PLANE = 1.0f;
+// Distance attenuation 1 / (1 + linear * d + quadratic * d^2), matches Shader.fs
+constexpr float ATTENUATION_LINEAR = 0.09f;
+constexpr float ATTENUATION_QUADRATIC = 0.032f;
 constexpr float MAX_FAR_PLANE = 500.0f;
 
 class Light {
 public:
+    LightType type = LightType::Point;
     glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f); // Spot and directional, the way the light shines
     glm::vec3 color = glm::vec3(0.0f);
     float intensity = 1.0f;
 
-    const Shader *shader = nullptr;
-    unsigned int depthMapFBO = 0;
-    unsigned int depthCubemap = 0;
+    // Spot cone, full intensity inside the inner angle, none outside the outer (degrees)
+    float innerCone = 20.0f;
+    float outerCone = 30.0f;
+
+    // Directional cascades, split over the camera's view out to shadowDistance
+    unsigned int cascadeCount = 4;
+    float shadowDistance = 100.0f;
+
+    const ShadowShaders *shadowShaders = nullptr;
+    const Object *proxy = nullptr; // Visual marker at the light, never casts its shadow
+
+    // Shadow map slot, assigned by the ShadowPool every frame
+    ShadowPool *shadowPool = nullptr;
+    unsigned int shadowMapSize = 0; // Cube face size, 0 if the light has no shadow map
+    unsigned int shadowTexture = 0; // The pool's cubemap array
+    unsigned int depthMapFBO = 0;   // Layered FBO over the whole array
+    unsigned int faceFBO = 0;       // FBO for drawing one face at a time
+    int shadowTier = -1;            // Index of the pool's array, -1 if the light has no shadow map
+    int shadowLayer = 0;            // First cube face layer of the shadow map
+    int staticLayer = -1;           // First layer of the cached static casters, -1 if none
+    float shadowFade = 1.0f;        // How much of the shadow applies, eases in and out as the pool picks lights
+    int shadowMaskChannel = -1;     // Channel of the screen-space shadow mask, -1 if the lit shaders look up the map
+
+    ShadowMode shadowMode = ShadowMode::Auto; // Requested in the MAP file
+    bool dualParaboloid = false;              // Mode in use, faces 0 and 1 hold the +Y and -Y hemispheres
 
-    static const unsigned int SHADOW_MAP_SIZE = 8192;
     float shadowNearPlane = 0.01f;
     float shadowFarPlane  = 100.0f;
 
-    Light(glm::vec3 position, glm::vec3 color, float intensity, const Shader *shader);
-    ~Light() noexcept;
+    Light(glm::vec3 position, glm::vec3 color, float intensity, const ShadowShaders *shadowShaders);
 
-    // Remove copying
+    // Remove copying, the pool tracks lights by address
     Light(const Light&) = delete;
     Light& operator=(const Light&) = delete;
 
-    // Allow moving
-    Light(Light&& other) noexcept;
-    Light& operator=(Light&& other) noexcept;
-
     float calculateFarPlane() const;
-    void renderShadowMap(const std::vector<Object*> &sceneObjects);
+    // Distance beyond which the light adds under half an 8-bit step, for
+    // light culling. Negative for directional lights, which reach everywhere.
+    [[nodiscard]]
+    float lightRange() const noexcept;
+    // Switch between cube and dual-paraboloid maps, a switch redraws the map
+    void setDualParaboloid(bool enabled) noexcept;
+    // Cube faces, hemispheres, the spot map or cascades the light draws.
+    // Each takes one face layer of the light's slot.
+    [[nodiscard]]
+    unsigned int shadowFaceCount() const noexcept;
+    [[nodiscard]]
+    unsigned int allFacesMask() const noexcept { return (1u << shadowFaceCount()) - 1; }
+    // Fit the directional cascades to the camera, snapped to whole shadow map
+    // texels so they don't shimmer as the camera moves
+    void fitCascades(const Camera &camera);
+    // View-projection of each face: the cube faces in GL cubemap face order,
+    // the spot's perspective or the cascades. Unused entries are identity.
+    [[nodiscard]]
+    std::array<glm::mat4, 6> shadowMatrices() const;
+    // Bind the FBO and set the cube face matrices on a shadow pass shader
+    void beginShadowPass(const Shader &passShader) const;
+    // Collect casters in range and the faces (or hemispheres) they touch, in object order.
+    // With a camera frustum, casters whose shadow can't reach the view are skipped too.
+    void selectCasters(const AABBTree &tree, const Frustum *cameraFrustum,
+        std::vector<ShadowCaster> &casters) const;
+    // Select this frame's casters and find the cube faces that are out of date.
+    // Returns the dirty face mask.
+    unsigned int prepareShadowUpdate(const AABBTree &tree, const Frustum *cameraFrustum);
+    // Queue the renders that bring the given dirty faces up to date, the rest
+    // keep their old depth until scheduled. Static casters are cached, dynamic
+    // ones are composited over the cached layer. The draws are run by
+    // drawShadow() or batched across lights by a ShadowBatch.
+    // Returns the number of caster faces queued.
+    unsigned int updateShadowMap(unsigned int faceMask, std::vector<ShadowDraw> &draws);
+    // Clear and restore the draw's faces, ready for its casters
+    void beginShadowDraw(const ShadowDraw &draw) const;
+    // Run one of this light's draws with the selected pipeline, returns the draw calls issued
+    unsigned int drawShadow(const ShadowDraw &draw) const;
+    // Force a full re-render on the next update
+    void invalidateShadowMap() noexcept;
+
+    // Faces found out of date by the last prepareShadowUpdate()
+    [[nodiscard]]
+    unsigned int dirtyFaceMask() const noexcept { return dirtyFaces; }
+    // Faces never drawn since the last invalidation, they're cleared until drawn
+    [[nodiscard]]
+    unsigned int unrenderedFaceMask() const noexcept;
+    // Updates the face has been dirty for without being drawn
+    [[nodiscard]]
+    unsigned int faceStaleness(int face) const noexcept { return faceCache[face].staleFrames; }
+
+private:
+    // What each cached cube face was rendered with
+    struct FaceCache {
+        bool valid = false;       // Drawn since the last invalidation
+        bool staticValid = false; // The static layer's face holds staticCasters
+        glm::mat4 matrix = glm::mat4(1.0f);
+        glm::vec3 position = glm::vec3(0.0f);
+        float intensity = 0.0f;
+        float nearPlane = 0.0f;
+        float farPlane = 0.0f;
+        std::vector<ShadowCaster> staticCasters;  // Masks limited to this face
+        std::vector<ShadowCaster> dynamicCasters;
+        unsigned int staleFrames = 0;
+    };
+    std::array<FaceCache, 6> faceCache;
+
+    // Casters selected by prepareShadowUpdate(), and the faces they leave out of date
+    std::vector<ShadowCaster> selectedStatic;
+    std::vector<ShadowCaster> selectedDynamic;
+    unsigned int dirtyFaces = 0;
+    unsigned int staticDirtyFaces = 0;
+
+    // Set by fitCascades()
+    std::array<glm::mat4, MAX_CASCADES> cascadeMatrices;
+
+    void clearShadowFaces(int layer, unsigned int faceMask) const;
+    void setShadowUniforms(const Shader &passShader, int layer) const;
+    // Draw casters into the cube starting at layer with the selected pipeline
+    unsigned int drawCasters(const std::vector<ShadowCaster> &casters, int layer) const;
+};
+
+// Per-light record for the lit shaders, matches the std430 struct in Shader.fs
+struct LightData {
+    glm::vec4 positionRange;  // xyz = position, w = shadow far plane, 0 without a shadow map
+    glm::vec4 colorIntensity; // rgb = color, a = intensity
+    glm::vec4 direction;      // xyz = direction the light shines, w = cosine of the spot's outer cone
+    int shadowTier;           // Which shadowMaps[] array holds the light's cubemap
+    int shadowCube;           // Cube index in that array
+    int shadowMode;           // 0 = cube, 1 = dual-paraboloid in the cube's +X and -X faces
+    int type;                 // LightType
+    int matrixIndex;          // First of the spot's or cascades' matrices in the matrix SSBO
+    int cascadeCount;
+    float cosInnerCone;
+    float shadowFade;         // Shadow strength while the light gains or loses its map
+    int shadowMaskChannel;    // ShadowMask channel holding the resolved shadow, -1 for none
+    int pad[3];
+};
+
+// Every light's shading data in one SSBO. Uploaded once per frame and bound
+// once per pass, together with the shadow pool's arrays.
+class LightBuffer {
+public:
+    unsigned int buffer = 0;
+    unsigned int matrixBuffer = 0;
+    size_t capacity = 0;
+    size_t matrixCapacity = 0;
+    size_t count = 0;
+
+    LightBuffer();
+    ~LightBuffer() noexcept;
+
+    // Remove copying
+    LightBuffer(const LightBuffer&) = delete;
+    LightBuffer& operator=(const LightBuffer&) = delete;
+
+    void upload(const std::vector<Light*> &lights);
+    // Bind the SSBO and the shadow maps, starting at the given texture unit
+    void bind(const Shader &shader, const ShadowPool &pool, int textureUnit) const;
 };
 
 #endif
\ No newline at end of file
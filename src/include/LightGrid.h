@@ -0,0 +1,64 @@
+#ifndef __LIGHT_GRID_H__
+#define __LIGHT_GRID_H__
+
+#include "Light.h"
+#include "Shader.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// Froxels of the view frustum: screen tiles by exponential depth slices
+constexpr unsigned int CLUSTER_X = 16;
+constexpr unsigned int CLUSTER_Y = 9;
+constexpr unsigned int CLUSTER_Z = 24;
+constexpr unsigned int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+
+constexpr unsigned int LIGHT_GRID_BINDING = 8;  // uvec2 (offset, count) per cluster, then the unbounded lights
+constexpr unsigned int LIGHT_INDEX_BINDING = 9; // Light indices the ranges point into
+
+// Clustered light assignment. Every frame each light's range sphere is tested
+// against the view-space bounds of the clusters in its depth slices, 4 at a
+// time with SSE, and the hits become compact per-cluster index lists for
+// Shader.fs. Directional lights reach everywhere and go in one extra list
+// every fragment walks.
+class LightGrid {
+public:
+    LightGrid();
+    ~LightGrid() noexcept;
+
+    // Remove copying
+    LightGrid(const LightGrid&) = delete;
+    LightGrid& operator=(const LightGrid&) = delete;
+
+    // Assign the lights, in LightBuffer order, and upload the lists
+    void build(const std::vector<Light*> &lights, const glm::mat4 &view, const glm::mat4 &projection,
+        float nearPlane, float farPlane);
+    // Bind the lists and the cluster lookup uniforms for a viewport
+    void bind(const Shader &shader, int width, int height) const;
+
+    // Light references across all clusters from the last build
+    [[nodiscard]]
+    size_t lightReferences() const noexcept { return indices.size(); }
+    // Clusters holding at least one light
+    [[nodiscard]]
+    size_t occupiedClusters() const noexcept { return occupied; }
+
+private:
+    unsigned int gridBuffer = 0;
+    unsigned int indexBuffer = 0;
+    size_t indexCapacity = 0;
+
+    // View-space cluster bounds in SoA, rebuilt when the projection changes
+    glm::mat4 clusterProjection = glm::mat4(0.0f);
+    float clusterNear = 0.0f;
+    float clusterFar = 0.0f;
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+    std::vector<glm::uvec2> ranges; // CLUSTER_COUNT + 1 entries
+    std::vector<unsigned int> indices;
+    std::vector<unsigned int> hits; // (cluster, light) pairs of the current build
+    size_t occupied = 0;
+
+    void buildClusters(const glm::mat4 &projection, float nearPlane, float farPlane);
+};
+
+#endif
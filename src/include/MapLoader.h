@@ -3,15 +3,23 @@
 
 #include "Object.h"
 #include "Light.h"
+#include "AABBTree.h"
 #include <vector>
 #include <memory>
 
 struct Scene {
+    // Move the tree leaves of objects whose transform changed, listing them in movedObjects
+    void updateSpatialIndex();
+
     // Raw pointers
     std::vector<Object*> sceneObjects;
     std::vector<Light*> sceneLights;
     std::vector<Object*> opaqueObjects;
     std::vector<Object*> transparentObjects;
+    std::vector<Object*> movedObjects; // Since the last updateSpatialIndex()
+
+    // Spatial index over sceneObjects
+    AABBTree objectTree;
 
     // Ownership
     std::vector<std::unique_ptr<Object>> objectOwnership;
@@ -21,7 +29,7 @@ struct Scene {
 class MAPLoader {
 public:
     [[nodiscard]]
-    static Scene loadMAP(const std::string &path, const Shader &shader, const Shader &shadowShader);
+    static Scene loadMAP(const std::string &path, const Shader &shader, const ShadowShaders &shadowShaders);
 };
 
 #endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define __OBJLOADER_H__
 
 #include "Material.h"
+#include "Bounds.h"
 #include <vector>
 #include <string>
 
@@ -20,6 +21,9 @@ class OBJLoader {
 public:
     [[nodiscard]]
     static std::vector<Face> loadOBJ(const std::string &path);
+
+    // Local AABB and bounding sphere of a loaded mesh
+    static void computeBounds(const std::vector<Face> &faces, AABB &box, Sphere &sphere);
 };
 
 #endif
@@ -3,26 +3,53 @@
 
 #include "Shader.h"
 #include "Light.h"
+#include "Bounds.h"
 #include <glm/glm.hpp>
 #include <vector>
 
 const size_t OBJECT_STRIDE = 13; // Floats per vertex
 const size_t MAX_TEXTURES = 16;
 
+// Which of an object's vertex ranges to draw
+enum class ObjectPart {
+    All,
+    Opaque,     // Faces with full opacity, first in the vertices
+    Transparent // The translucent faces after them
+};
+
+// Whether an object's opaque faces hide what's behind them in the OcclusionCuller
+enum class OccluderMode {
+    Auto, // When large enough on screen
+    On,   // Whenever in view, ahead of the automatic ones
+    Off
+};
+
 class Object {
 public:
     const Shader* shader = nullptr;
     unsigned int VAO = 0, VBO = 0;
-    bool hasTransparency = false;
+    bool hasTransparency = false; // Has translucent faces, drawn in the blended pass
+    size_t opaqueVertexCount = 0; // Vertices of the opaque faces, the translucent ones follow
 
     std::vector<float> vertices;
     std::vector<unsigned int> textures;
 
+    // Local bounds from the loader, world bounds follow the transform
+    AABB localBounds;
+    Sphere localSphere;
+    AABB worldBounds;
+    Sphere worldSphere;
+    unsigned int transformVersion = 0; // Bumped whenever the world bounds change
+    int spatialProxy = -1;             // Leaf in the scene's AABBTree
+
     glm::vec3 position = glm::vec3(0.0f);
     glm::vec3 rotation = glm::vec3(0.0f);
     glm::vec3 scale = glm::vec3(1.0f);
 
     bool useLighting = true;
+    bool isStatic = true; // Static casters stay in the cached shadow layer
+    OccluderMode occluder = OccluderMode::Auto;
+    unsigned int sceneIndex = 0; // Index in the GPUScene arrays, set by the GPUScene
 
     Object(const std::string &path, const Shader *shader);
     ~Object() noexcept;
@@ -35,8 +62,33 @@ public:
     Object(Object&& other) noexcept;
     Object& operator=(Object&& other) noexcept;
 
+    [[nodiscard]]
+    size_t vertexCount() const noexcept { return vertices.size() / OBJECT_STRIDE; }
+    [[nodiscard]]
+    bool hasOpaque() const noexcept { return opaqueVertexCount > 0; }
+
     glm::mat4 GetModelMatrix() const noexcept;
-    void draw(const glm::mat4 view, const glm::mat4 projection, std::vector<Light*> &sceneLight) const;
+    // Refresh the world bounds if position, rotation or scale changed.
+    // Returns true if they did.
+    bool updateTransform() noexcept;
+    void draw(const glm::mat4 view, const glm::mat4 projection, ObjectPart part = ObjectPart::All) const;
+    // Draw with another program taking the same inputs, like the G-buffer pass
+    void draw(const glm::mat4 view, const glm::mat4 projection, const Shader &passShader,
+        ObjectPart part = ObjectPart::All) const;
+    // Draw the vertices an index buffer lists, in its order, like a TriangleSorter's
+    void drawIndexed(const glm::mat4 view, const glm::mat4 projection, unsigned int indexBuffer,
+        size_t indexCount) const;
+
+private:
+    // Set the pass shader's per-object uniforms and bind the textures and VAO
+    void beginDraw(const glm::mat4 &view, const glm::mat4 &projection, const Shader &passShader) const;
+    void endDraw() const;
+
+    // Transform the world bounds were last computed for
+    bool transformValid = false;
+    glm::vec3 boundsPosition = glm::vec3(0.0f);
+    glm::vec3 boundsRotation = glm::vec3(0.0f);
+    glm::vec3 boundsScale = glm::vec3(1.0f);
 };
 
 #endif
\ No newline at end of file
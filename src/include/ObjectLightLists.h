@@ -0,0 +1,63 @@
+#ifndef __OBJECT_LIGHT_LISTS_H__
+#define __OBJECT_LIGHT_LISTS_H__
+
+#include "GPUScene.h"
+#include "Light.h"
+#include "Shader.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+constexpr unsigned int OBJECT_LIGHT_RANGE_BINDING = 10; // uvec2 (offset, count) per scene object
+constexpr unsigned int OBJECT_LIGHT_INDEX_BINDING = 11; // Light indices the ranges point into
+
+// Which lights a forward shaded fragment loops over, matches LIGHT_CULLING_* in Shader.fs
+enum class LightCulling {
+    None,      // Every light
+    Clustered, // The lights of the fragment's LightGrid cluster
+    PerObject  // The object's ObjectLightLists entry
+};
+
+// Per-object light lists. Every frame each lit object's world bounds are
+// tested against all light range spheres, 4 at a time with SSE. The hits are
+// ranked by their estimated contribution at the closest point of the bounds,
+// and the strongest maxLightsPerObject are kept. Lists are indexed by the
+// object's GPUScene index, which both draw paths pass to Shader.fs.
+class ObjectLightLists {
+public:
+    unsigned int maxLightsPerObject = 8; // Top K, the weakest beyond it are dropped
+
+    explicit ObjectLightLists(const GPUScene &scene);
+    ~ObjectLightLists() noexcept;
+
+    // Remove copying
+    ObjectLightLists(const ObjectLightLists&) = delete;
+    ObjectLightLists& operator=(const ObjectLightLists&) = delete;
+
+    // Assign the lights, in LightBuffer order, to the objects and upload the
+    // lists. Objects not in the list get none.
+    void build(const std::vector<Object*> &objects, const std::vector<Light*> &lights);
+    void bind() const;
+
+    // Light references across all lists from the last build
+    [[nodiscard]]
+    size_t lightReferences() const noexcept { return indices.size(); }
+    // Lights dropped by the top K cap in the last build
+    [[nodiscard]]
+    size_t droppedLights() const noexcept { return dropped; }
+
+private:
+    const GPUScene &scene;
+    unsigned int rangeBuffer = 0;
+    unsigned int indexBuffer = 0;
+    size_t indexCapacity = 0;
+
+    // Range spheres in SoA, padded to 4 with spheres nothing reaches
+    std::vector<float> lightX, lightY, lightZ, lightRange2;
+    std::vector<unsigned int> unbounded; // Directional lights, in every list
+
+    std::vector<glm::uvec2> ranges;
+    std::vector<unsigned int> indices;
+    size_t dropped = 0;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef __OCCLUSION_BUFFER_H__
+#define __OCCLUSION_BUFFER_H__
+
+#include "Bounds.h"
+#include "WorkerPool.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+constexpr int OCCLUSION_TILE_SIZE = 8;         // Pixels per side of a hierarchy tile
+constexpr float OCCLUSION_DEPTH_BIAS = 1e-3f;  // Relative distance a tested box is pulled closer by
+constexpr size_t OCCLUSION_TRIANGLES_PER_WORKER = 512;
+constexpr size_t OCCLUSION_TILE_ROWS_PER_WORKER = 2;
+
+// Low resolution software depth buffer for occlusion culling. Occluder
+// triangles are clipped to the near plane and rasterized 4 pixels at a time
+// with SSE, split into bands of tile rows across the worker pool. Each pixel
+// keeps the nearest 1/w, which interpolates linearly in screen space, and each
+// 8x8 tile the farthest of its pixels, so most box tests stop at the tiles.
+// Needs no GL context. The result doesn't depend on the number of workers or
+// the order occluders were added in.
+class OcclusionBuffer {
+public:
+    OcclusionBuffer(WorkerPool &workers, int width, int height);
+
+    // Start a frame from the camera's view-projection, dropping last frame's occluders
+    void begin(const glm::mat4 &viewProjection);
+    // Queue object-space triangles, 3 points each, drawn with the model matrix.
+    // They're read in rasterize(), which must come before they change.
+    void addOccluder(const std::vector<glm::vec3> &triangles, const glm::mat4 &model);
+    // Draw the queued occluders and build the tile hierarchy
+    void rasterize();
+
+    // False if every pixel the box could cover is nearer than the box
+    [[nodiscard]]
+    bool isVisible(const AABB &box) const noexcept;
+
+    [[nodiscard]]
+    int width() const noexcept { return bufferWidth; }
+    [[nodiscard]]
+    int height() const noexcept { return bufferHeight; }
+    // Nearest 1/w per pixel, rows from the bottom, 0 where nothing was drawn
+    [[nodiscard]]
+    const std::vector<float> &depth() const noexcept { return pixels; }
+    // Triangles left after clipping and backface culling in the last rasterize()
+    [[nodiscard]]
+    size_t rasterizedTriangles() const noexcept { return triangles.size(); }
+
+private:
+    // Screen space triangle with edge and 1/w plane equations over pixel coordinates
+    struct Triangle {
+        float edgeA[3], edgeB[3], edgeC[3]; // Inside where all three A x + B y + C >= 0
+        float depthA, depthB, depthC;       // 1/w = A x + B y + C
+        int minX, maxX, minY, maxY;         // Pixel bounds, clamped to the buffer
+    };
+    struct Occluder {
+        const std::vector<glm::vec3> *triangles;
+        glm::mat4 modelViewProjection;
+    };
+
+    WorkerPool &workers;
+    int bufferWidth, bufferHeight;
+    int tilesX, tilesY;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+
+    std::vector<Occluder> occluders;
+    std::vector<size_t> occluderFirst; // Prefix sum of the occluders' triangle counts
+    std::vector<std::vector<Triangle>> workerTriangles;
+    std::vector<Triangle> triangles;
+
+    std::vector<float> pixels; // Nearest 1/w
+    std::vector<float> tiles;  // Farthest 1/w of each tile's pixels
+
+    // Clip against the near plane and append the 0 to 2 front facing pieces
+    void setupTriangle(const glm::vec4 clip[3], std::vector<Triangle> &out) const;
+    void addScreenTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c,
+        std::vector<Triangle> &out) const;
+    void rasterizeRows(int beginRow, int endRow);
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef __OCCLUSION_CULLER_H__
+#define __OCCLUSION_CULLER_H__
+
+#include "Object.h"
+#include "OcclusionBuffer.h"
+#include "WorkerPool.h"
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+struct OcclusionCullerSettings {
+    int width = 256, height = 128;     // Depth buffer resolution
+    size_t maxOccluders = 16;          // Largest on screen first, designated ones ahead of them
+    size_t maxTriangles = 8192;        // Occluder triangles per frame
+    float minScreenSize = 0.1f;        // Bounding sphere radius over distance for automatic occluders
+    // Meshes up to this many opaque triangles are their own occluder, bigger
+    // ones are replaced by boxes inside their voxelized interior
+    size_t maxMeshTriangles = 1024;
+    int voxelResolution = 24;          // Cells along the longest side of the bounds
+    size_t maxBoxes = 32;              // Largest inner boxes kept per object
+    size_t minObjectsPerWorker = 64;   // Box tests per worker below which they stay on one thread
+};
+
+// CPU occlusion culling. Each frame the largest occluders in view are drawn
+// into an OcclusionBuffer, then the frustum culled objects' world bounds are
+// tested against it. Occluder meshes are built once per object: small meshes
+// are used as they are, others are simplified into boxes that stay inside the
+// mesh, so they never hide more than the real surface. Shadow casters aren't
+// culled, their shadows can still fall into view.
+class OcclusionCuller {
+public:
+    struct Stats {
+        size_t occluders = 0;
+        size_t triangles = 0; // Rasterized after clipping and backface culling
+        size_t tested = 0;
+        size_t occluded = 0;
+        double milliseconds = 0.0;
+    };
+    Stats stats;
+    OcclusionCullerSettings settings;
+
+    explicit OcclusionCuller(WorkerPool &workers, const OcclusionCullerSettings &settings = OcclusionCullerSettings());
+
+    // Remove copying
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    // Append the objects not hidden by the occluders among them to visible,
+    // in their order
+    void cull(const glm::mat4 &viewProjection, const glm::vec3 &cameraPos,
+        const std::vector<Object*> &objects, std::vector<Object*> &visible);
+    void resetStats() noexcept { stats = Stats(); }
+
+    [[nodiscard]]
+    const OcclusionBuffer &buffer() const noexcept { return depthBuffer; }
+
+private:
+    WorkerPool &workers;
+    OcclusionBuffer depthBuffer;
+    // Object-space occluder triangles, empty for objects that can't occlude
+    std::unordered_map<const Object*, std::vector<glm::vec3>> meshes;
+
+    struct Candidate {
+        const Object *object;
+        const std::vector<glm::vec3> *mesh;
+        bool designated; // Ranked above every automatic one
+        float size;      // Bounding sphere radius over distance
+    };
+    std::vector<Candidate> candidates;
+    std::vector<unsigned char> visibleFlags;
+
+    const std::vector<glm::vec3> &meshFor(const Object &object);
+    void buildInnerBoxes(const Object &object, std::vector<glm::vec3> &triangles) const;
+};
+
+#endif
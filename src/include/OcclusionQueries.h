@@ -0,0 +1,124 @@
+#ifndef __OCCLUSION_QUERIES_H__
+#define __OCCLUSION_QUERIES_H__
+
+#include "AABBTree.h"
+#include "Object.h"
+#include "Shader.h"
+#include <glm/glm.hpp>
+#include <deque>
+#include <functional>
+#include <vector>
+
+// How the CPU draw path hides objects behind others
+enum class OcclusionCulling {
+    Off,
+    Software, // OcclusionCuller's CPU depth buffer
+    Queries   // OcclusionQueries, GPU occlusion queries over the scene's AABBTree
+};
+
+struct OcclusionQuerySettings {
+    // Frames between re-checks of a visible leaf, each leaf at its own offset
+    unsigned int visibleQueryInterval = 8;
+    // Distance in near planes within which the camera counts as inside a box,
+    // whose query the near plane could clip away
+    float nearMargin = 2.0f;
+};
+
+// Coherent hierarchical culling with hardware occlusion queries, after
+// CHC++. The AABBTree is walked nearer child first, reusing each node's
+// visibility from earlier frames:
+// - Visible leaves are drawn, and their pre-pass depth draw is queried now
+//   and then to notice when they become hidden.
+// - Hidden nodes end the walk. Their boxes are queried against the finished
+//   pre-pass depth in one batch, and the leaves under them are still drawn,
+//   under conditional rendering on this frame's query, so nothing pops in.
+// - Results are read whenever they're available, never waited for. A node
+//   whose children are all hidden becomes hidden itself, and a hidden node
+//   found visible has its subtree walked again from the next frame.
+// - When the tree changes, only the nodes whose subtree changed start over,
+//   so a moving object doesn't throw away the rest of the history.
+// Queries use GL_ANY_SAMPLES_PASSED_CONSERVATIVE.
+class OcclusionQueries {
+public:
+    struct Stats {
+        size_t visited = 0;       // Tree nodes walked
+        size_t hidden = 0;        // Leaves drawn only under conditional rendering
+        size_t boxQueries = 0;
+        size_t geometryQueries = 0;
+        size_t pending = 0;       // Queries still waiting for results at the start of the frame
+    };
+    Stats stats;
+    OcclusionQuerySettings settings;
+
+    OcclusionQueries(const Shader *boxShader, const OcclusionQuerySettings &settings = OcclusionQuerySettings());
+    ~OcclusionQueries() noexcept;
+
+    // Remove copying
+    OcclusionQueries(const OcclusionQueries&) = delete;
+    OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+
+    // Read the results that arrived and walk the tree, appending the leaves
+    // in the frustum that are visible or being tested, nearest first. Leaves
+    // potentiallyVisible rejects are skipped, neither drawn nor queried.
+    // Returns how many leaves the walk reached in the frustum.
+    size_t cull(const AABBTree &tree, const Frustum &frustum, const glm::vec3 &cameraPos,
+        float nearPlane, std::vector<Object*> &visible,
+        const std::function<bool(const Object&)> &potentiallyVisible = nullptr);
+    // Pre-pass depth of the leaves known to be visible, querying those due for a re-check
+    void drawDepth(const glm::mat4 &view, const glm::mat4 &projection, const Shader &depthShader);
+    // After the pre-pass: query the hidden nodes' boxes against its depth,
+    // then add the hidden leaves' depth, drawn if their query passes
+    void queryHidden(const glm::mat4 &view, const glm::mat4 &projection, const Shader &depthShader);
+
+    // Wrap an object's draws this frame: if its bounds were queried, starts
+    // conditional rendering on the query and returns true, to be matched by
+    // endConditional()
+    bool beginConditional(const Object &object) const;
+    void endConditional() const;
+
+    void resetStats() noexcept { stats = Stats(); }
+
+private:
+    struct NodeState {
+        unsigned int version = 0;       // The tree node's version the state belongs to
+        bool visible = true;
+        unsigned int visitedFrame = 0;
+        unsigned int resultFrame = 0;   // Frame the applied result was queried in
+        unsigned int query = 0;         // Bounds query its draws are conditional on, from queryFrame
+        unsigned int queryFrame = 0;
+    };
+    struct PendingQuery {
+        unsigned int id;
+        int node;
+        unsigned int frame;
+        unsigned int nodeVersion;
+    };
+
+    const Shader *boxShader;
+    const AABBTree *tree = nullptr;
+    unsigned int frame = 1; // Node states visited in frame 0 were never visited
+
+    std::vector<NodeState> nodes;
+    std::deque<PendingQuery> pending;
+    std::vector<unsigned int> freeQueries;
+
+    // This frame's walk
+    std::vector<int> visibleLeaves; // Drawn normally
+    std::vector<int> checkedLeaves; // Of those, re-checked with a query on their depth draw
+    std::vector<int> hiddenLeaves;  // Drawn conditionally
+    std::vector<int> hiddenConditions; // Per hidden leaf, the queried node its draws wait on
+    std::vector<int> boxNodes;      // Queried by their bounds, the hidden ones and the visible leaves without depth
+
+    std::vector<int> stack, subtree;
+    unsigned int boxVAO = 0, boxVBO = 0;
+    std::vector<float> boxData; // Center and extents per queried box
+
+    // The node's state, reset when its subtree changed since it was kept
+    NodeState &state(int node);
+    unsigned int acquireQuery();
+    void issue(unsigned int query, int node);
+    void collectResults();
+    void applyResult(int node, bool visible);
+};
+
+#endif
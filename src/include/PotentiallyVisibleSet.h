@@ -0,0 +1,91 @@
+#ifndef __POTENTIALLY_VISIBLE_SET_H__
+#define __POTENTIALLY_VISIBLE_SET_H__
+
+#include "MapLoader.h"
+#include "WorkerPool.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+constexpr uint32_t PVS_FILE_VERSION = 1;
+constexpr size_t PVS_LEAF_TRIANGLES = 4; // Triangles per leaf of the bake's ray tracing hierarchy
+
+struct PVSSettings {
+    float cellSize = 2.0f;           // View cell side, grown when the map would need more than maxCells
+    size_t maxCells = 65536;
+    int padding = 1;                 // Cells around the static bounds, the camera can stand there too
+    size_t raysPerCell = 1024;       // From random points in the cell in random directions
+    size_t raysPerObject = 4;        // Per cell, at random points in each nearby static object's bounds
+    float objectRayDistance = 32.0f; // Objects further from the cell only get the random rays
+    size_t objectRaysPerCell = 1024; // Nearby objects beyond this budget are a random subset of them
+    int dilation = 1;                // Cells also see what their neighbours this many cells away see
+    size_t minCellsPerWorker = 4;
+};
+
+// Precomputed potentially visible sets for a map's static objects. The map's
+// bounds are split into a grid of view cells, and rays from random points in
+// each cell mark the objects whose front faces they hit first, translucent
+// faces letting them through. A few more rays aim at the objects near the
+// cell, which random directions easily miss. Objects touching a cell are
+// always in its set, and each set is merged with its neighbours' to cover
+// what the samples missed. The bake runs on the worker pool and is written
+// next to the map, each cell's bitset zero run-length compressed and
+// identical ones shared. At runtime the camera's cell gives its set,
+// decompressed only when the cell changes. Dynamic objects aren't baked,
+// every set includes them.
+class PotentiallyVisibleSet {
+public:
+    PVSSettings settings;
+
+    // Load the sidecar next to the map (map.pvs for map.map) if it was baked
+    // for this map and these settings, otherwise bake and write it.
+    // False when the map has no static objects.
+    bool loadOrBake(const std::string &mapPath, const Scene &scene, WorkerPool &workers);
+
+    // Select the cell the position is in. False outside the grid or without
+    // a bake, where anything can be visible.
+    bool update(const glm::vec3 &position);
+    // The current cell's static objects, then every dynamic one, in scene order
+    [[nodiscard]]
+    const std::vector<Object*> &visibleObjects() const noexcept { return visible; }
+    [[nodiscard]]
+    bool isVisible(const Object &object) const noexcept;
+
+    [[nodiscard]]
+    bool baked() const noexcept { return !offsets.empty(); }
+    // Cell index, -1 when update() returned false
+    [[nodiscard]]
+    int currentCell() const noexcept { return current; }
+    [[nodiscard]]
+    size_t cellCount() const noexcept { return offsets.size(); }
+    [[nodiscard]]
+    size_t compressedBytes() const noexcept { return data.size(); }
+
+private:
+    // Grid
+    glm::vec3 origin = glm::vec3(0.0f);
+    float cellSize = 1.0f;
+    glm::ivec3 dims = glm::ivec3(0);
+
+    std::vector<Object*> staticObjects;  // Bit i of a cell's set is staticObjects[i]
+    std::vector<Object*> dynamicObjects;
+    std::unordered_map<const Object*, size_t> staticIndex;
+    size_t rowBytes = 0;
+
+    std::vector<uint32_t> offsets; // Per cell, where its compressed set starts in data
+    std::vector<uint8_t> data;
+
+    int current = -1;
+    std::vector<uint8_t> row; // The current cell's set
+    std::vector<Object*> visible;
+
+    uint64_t bakeKey(const std::string &mapPath) const;
+    void setupGrid();
+    void bake(WorkerPool &workers);
+    bool load(const std::string &path, uint64_t key);
+    bool save(const std::string &path, uint64_t key) const;
+};
+
+#endif
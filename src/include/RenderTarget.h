@@ -0,0 +1,23 @@
+#ifndef __RENDER_TARGET_H__
+#define __RENDER_TARGET_H__
+
+#include <glad/gl.h>
+
+// Single level screen texture for a framebuffer attachment, read back texel
+// for texel. With layers it's a 2D array, one attachment per layer.
+inline unsigned int createRenderTarget(GLenum format, int width, int height, int layers = 0) {
+    GLenum target = layers > 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(target, texture);
+    if (layers > 0) glTexStorage3D(target, 1, format, width, height, layers);
+    else glTexStorage2D(target, 1, format, width, height);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(target, 0);
+    return texture;
+}
+
+#endif
@@ -14,9 +14,11 @@
 class Shader {
 public:
     unsigned int ID;
-    // Constructor generates the shader on the fly
+    // Constructor generates the shader on the fly. Fragment libraries are
+    // compiled as further fragment shaders, for functions shared between programs.
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr) {
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+        const std::vector<const char*> &fragmentLibraryPaths = {}) {
         std::string vertexCode, fragmentCode;
         std::ifstream vShaderFile, fShaderFile;
 
@@ -88,6 +90,35 @@ public:
             glAttachShader(ID, geom);
         }
 
+        std::vector<unsigned int> libraries;
+        for (const char* fragmentLibraryPath : fragmentLibraryPaths) {
+            std::string libraryCode;
+            std::ifstream lShaderFile;
+
+            // Ensure ifstream objects can throw exceptions:
+            lShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+            try {
+                lShaderFile.open(fragmentLibraryPath);
+                std::stringstream lShaderStream;
+
+                lShaderStream << lShaderFile.rdbuf();
+                lShaderFile.close();
+                libraryCode = lShaderStream.str();
+            }
+            catch (std::ifstream::failure& e) {
+                std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            }
+            const char* lShaderCode = libraryCode.c_str();
+
+            unsigned int library = glCreateShader(GL_FRAGMENT_SHADER);
+            glShaderSource(library, 1, &lShaderCode, NULL);
+            glCompileShader(library);
+            checkCompileErrors(library, "FRAGMENT");
+
+            glAttachShader(ID, library);
+            libraries.push_back(library);
+        }
+
         // Link program
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
@@ -98,6 +129,42 @@ public:
         glDeleteShader(vertex);
         glDeleteShader(fragment);
         if (geometryPath) glDeleteShader(geom);
+        for (unsigned int library : libraries) glDeleteShader(library);
+    }
+    // Constructor for a compute-only program
+    // ------------------------------------------------------------------------
+    explicit Shader(const char* computePath) {
+        std::string computeCode;
+        std::ifstream cShaderFile;
+
+        // Ensure ifstream objects can throw exceptions
+        cShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        try {
+            cShaderFile.open(computePath);
+            std::stringstream cShaderStream;
+
+            cShaderStream << cShaderFile.rdbuf();
+            cShaderFile.close();
+            computeCode = cShaderStream.str();
+        }
+        catch (std::ifstream::failure& e) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+        }
+        const char* cShaderCode = computeCode.c_str();
+
+        // Compute shader
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, NULL);
+        glCompileShader(compute);
+        checkCompileErrors(compute, "COMPUTE");
+
+        // Link program
+        ID = glCreateProgram();
+        glAttachShader(ID, compute);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+
+        glDeleteShader(compute);
     }
     // Activate the shader
     // ------------------------------------------------------------------------
@@ -126,6 +193,11 @@ public:
         glUniform1iv(glGetUniformLocation(ID, name.c_str()), values.size(), values.data());
     }
     // ------------------------------------------------------------------------
+    void setUInt(const std::string &name, unsigned int value) const
+    {
+        glUniform1ui(glGetUniformLocation(ID, name.c_str()), value);
+    }
+    // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     {
         glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
@@ -0,0 +1,76 @@
+#ifndef __SHADOW_BATCH_H__
+#define __SHADOW_BATCH_H__
+
+#include "GPUScene.h"
+#include "Light.h"
+#include "Shader.h"
+#include "ShadowPool.h"
+#include <glm/glm.hpp>
+#include <array>
+#include <vector>
+
+constexpr unsigned int SHADOW_BATCH_BINDING = 6; // SSBO binding of the batch's light records
+
+// Per-light record of one batch, matches the std430 struct in ShadowBatch.vs
+struct ShadowBatchLight {
+    glm::mat4 faceMatrices[6];
+    glm::vec4 positionFar; // xyz = position, w = shadow far plane
+    int layer;             // First cube face layer drawn into
+    int mode;              // ShadowBatchMode, how the faces project
+    int pad[2];
+};
+
+// How a batch light's faces project, matches ShadowBatch.vs
+enum ShadowBatchMode {
+    SHADOW_BATCH_PERSPECTIVE = 0, // Cube faces or a spot map, depth is distance / far
+    SHADOW_BATCH_PARABOLOID = 1,  // Faces 0 and 1 are dual-paraboloid hemispheres
+    SHADOW_BATCH_ORTHO = 2        // Directional cascades, depth is the rasterized depth
+};
+
+// Renders the shadow draws of many lights at once. Every caster becomes one
+// indirect command over the GPUScene vertex buffer, with one instance per
+// (light, face) it reaches; the vertex shader picks the face matrix, or the
+// paraboloid hemisphere, and gl_Layer from the instance. One multi-draw
+// covers each resolution tier, so draw calls scale with the casters instead
+// of lights x casters.
+class ShadowBatch {
+public:
+    // batchShader uses ShadowBatch.vs, null when ARB_shader_viewport_layer_array is missing
+    ShadowBatch(GPUScene &scene, const Shader *batchShader);
+    ~ShadowBatch() noexcept;
+
+    // Remove copying
+    ShadowBatch(const ShadowBatch&) = delete;
+    ShadowBatch& operator=(const ShadowBatch&) = delete;
+
+    [[nodiscard]]
+    bool supported() const noexcept { return batchShader != nullptr; }
+
+    // Run the draws, pass 0 before pass 1. Returns the indirect commands issued.
+    unsigned int render(const std::vector<ShadowDraw> &draws);
+
+private:
+    GPUScene &scene;
+    const Shader *batchShader = nullptr;
+
+    unsigned int VAO = 0;
+    unsigned int instanceBuffer = 0; // uvec2 per instance: object, light * 6 + face
+    unsigned int commandBuffer = 0;
+    unsigned int lightBuffer = 0;
+    size_t instanceCapacity = 0;
+    size_t commandCapacity = 0;
+    size_t lightCapacity = 0;
+
+    // Scratch kept between tiers and frames
+    std::array<std::vector<const ShadowDraw*>, MAX_SHADOW_TIERS> tiers;
+    std::vector<ShadowBatchLight> lights;
+    std::vector<unsigned int> objectFirst; // Per object, its first instance, then the instance count
+    std::vector<unsigned int> objectNext;  // Where each object's next instance goes while filling
+    std::vector<glm::uvec2> instances;     // Grouped by object
+    std::vector<DrawCommand> commands;
+
+    // Draws sharing one tier's FBO, as one multi-draw
+    unsigned int renderTier(const std::vector<const ShadowDraw*> &draws);
+};
+
+#endif
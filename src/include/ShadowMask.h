@@ -0,0 +1,61 @@
+#ifndef __SHADOW_MASK_H__
+#define __SHADOW_MASK_H__
+
+#include "Light.h"
+#include "Shader.h"
+#include "ShadowPool.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+constexpr unsigned int SHADOW_MASK_IMAGE_UNIT = 2; // Image unit the lit shaders read the mask from, matches Lighting.glsl
+constexpr int SHADOW_MASK_LAYERS = 2;              // RGBA8 layers of the mask, one light per channel
+constexpr int MAX_SHADOW_MASK_LIGHTS = 4 * SHADOW_MASK_LAYERS; // Matches ShadowMask.fs
+
+// Screen-space shadows for the forward path. After the depth pre-pass, one
+// full-screen pass rebuilds each pixel's position and geometric normal from
+// the depth and resolves the shadow of the most important shadowed lights,
+// one RGBA8 channel each. The opaque lit draws then read their pixel's
+// channel instead of filtering the shadow map, so shadow lookups cost one per
+// pixel and masked light, however much overdraw there is. Lights without a
+// channel and transparent draws still look up the maps.
+class ShadowMask {
+public:
+    explicit ShadowMask(const Shader *resolveShader);
+    ~ShadowMask() noexcept;
+
+    // Remove copying
+    ShadowMask(const ShadowMask&) = delete;
+    ShadowMask& operator=(const ShadowMask&) = delete;
+
+    // Give the most important lights with a shadow map a channel, before the
+    // LightBuffer upload. The rest get -1 and keep their lookups.
+    void selectLights(const std::vector<Light*> &lights, const ShadowPool &pool,
+        const glm::vec3 &cameraPos, const glm::mat4 &projection);
+    // Copy the pre-pass depth from the window and resolve the selected lights
+    // into the mask. The resolve shader needs the LightBuffer bound.
+    // Leaves the window bound with the depth test on.
+    void resolve(int width, int height, const glm::mat4 &view, const glm::mat4 &projection);
+    // Read the mask in the lit shader's following draws, or stop for draws
+    // that aren't in the pre-pass's depth
+    void bind(const Shader &shader, bool enabled) const;
+
+    // Lights with a channel after the last selectLights()
+    [[nodiscard]]
+    size_t maskedLights() const noexcept { return channelLights.size(); }
+
+private:
+    const Shader *resolveShader;
+    int width = 0, height = 0;
+
+    unsigned int fbo = 0;
+    unsigned int maskTexture = 0;  // GL_RGBA8 2D array, SHADOW_MASK_LAYERS layers
+    unsigned int depthTexture = 0; // GL_DEPTH_COMPONENT24 copy of the pre-pass
+    unsigned int emptyVAO = 0;
+
+    std::vector<int> channelLights; // LightBuffer index of each channel's light
+
+    void createTargets();
+    void destroyTargets();
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef __SHADOW_POOL_H__
+#define __SHADOW_POOL_H__
+
+#include "Light.h"
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+constexpr unsigned int MAX_SHADOW_TIERS = 6; // Cubemap arrays the lit shaders sample
+// Texture units bindTextures() takes, shadowMaps[] and shadowCompareMaps[]
+constexpr unsigned int SHADOW_TEXTURE_UNITS = 2 * MAX_SHADOW_TIERS;
+
+enum class ShadowDepthFormat { Depth16, Depth24, Depth32F };
+
+// How the lit shaders filter the shadow maps, matches SHADOW_FILTER_* in Shader.fs
+enum class ShadowFilter {
+    Nearest, // One hard lookup
+    PCF,     // Hardware depth compares, bilinear over a 3x3 texel footprint
+    EVSM     // Exponential variance moments, blurred by the ShadowPrefilter
+};
+
+struct ShadowPoolSettings {
+    // Resolution tiers are the powers of two from minSize to maxSize
+    unsigned int minSize = 256;
+    unsigned int maxSize = 8192;
+    ShadowDepthFormat depthFormat = ShadowDepthFormat::Depth24;
+    size_t memoryBudget = size_t(512) << 20; // Bytes of depth storage across all tiers
+    float resolutionScale = 1.0f;            // Cube face texels per screen pixel the light covers
+    // ShadowMode::Auto lights switch to dual-paraboloid maps beyond this camera
+    // distance, 0 keeps them cubes
+    float paraboloidDistance = 20.0f;
+    bool paraboloidShadows = true; // Off forces cubes, the GPU-driven shadow pass only draws those
+    ShadowFilter filter = ShadowFilter::PCF;
+    // Only the most important lights get shadow maps, 0 for every light
+    unsigned int maxShadowedLights = 0;
+    float shadowFadeTime = 0.5f; // Seconds a light's shadow takes to fade in or out
+};
+
+// Shadow cubemaps for all lights, pooled in one cubemap array per resolution
+// tier. Every frame each light gets the tier its screen coverage asks for,
+// stepping down while the pool is over budget. With a shadowed light limit,
+// lights are ranked by importance first and only the top ones get a map. A
+// light leaving the top keeps its map while its shadow fades out, one joining
+// fades its shadow in, so the set can change without popping.
+class ShadowPool {
+public:
+    ShadowPoolSettings settings;
+
+    explicit ShadowPool(const ShadowPoolSettings &settings = ShadowPoolSettings());
+    ~ShadowPool() noexcept;
+
+    // Remove copying
+    ShadowPool(const ShadowPool&) = delete;
+    ShadowPool& operator=(const ShadowPool&) = delete;
+
+    // Choose every light's resolution and assign its slot. Lights missing from
+    // the list give their slots back.
+    void update(const std::vector<Light*> &lights, const glm::vec3 &cameraPos,
+        const glm::mat4 &projection, int viewportHeight, float deltaTime);
+    // Second slot of the light's size for its cached static casters
+    bool allocateStaticLayer(Light &light);
+
+    // Cube face size the light's coverage asks for, before the budget
+    [[nodiscard]]
+    unsigned int desiredSize(const Light &light, const glm::vec3 &cameraPos,
+        const glm::mat4 &projection, int viewportHeight) const;
+    // Brightness times the share of the screen the light's range covers
+    [[nodiscard]]
+    float importance(const Light &light, const glm::vec3 &cameraPos, const glm::mat4 &projection) const;
+    [[nodiscard]]
+    size_t allocatedBytes() const noexcept;
+    // Lights holding a shadow map after the last update, fading ones included
+    [[nodiscard]]
+    size_t shadowedLights() const noexcept { return shadowedCount; }
+    // Bind every tier's cubemap array to shadowMaps[] from the given texture
+    // unit, or its moments with EVSM filtering, and its depth compare sampler
+    // to shadowCompareMaps[] after them. Uses SHADOW_TEXTURE_UNITS units.
+    void bindTextures(const Shader &shader, int textureUnit) const;
+    // EVSM moments of a tier, 0 unless filtering with EVSM
+    [[nodiscard]]
+    unsigned int momentTexture(int tier) const noexcept { return tiers[tier].momentTexture; }
+
+private:
+    struct Tier {
+        unsigned int size = 0;
+        unsigned int texture = 0; // GL_TEXTURE_CUBE_MAP_ARRAY, 6 layers per slot
+        unsigned int fbo = 0;
+        unsigned int faceFBO = 0; // One layer at a time, re-attached per face
+        unsigned int momentTexture = 0; // GL_RGBA16F cubemap array for EVSM, same layers
+        std::vector<bool> used;
+    };
+    struct Allocation {
+        int tier = -1;
+        int slot = -1;
+        int staticSlot = -1;
+    };
+
+    std::vector<Tier> tiers;
+    std::unordered_map<Light*, Allocation> allocations;
+    unsigned int compareSampler = 0; // Linear filtered depth compares for PCF
+    bool budgetWarned = false;
+    size_t shadowedCount = 0;
+
+    // Screen height fraction covered by the light's range sphere
+    [[nodiscard]]
+    float screenCoverage(const Light &light, const glm::vec3 &cameraPos, const glm::mat4 &projection) const;
+    // Shadow fade targets of the lights, 1 for the most important
+    void selectShadowedLights(const std::vector<Light*> &lights, const glm::vec3 &cameraPos,
+        const glm::mat4 &projection, std::vector<float> &targets) const;
+
+    [[nodiscard]]
+    size_t cubeBytes(unsigned int size) const noexcept;
+    // Create or free the tiers' EVSM moments to match the filter
+    void updateMoments();
+    int allocateSlot(int tier);
+    bool growTier(int tier, size_t capacity);
+    void release(Allocation &allocation);
+    void assign(Light &light, Allocation &allocation);
+};
+
+#endif
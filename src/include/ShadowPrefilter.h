@@ -0,0 +1,42 @@
+#ifndef __SHADOW_PREFILTER_H__
+#define __SHADOW_PREFILTER_H__
+
+#include "Light.h"
+#include "ShadowPool.h"
+#include "Shader.h"
+#include <vector>
+
+constexpr unsigned int PREFILTER_GROUP_SIZE = 8;
+constexpr int MAX_PREFILTER_RADIUS = 8;
+
+// Turns freshly drawn shadow map faces into blurred EVSM moments for the
+// pool's moment textures. A horizontal pass warps the depth into moments and
+// blurs them into a scratch array, a vertical pass blurs that into the face.
+// Each face is blurred on its own, so cube maps can show faint seams at the
+// face edges.
+class ShadowPrefilter {
+public:
+    int radius = 2; // Blur taps on each side, up to MAX_PREFILTER_RADIUS
+
+    // prefilterShader uses ShadowPrefilter.cs
+    ShadowPrefilter(ShadowPool &pool, const Shader *prefilterShader);
+    ~ShadowPrefilter() noexcept;
+
+    // Remove copying
+    ShadowPrefilter(const ShadowPrefilter&) = delete;
+    ShadowPrefilter& operator=(const ShadowPrefilter&) = delete;
+
+    // Filter the faces of the light's shadow map in faceMask. Returns the faces filtered.
+    unsigned int filter(const Light &light, unsigned int faceMask);
+    // Filter every face the draws changed in the lights' shadow maps
+    unsigned int filter(const std::vector<ShadowDraw> &draws);
+
+private:
+    ShadowPool &pool;
+    const Shader *prefilterShader = nullptr;
+
+    unsigned int scratchTexture = 0; // GL_RGBA32F 2D array, one layer per face
+    unsigned int scratchSize = 0;
+};
+
+#endif
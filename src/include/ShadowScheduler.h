@@ -0,0 +1,44 @@
+#ifndef __SHADOW_SCHEDULER_H__
+#define __SHADOW_SCHEDULER_H__
+
+#include "Light.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+struct ShadowSchedulerSettings {
+    // Cube faces redrawn per frame, 0 for no limit
+    unsigned int faceBudget = 0;
+    // GPU time for the shadow pass per frame, 0 for no limit. Turned into a
+    // face budget with the measured cost per face.
+    double millisecondBudget = 0.0;
+};
+
+// Spreads shadow map updates over frames. Every frame the dirty cube faces of
+// all lights are ranked by the light's importance, its closeness to the camera
+// and how long the face has waited, and the best ones up to the budget are
+// redrawn. Waiting faces gain priority each frame, so lower ranked faces take
+// turns instead of starving.
+class ShadowScheduler {
+public:
+    ShadowSchedulerSettings settings;
+
+    explicit ShadowScheduler(const ShadowSchedulerSettings &settings = ShadowSchedulerSettings())
+    : settings(settings) {}
+
+    // Pick the faces to redraw this frame from each light's dirtyFaceMask().
+    // faceMasks gets one mask per light, returns the number of faces picked.
+    unsigned int schedule(const std::vector<Light*> &lights, const glm::vec3 &cameraPos,
+        std::vector<unsigned int> &faceMasks);
+    // Feed back the measured shadow pass time for the faces drawn, for the millisecond budget
+    void measure(double milliseconds, double faces);
+
+    // Faces allowed this frame, 0 for no limit
+    [[nodiscard]]
+    unsigned int budget() const noexcept;
+
+private:
+    double millisecondsPerFace = 0.0;
+    unsigned int frame = 0;
+};
+
+#endif
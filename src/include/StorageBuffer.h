@@ -0,0 +1,22 @@
+#ifndef __STORAGE_BUFFER_H__
+#define __STORAGE_BUFFER_H__
+
+#include <glad/gl.h>
+#include <algorithm>
+#include <vector>
+
+// Upload into an SSBO, growing it to twice the data when it doesn't fit.
+// Never empty, so it can be bound. Capacity counts elements.
+template <typename T>
+inline void uploadStorageBuffer(unsigned int buffer, size_t &capacity, const std::vector<T> &data) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    if (data.size() > capacity || capacity == 0) {
+        capacity = std::max<size_t>(data.size() * 2, 64);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+    }
+    if (!data.empty())
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, data.size() * sizeof(T), data.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+#endif
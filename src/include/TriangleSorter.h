@@ -0,0 +1,86 @@
+#ifndef __TRIANGLE_SORTER_H__
+#define __TRIANGLE_SORTER_H__
+
+#include "Object.h"
+#include "WorkerPool.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct TriangleSorterSettings {
+    // Out of order neighbours per triangle in last frame's order up to which
+    // it's patched with an insertion sort instead of re-sorted
+    float insertionSortFraction = 1.0f / 64.0f;
+    // Element moves per triangle the insertion sort may make before giving up on it
+    unsigned int insertionSortMoves = 4;
+    // Triangles per worker below which sorting stays on one thread
+    size_t minTrianglesPerWorker = 8192;
+};
+
+// Back to front order of each transparent object's translucent triangles,
+// redone every frame from the camera position. Centroid distances are
+// quantized to 16-bit keys and radix sorted in two 8-bit passes, split
+// across the worker pool. The order is kept between frames: if the new keys
+// leave it sorted nothing is uploaded, and if only a few neighbours swapped
+// an insertion sort patches it. Changed orders are rewritten into the
+// object's dynamic index buffer.
+class TriangleSorter {
+public:
+    struct Stats {
+        size_t objects = 0;
+        size_t triangles = 0;
+        size_t kept = 0;            // Orders still sorted, or camera and object unchanged
+        size_t insertionSorted = 0; // Patched in place
+        size_t radixSorted = 0;     // Sorted from scratch
+        double milliseconds = 0.0;
+    };
+    Stats stats;
+    TriangleSorterSettings settings;
+
+    explicit TriangleSorter(WorkerPool &workers, const TriangleSorterSettings &settings = TriangleSorterSettings());
+    ~TriangleSorter() noexcept;
+
+    // Remove copying
+    TriangleSorter(const TriangleSorter&) = delete;
+    TriangleSorter& operator=(const TriangleSorter&) = delete;
+
+    // Sort the translucent triangles of each object back to front from the camera
+    void sort(const std::vector<Object*> &objects, const glm::vec3 &cameraPos);
+    // Draw the object's translucent triangles in their last sorted order
+    void draw(const Object &object, const glm::mat4 &view, const glm::mat4 &projection) const;
+    void resetStats() noexcept { stats = Stats(); }
+
+private:
+    struct Entry {
+        unsigned int indexBuffer = 0;
+        size_t triangleCount = 0;
+        // SoA centroids of the translucent triangles, in object space
+        std::vector<float> centroidX, centroidY, centroidZ;
+        std::vector<float> distances;
+        std::vector<uint16_t> keys;
+        std::vector<uint32_t> order;   // Triangles back to front
+        std::vector<uint32_t> scratch; // Radix sort ping-pong
+        std::vector<uint32_t> indices;
+        // Camera and transform the order was sorted for
+        glm::vec3 sortedCamera = glm::vec3(0.0f);
+        unsigned int sortedVersion = 0;
+        bool sorted = false;
+    };
+
+    WorkerPool &workers;
+    std::unordered_map<const Object*, Entry> entries;
+    // Radix histograms, 256 buckets per worker
+    std::vector<uint32_t> histograms;
+    // Distance range per worker while computing keys
+    std::vector<float> minimums, maximums;
+
+    Entry &entryFor(const Object &object);
+    void computeKeys(Entry &entry, const Object &object, const glm::vec3 &cameraPos);
+    // Patch last frame's order, false if it's too far from sorted
+    bool insertionSort(Entry &entry) const;
+    void radixSort(Entry &entry);
+    void upload(Entry &entry, const Object &object);
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef __WEIGHTED_BLENDED_OIT_H__
+#define __WEIGHTED_BLENDED_OIT_H__
+
+#include "Shader.h"
+
+enum class TransparencyMode {
+    Sorted,          // Back to front by object distance, wrong where objects overlap
+    SortedTriangles, // Objects back to front, and each one's triangles by a TriangleSorter
+    WeightedBlended  // Order-independent, no sorting
+};
+
+// Weighted blended order-independent transparency (McGuire and Bavoil).
+// Transparent draws add their premultiplied color, weighted by alpha and
+// depth, into an accumulation target and multiply their coverage out of a
+// revealage target, both order-independent blends. A full-screen pass then
+// blends the weighted average over the scene by the revealed amount. The
+// draws test against a copy of the scene depth and need no sorting, so they
+// can go through the same batched draws as opaque geometry.
+class WeightedBlendedOIT {
+public:
+    explicit WeightedBlendedOIT(const Shader *compositeShader);
+    ~WeightedBlendedOIT() noexcept;
+
+    // Remove copying
+    WeightedBlendedOIT(const WeightedBlendedOIT&) = delete;
+    WeightedBlendedOIT& operator=(const WeightedBlendedOIT&) = delete;
+
+    // Copy the bound framebuffer's depth, clear the targets and bind them
+    // with their blend modes for the transparent draws. The lit shader
+    // writes to them with weightedBlended set.
+    void begin(int width, int height);
+    // Blend the result over the framebuffer bound at begin() and restore
+    // opaque drawing state
+    void composite() const;
+
+private:
+    const Shader *compositeShader;
+    int width = 0, height = 0;
+    int targetFBO = 0; // Framebuffer the scene was drawn to
+
+    unsigned int fbo = 0;
+    unsigned int accumulationTexture = 0; // GL_RGBA16F, sum of weighted premultiplied color and weighted alpha
+    unsigned int revealageTexture = 0;    // GL_R8, product of 1 - alpha
+    unsigned int depthTexture = 0;        // GL_DEPTH_COMPONENT24 copy of the scene's
+    unsigned int emptyVAO = 0;
+
+    void createTargets();
+    void destroyTargets();
+};
+
+#endif
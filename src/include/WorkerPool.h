@@ -0,0 +1,51 @@
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for data-parallel CPU work within a frame. The
+// calling thread works as worker 0 and every call waits for all workers, so
+// the work splits the same way every time.
+class WorkerPool {
+public:
+    // 0 uses one thread per hardware thread, the caller included
+    explicit WorkerPool(unsigned int threadCount = 0);
+    ~WorkerPool() noexcept;
+
+    // Remove copying
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Workers including the calling thread
+    [[nodiscard]]
+    unsigned int workerCount() const noexcept { return (unsigned int)threads.size() + 1; }
+
+    // Run task(worker) once on every worker and wait for all of them
+    void run(const std::function<void(unsigned int worker)> &task);
+    // Split [0, count) into one contiguous range per worker, in worker order.
+    // Counts under minPerWorker per worker use fewer workers.
+    void parallelFor(size_t count, size_t minPerWorker,
+        const std::function<void(size_t begin, size_t end, unsigned int worker)> &body);
+
+    // Workers parallelFor() uses for count items
+    [[nodiscard]]
+    unsigned int workersFor(size_t count, size_t minPerWorker) const noexcept;
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(unsigned int)> *task = nullptr;
+    unsigned int generation = 0;
+    unsigned int pending = 0;
+    bool stopping = false;
+
+    void workerLoop(unsigned int worker);
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "OcclusionBuffer.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+
+// Software occlusion buffer against a known scene: one 4x4 quad facing the
+// camera 5 units down -Z, and boxes behind, beside and in front of it.
+// Needs no GL context, run with `make test`.
+
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+    if (condition) return;
+    std::cerr << "FAILED: " << what << std::endl;
+    failures++;
+}
+
+static AABB box(const glm::vec3 &min, const glm::vec3 &max) {
+    AABB result;
+    result.min = min;
+    result.max = max;
+    return result;
+}
+
+// Draw the occluder from a camera at the origin looking down -Z
+static void drawOccluder(OcclusionBuffer &buffer, const std::vector<glm::vec3> &quad) {
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    buffer.begin(projection * view);
+    buffer.addOccluder(quad, glm::mat4(1.0f));
+    buffer.rasterize();
+}
+
+int main() {
+    // Counter-clockwise seen from the camera
+    const std::vector<glm::vec3> quad = {
+        { -2.0f, -2.0f, -5.0f }, { 2.0f, -2.0f, -5.0f }, { 2.0f, 2.0f, -5.0f },
+        { -2.0f, -2.0f, -5.0f }, { 2.0f, 2.0f, -5.0f }, { -2.0f, 2.0f, -5.0f },
+    };
+
+    WorkerPool workers(4);
+    OcclusionBuffer buffer(workers, 64, 64);
+    drawOccluder(buffer, quad);
+
+    expect(buffer.rasterizedTriangles() == 2, "both quad triangles are rasterized");
+    expect(!buffer.isVisible(box({ -0.5f, -0.5f, -11.0f }, { 0.5f, 0.5f, -10.0f })), "box behind the quad is hidden");
+    expect(!buffer.isVisible(box({ -1.5f, -1.5f, -6.0f }, { 1.5f, 1.5f, -5.5f })), "box just behind the quad is hidden");
+    expect(buffer.isVisible(box({ 5.0f, -0.5f, -11.0f }, { 6.0f, 0.5f, -10.0f })), "box beside the quad is visible");
+    expect(buffer.isVisible(box({ -0.5f, 3.0f, -8.0f }, { 0.5f, 4.0f, -7.0f })), "box above the quad is visible");
+    expect(buffer.isVisible(box({ -5.0f, -5.0f, -11.0f }, { 5.0f, 5.0f, -10.0f })), "box wider than the quad is visible");
+    expect(buffer.isVisible(box({ -0.5f, -0.5f, -3.0f }, { 0.5f, 0.5f, -2.0f })), "box in front of the quad is visible");
+    expect(buffer.isVisible(box({ -0.5f, -0.5f, -5.5f }, { 0.5f, 0.5f, -4.5f })), "box through the quad is visible");
+
+    // Facing away it's culled and hides nothing
+    std::vector<glm::vec3> backFacing = quad;
+    std::swap(backFacing[1], backFacing[2]);
+    std::swap(backFacing[4], backFacing[5]);
+    OcclusionBuffer culled(workers, 64, 64);
+    drawOccluder(culled, backFacing);
+    expect(culled.rasterizedTriangles() == 0, "back facing quad is culled");
+    expect(culled.isVisible(box({ -0.5f, -0.5f, -11.0f }, { 0.5f, 0.5f, -10.0f })), "back facing quad hides nothing");
+
+    // The same depth whatever the number of workers
+    WorkerPool single(1);
+    OcclusionBuffer reference(single, 64, 64);
+    drawOccluder(reference, quad);
+    expect(reference.depth() == buffer.depth(), "depth doesn't depend on the worker count");
+
+    if (failures > 0) {
+        std::cerr << failures << " OcclusionBuffer checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "OcclusionBuffer checks passed" << std::endl;
+    return 0;
+}